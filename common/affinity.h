@@ -0,0 +1,95 @@
+/*
+ * Copyright 2020-2022 F4PGA Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+// Pairs items, e.g. cells to be packed into one site, by affinity. Items
+// that share a key such as a net or a parent instance gain the weight of
+// the key for every pair among them. Each item is only linked to the next
+// max_neighbors items of a key, which keeps the number of candidate pairs
+// linear in the number of items.
+class AffinityMatcher
+{
+  public:
+    AffinityMatcher(size_t count, size_t max_neighbors = 8) : count_(count), max_neighbors_(max_neighbors) {}
+
+    // Adds a key shared by the given items. The items must be sorted and
+    // must not repeat.
+    void add_key(const std::vector<int> &items, int weight)
+    {
+        for (size_t i = 0; i < items.size(); ++i) {
+            for (size_t j = i + 1; j < items.size() && j <= i + max_neighbors_; ++j) {
+                scores_[((uint64_t)items[i] << 32) | (uint32_t)items[j]] += weight;
+            }
+        }
+    }
+
+    // Picks pairs greedily by decreasing score, ties broken by index, then
+    // pairs the remaining items in order with a score of 0. Returns the
+    // pairs as (first, second, score) and sets unpaired to the item left
+    // over or to -1.
+    std::vector<std::tuple<int, int, int>> match(int &unpaired) const
+    {
+        std::vector<std::tuple<int, int, int>> candidates;
+        for (const auto &it : scores_) {
+            candidates.push_back(std::make_tuple(-it.second, (int)(it.first >> 32), (int)(uint32_t)it.first));
+        }
+        std::sort(candidates.begin(), candidates.end());
+
+        std::vector<std::tuple<int, int, int>> pairs;
+        std::vector<bool> paired(count_, false);
+        for (const auto &candidate : candidates) {
+            int a = std::get<1>(candidate);
+            int b = std::get<2>(candidate);
+            if (paired[a] || paired[b]) {
+                continue;
+            }
+            paired[a] = paired[b] = true;
+            pairs.push_back(std::make_tuple(a, b, -std::get<0>(candidate)));
+        }
+
+        unpaired = -1;
+        for (size_t i = 0; i < count_; ++i) {
+            if (paired[i]) {
+                continue;
+            }
+            if (unpaired < 0) {
+                unpaired = i;
+            } else {
+                pairs.push_back(std::make_tuple(unpaired, (int)i, 0));
+                unpaired = -1;
+            }
+        }
+
+        return pairs;
+    }
+
+  private:
+    size_t count_;
+    size_t max_neighbors_;
+    std::unordered_map<uint64_t, int> scores_;
+};
+
+#endif // AFFINITY_H
@@ -0,0 +1,66 @@
+/*
+ * Copyright 2020-2022 F4PGA Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+#ifndef HIERARCHY_H
+#define HIERARCHY_H
+
+#include "kernel/rtlil.h"
+
+#include <string>
+#include <vector>
+
+// Returns the instance path of the module that contained a cell before the
+// design was flattened, outermost instance first. The path is taken from the
+// hdlname attribute or, for cells without it, from the name that flatten
+// gives to cells. Returns an empty path for top level cells.
+inline std::vector<std::string> cell_hier_path(const Yosys::RTLIL::Cell *cell)
+{
+    std::vector<std::string> path;
+    if (cell->has_attribute(Yosys::ID::hdlname)) {
+        path = Yosys::split_tokens(cell->get_string_attribute(Yosys::ID::hdlname), " ");
+        if (!path.empty()) {
+            path.pop_back();
+        }
+        return path;
+    }
+
+    // Strip escaping and the prefix that flatten adds to private names
+    std::string name = cell->name.str();
+    if (name.compare(0, 2, "\\$") == 0) {
+        name = name.substr(1);
+    }
+    if (name.compare(0, 9, "$flatten\\") == 0) {
+        name = name.substr(9);
+    } else if (name[0] == '\\') {
+        name = name.substr(1);
+    } else {
+        return path;
+    }
+
+    // The path ends where a private name starts or at the last dot
+    size_t end = name.find(".$");
+    if (end == std::string::npos) {
+        end = name.rfind('.');
+    }
+    if (end == std::string::npos) {
+        return path;
+    }
+    return Yosys::split_tokens(name.substr(0, end), ".");
+}
+
+#endif // HIERARCHY_H
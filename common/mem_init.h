@@ -0,0 +1,195 @@
+/*
+ * Copyright 2020-2022 F4PGA Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+#ifndef MEM_INIT_H
+#define MEM_INIT_H
+
+#include "kernel/yosys.h"
+
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/stat.h>
+#include <utility>
+#include <vector>
+
+// Contents of a memory initialization file in $readmemh or $readmemb
+// syntax. Every word is stored with its address and its bits, LSB first,
+// independent of the width of the memory it is loaded into.
+struct mem_init_file {
+    std::vector<std::pair<int, std::vector<Yosys::RTLIL::State>>> words;
+};
+
+// Parses one word of the given radix into bits, LSB first. Returns false
+// on an invalid digit.
+inline bool parse_mem_init_word(const std::string &token, bool binary, std::vector<Yosys::RTLIL::State> &bits)
+{
+    const int digit_bits = binary ? 1 : 4;
+    bits.clear();
+    bits.reserve(token.size() * digit_bits);
+    for (auto it = token.rbegin(); it != token.rend(); ++it) {
+        char c = *it;
+        if (c == '_') {
+            continue;
+        }
+
+        Yosys::RTLIL::State special = Yosys::RTLIL::State::Sm;
+        int value = -1;
+        if (c == 'x' || c == 'X') {
+            special = Yosys::RTLIL::State::Sx;
+        } else if (c == 'z' || c == 'Z' || c == '?') {
+            special = Yosys::RTLIL::State::Sz;
+        } else if (c >= '0' && c <= '9') {
+            value = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            value = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            value = c - 'A' + 10;
+        }
+        if (special == Yosys::RTLIL::State::Sm && (value < 0 || value >= (1 << digit_bits))) {
+            return false;
+        }
+
+        for (int i = 0; i < digit_bits; ++i) {
+            if (special != Yosys::RTLIL::State::Sm) {
+                bits.push_back(special);
+            } else {
+                bits.push_back((value >> i) & 1 ? Yosys::RTLIL::State::S1 : Yosys::RTLIL::State::S0);
+            }
+        }
+    }
+    return !bits.empty();
+}
+
+// Parses the text of a memory initialization file. Tokens that cannot be
+// parsed are reported and skipped.
+inline void parse_mem_init_file(const std::string &text, bool binary, const std::string &path, mem_init_file &file)
+{
+    int cursor = 0;
+    size_t pos = 0;
+    std::vector<Yosys::RTLIL::State> bits;
+    while (pos < text.size()) {
+        char c = text[pos];
+
+        // Whitespace and comments
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+            pos++;
+            continue;
+        }
+        if (text.compare(pos, 2, "//") == 0) {
+            pos = text.find('\n', pos);
+            continue;
+        }
+        if (text.compare(pos, 2, "/*") == 0) {
+            pos = text.find("*/", pos + 2);
+            pos = pos == std::string::npos ? pos : pos + 2;
+            continue;
+        }
+
+        size_t end = text.find_first_of(" \t\r\n/", pos);
+        if (end == pos) {
+            end++;
+        }
+        std::string token = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end;
+
+        // Address, always hexadecimal
+        if (token[0] == '@') {
+            const char *nptr = token.c_str() + 1;
+            char *endptr;
+            long value = strtol(nptr, &endptr, 16);
+            if (!*nptr || *endptr) {
+                Yosys::log("Can not parse address `%s` in `%s`.\n", token.c_str(), path.c_str());
+                continue;
+            }
+            cursor = value;
+            continue;
+        }
+
+        if (!parse_mem_init_word(token, binary, bits)) {
+            Yosys::log("Can not parse value `%s` in `%s`.\n", token.c_str(), path.c_str());
+            continue;
+        }
+        file.words.push_back(std::make_pair(cursor++, bits));
+    }
+}
+
+// Loads a memory initialization file. Parsed files are cached by path,
+// modification time and size, so a file referenced by many memories is read
+// only once. The size catches most rewrites within the one second resolution
+// of the modification time. Returns nullptr if the file cannot be opened.
+inline const mem_init_file *load_mem_init_file(const std::string &path, bool binary)
+{
+    struct cache_entry {
+        time_t mtime;
+        off_t size;
+        mem_init_file file;
+    };
+    static std::map<std::pair<std::string, bool>, cache_entry> cache;
+
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        return nullptr;
+    }
+
+    auto key = std::make_pair(path, binary);
+    auto it = cache.find(key);
+    if (it != cache.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size) {
+        return &it->second.file;
+    }
+
+    std::ifstream f(path.c_str());
+    if (f.fail()) {
+        return nullptr;
+    }
+    std::stringstream text;
+    text << f.rdbuf();
+
+    cache_entry &entry = cache[key];
+    entry.mtime = st.st_mtime;
+    entry.size = st.st_size;
+    entry.file.words.clear();
+    parse_mem_init_file(text.str(), binary, path, entry.file);
+    return &entry.file;
+}
+
+// Builds the INIT value of a memory with the given geometry, word 0 at the
+// LSB. Words are truncated or zero-extended to the memory width and bits
+// not set by the file are filled with the given state. Returns the number
+// of words whose address is out of range in out_of_range.
+inline Yosys::RTLIL::Const mem_init_to_const(const mem_init_file &file, int width, int depth, Yosys::RTLIL::State fill, int &out_of_range)
+{
+    Yosys::RTLIL::Const init(fill, width * depth);
+    out_of_range = 0;
+    for (const auto &word : file.words) {
+        if (word.first < 0 || word.first >= depth) {
+            out_of_range++;
+            continue;
+        }
+
+        const auto &bits = word.second;
+        size_t offset = (size_t)word.first * width;
+        for (int i = 0; i < width; ++i) {
+            init.bits[offset + i] = i < (int)bits.size() ? bits[i] : Yosys::RTLIL::State::S0;
+        }
+    }
+    return init;
+}
+
+#endif // MEM_INIT_H
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2020-2022 F4PGA Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ *
+ */
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Returns the number of worker threads to use when the user did not ask for
+// a specific number. Honors the YOSYS_PLUGIN_THREADS environment variable.
+inline int default_thread_count()
+{
+    const char *env = std::getenv("YOSYS_PLUGIN_THREADS");
+    if (env != nullptr && std::atoi(env) > 0) {
+        return std::atoi(env);
+    }
+
+    unsigned int count = std::thread::hardware_concurrency();
+    return count > 0 ? (int)count : 1;
+}
+
+// Calls func(i) for every i in [0, count) using up to num_threads threads.
+// Items are handed out dynamically so uneven item costs balance out. Runs
+// inline when there is a single thread or a single item.
+//
+// Note that most of the Yosys kernel is not thread-safe. In particular
+// creating or copying RTLIL::IdString objects and logging must not happen
+// inside func.
+template <typename F> inline void parallel_for(size_t count, int num_threads, F func)
+{
+    size_t workers = std::min((size_t)std::max(num_threads, 1), count);
+    if (workers <= 1) {
+        for (size_t i = 0; i < count; ++i) {
+            func(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        for (size_t i = next++; i < count; i = next++) {
+            func(i);
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (size_t i = 1; i < workers; ++i) {
+        threads.emplace_back(worker);
+    }
+    worker();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+#endif // PARALLEL_H
@@ -1,6 +1,12 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
+#include "libs/json11/json11.hpp"
+
+#include "../common/parallel.h"
+
+#include <chrono>
+#include <sys/stat.h>
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -10,12 +16,17 @@ PRIVATE_NAMESPACE_BEGIN
 struct DspFF : public Pass {
 
     /// A structure identifying specific pin in a cell instance
+    ///
+    /// The port name is stored as its IdString index. Pins are created while
+    /// modules are analyzed concurrently and copying an RTLIL::IdString is not
+    /// thread-safe. Unlike a reference to a cell connection dict key the index
+    /// stays valid when new ports get connected to the cell later on.
     struct CellPin {
-        RTLIL::Cell *cell;    /// Cell pointer (nullptr for top-level ports)
-        RTLIL::IdString port; /// Port name
-        int bit;              /// Bit index
+        RTLIL::Cell *cell; /// Cell pointer (nullptr for top-level ports)
+        int port;          /// Port name (IdString index)
+        int bit;           /// Bit index
 
-        CellPin(RTLIL::Cell *_cell, const RTLIL::IdString &_port, int _bit = 0) : cell(_cell), port(_port), bit(_bit) {}
+        CellPin(RTLIL::Cell *_cell, const RTLIL::IdString &_port, int _bit = 0) : cell(_cell), port(_port.index_), bit(_bit) {}
 
         CellPin(const CellPin &ref) = default;
         CellPin(CellPin &&ref) = default;
@@ -26,25 +37,33 @@ struct DspFF : public Pass {
             if (cell != nullptr) {
                 h = mkhash_add(h, cell->hash());
             }
-            h = mkhash_add(h, port.hash());
+            h = mkhash_add(h, port);
             h = mkhash_add(h, bit);
             return h;
         }
 
         bool operator==(const CellPin &ref) const { return (cell == ref.cell) && (port == ref.port) && (bit == ref.bit); }
 
+        bool isPort(const RTLIL::IdString &a_Port) const { return port == a_Port.index_; }
+
         std::string as_string() const
         {
+            std::string name = RTLIL::unescape_id(std::string(RTLIL::IdString::global_id_storage_.at(port)));
             if (cell != nullptr) {
-                return stringf("%s.%s[%d]", RTLIL::unescape_id(cell->name).c_str(), RTLIL::unescape_id(port).c_str(), bit);
+                return stringf("%s.%s[%d]", RTLIL::unescape_id(cell->name).c_str(), name.c_str(), bit);
             } else {
-                return stringf("%s[%d]", RTLIL::unescape_id(port).c_str(), bit);
+                return stringf("%s[%d]", name.c_str(), bit);
             }
         }
     };
 
     // ..........................................
 
+    /// Directions (input, output) of cell ports indexed by the IdString
+    /// indices of the cell type and the port name. Resolved before the
+    /// concurrent analysis as Cell::input() and Cell::output() copy IdStrings.
+    typedef dict<std::pair<int, int>, std::pair<bool, bool>> PortDirs;
+
     /// Connection map
     struct ConnMap {
 
@@ -54,7 +73,7 @@ struct DspFF : public Pass {
         dict<RTLIL::SigBit, CellPin> drivers;
 
         /// Builds the map
-        void build(RTLIL::Module *module, const SigMap &sigmap)
+        void build(RTLIL::Module *module, const SigMap &sigmap, const PortDirs &dirs)
         {
             clear();
 
@@ -62,17 +81,18 @@ struct DspFF : public Pass {
             for (auto *cell : module->cells()) {
                 for (const auto &it : cell->connections_) {
                     const auto &port = it.first;
+                    const auto &dir = dirs.at(std::make_pair(cell->type.index_, port.index_));
                     const auto &sigbits = it.second.bits();
                     for (size_t i = 0; i < sigbits.size(); ++i) {
                         auto sigbit = sigmap(sigbits[i]);
 
                         // This is an input port (sink))
-                        if (cell->input(port)) {
+                        if (dir.first) {
                             auto &vec = sinks[sigbit];
                             vec.push_back(CellPin(cell, port, i));
                         }
                         // This is a source
-                        if (cell->output(port)) {
+                        if (dir.second) {
                             drivers.insert(std::make_pair(sigbit, CellPin(cell, port, i)));
                         }
                     }
@@ -184,10 +204,103 @@ struct DspFF : public Pass {
         dict<RegisterType, std::vector<PortType>> registers;
     };
 
+    /// A DSP register along with its place in a pipeline. Register sections
+    /// of a DSP that cover the same set of ports are successive stages of
+    /// a pipeline on these ports, in the order of the rules file.
+    struct RegisterSlot {
+        const RegisterType *reg;
+        const std::vector<PortType> *ports;
+
+        /// Pipeline stage, starting from 1
+        int stage = 1;
+        /// Indices of slots of the previous and the next stages
+        std::vector<size_t> prevStages;
+        std::vector<size_t> nextStages;
+        /// Parameters set by a previous stage that this stage sets to
+        /// a different value (eg. a register depth)
+        pool<RTLIL::IdString> overrides;
+    };
+
     /// Describes a changes made to a DSP cell
     struct DspChanges {
         pool<RTLIL::IdString> params; // Modified params
         pool<RTLIL::IdString> conns;  // Altered connections (ports)
+        pool<size_t> slots;           // Register slots flip-flops got integrated into
+    };
+
+    /// Categories of reasons for not integrating a flip-flop
+    enum class Rejection { NONE, MULTI_SINK, NON_FLOP, CONTROL_CONFLICT, PARAM_CONFLICT, MODULE_EDGE };
+
+    static const char *rejectionName(Rejection a_Rejection)
+    {
+        switch (a_Rejection) {
+        case Rejection::MULTI_SINK:
+            return "multi-sink";
+        case Rejection::NON_FLOP:
+            return "non-ff";
+        case Rejection::CONTROL_CONFLICT:
+            return "control-conflict";
+        case Rejection::PARAM_CONFLICT:
+            return "param-conflict";
+        case Rejection::MODULE_EDGE:
+            return "module-edge";
+        default:
+            return "none";
+        }
+    }
+
+    /// Integration statistics of a DSP port (or a group of them)
+    struct PortStats {
+        int absorbed = 0;                  /// Bits with flip-flops integrated
+        std::map<Rejection, int> rejected; /// Bits left in fabric per reason
+
+        int rejectedCount() const
+        {
+            int count = 0;
+            for (const auto &it : rejected) {
+                count += it.second;
+            }
+            return count;
+        }
+
+        void add(const PortStats &a_Other)
+        {
+            absorbed += a_Other.absorbed;
+            for (const auto &it : a_Other.rejected) {
+                rejected[it.first] += it.second;
+            }
+        }
+    };
+
+    /// The last decision made for a DSP register slot
+    struct SlotDecision {
+        int round = 0;                          /// Round in which the decision was made
+        bool absorbed = false;                  /// Whether flip-flops were integrated
+        std::string reason;                     /// Why they were not
+        Rejection rejection = Rejection::NONE;  /// Category of the reason
+        dict<RTLIL::IdString, PortStats> ports; /// Statistics of the slot ports
+    };
+
+    /// Per-module working state of the pass
+    struct ModuleContext {
+        /// The module
+        RTLIL::Module *module;
+        /// DSP cells of the module, in the module cell order
+        std::vector<RTLIL::Cell *> dspCells;
+
+        /// Temporary SigBit to SigBit helper map.
+        SigMap sigMap;
+        /// Module connection map
+        ConnMap connMap;
+
+        /// Cells to be removed
+        pool<RTLIL::Cell *> cellsToRemove;
+        /// DSP cells that got changed
+        dict<RTLIL::Cell *, DspChanges> dspChanges;
+        /// Decisions made for register slots of DSP cells
+        dict<RTLIL::Cell *, dict<size_t, SlotDecision>> decisions;
+
+        ModuleContext(RTLIL::Module *a_Module) : module(a_Module) {}
     };
 
     // ..........................................
@@ -224,73 +337,138 @@ struct DspFF : public Pass {
 
     // ..........................................
 
-    /// Loads FF and DSP integration rules from a file
-    void load_rules(const std::string &a_FileName)
+    /// A set of DSP and flip-flop integration rules
+    struct Rules {
+        /// DSP types
+        dict<RTLIL::IdString, DspType> dspTypes;
+        /// Flip-flop types
+        dict<RTLIL::IdString, FlopType> flopTypes;
+    };
+
+    /// Rules compiled from a file along with the file state they correspond to
+    struct CachedRules {
+        time_t mtime = 0;
+        off_t size = 0;
+        Rules rules;
+    };
+
+    /// Splits a string into fields delimited by whitespace
+    static std::vector<std::string> splitFields(const std::string &a_String)
     {
+        std::vector<std::string> fields;
 
-        // Parses a string and returns a vector of fields delimited by the
-        // given character.
-        auto getFields = [](const std::string &a_String, const char a_Delim = ' ', bool a_KeepEmpty = false) {
-            std::vector<std::string> fields;
-            std::stringstream ss(a_String);
+        size_t i = 0;
+        while (i < a_String.size()) {
+            while (i < a_String.size() && isspace((unsigned char)a_String[i])) {
+                i++;
+            }
 
-            while (ss.good()) {
-                std::string field;
-                std::getline(ss, field, a_Delim);
-                if (!field.empty() || a_KeepEmpty) {
-                    fields.push_back(field);
-                }
+            size_t j = i;
+            while (j < a_String.size() && !isspace((unsigned char)a_String[j])) {
+                j++;
             }
 
-            return fields;
-        };
+            if (j > i) {
+                fields.push_back(a_String.substr(i, j - i));
+            }
+            i = j;
+        }
 
-        // Parses a vector of strings like "<name>=<value>" starting from the
-        // second one on the list
-        auto parseNameValue = [&](const std::vector<std::string> &strs) {
-            const std::regex expr("(\\S+)=(\\S+)");
-            std::smatch match;
+        return fields;
+    }
 
-            std::vector<std::pair<std::string, std::string>> vec;
+    /// Splits "<name>=<value>" at the last '=' that leaves both parts
+    /// non-empty. Returns false if there is no such '='.
+    static bool splitNameValue(const std::string &a_String, std::string &a_Name, std::string &a_Value)
+    {
+        for (size_t pos = a_String.rfind('='); pos != std::string::npos && pos > 0; pos = a_String.rfind('=', pos - 1)) {
+            if (pos + 1 < a_String.size()) {
+                a_Name = a_String.substr(0, pos);
+                a_Value = a_String.substr(pos + 1);
+                return true;
+            }
+        }
 
-            for (size_t i = 1; i < strs.size(); ++i) {
-                if (std::regex_match(strs[i], match, expr)) {
-                    vec.push_back(std::make_pair(match[1], match[2]));
-                } else {
-                    log_error(" syntax error: '%s'\n", strs[i].c_str());
+        return false;
+    }
+
+    /// Parses port name as "<name>[<hi>:<lo>]" or just "<name>". In the
+    /// latter case both bit indices are set to -1. Returns false if the bit
+    /// range is invalid.
+    static bool parsePortName(const std::string &a_String, std::string &a_Name, int &a_Hi, int &a_Lo)
+    {
+        a_Name = a_String;
+        a_Hi = -1;
+        a_Lo = -1;
+
+        // Parses a non-empty decimal number
+        auto parseNumber = [](const std::string &str, int &value) {
+            if (str.empty() || str.size() > 9) {
+                return false;
+            }
+            value = 0;
+            for (char c : str) {
+                if (c < '0' || c > '9') {
+                    return false;
                 }
+                value = value * 10 + (c - '0');
             }
-
-            return vec;
+            return true;
         };
 
-        // Parses port name as "<name>[<hi>:<lo>]" or just "<name>"
-        auto parsePortName = [&](const std::string &str) {
-            const std::regex expr("^(.*)\\[([0-9]+):([0-9]+)\\]");
-            std::smatch match;
+        if (a_String.empty() || a_String.back() != ']') {
+            return true;
+        }
 
-            std::tuple<std::string, int, int> data;
-            auto res = std::regex_match(str, match, expr);
-            if (res) {
-                data = std::make_tuple(std::string(match[1]), std::stoi(match[2]), std::stoi(match[3]));
+        size_t open = a_String.rfind('[');
+        if (open == std::string::npos) {
+            return true;
+        }
+        size_t colon = a_String.find(':', open);
+        if (colon == std::string::npos) {
+            return true;
+        }
 
-                if ((std::get<2>(data) > std::get<1>(data)) || std::get<2>(data) < 0 || std::get<1>(data) < 0) {
-                    log_error(" invalid port spec: '%s'\n", str.c_str());
-                }
-            } else {
-                data = std::make_tuple(str, -1, -1);
-            }
+        int hi, lo;
+        if (!parseNumber(a_String.substr(open + 1, colon - open - 1), hi) ||
+            !parseNumber(a_String.substr(colon + 1, a_String.size() - colon - 2), lo)) {
+            return true;
+        }
 
-            return data;
-        };
+        a_Name = a_String.substr(0, open);
+        a_Hi = hi;
+        a_Lo = lo;
+
+        return lo <= hi;
+    }
 
-        std::ifstream file(a_FileName);
+    /// Parses FF and DSP integration rules in the text format. Parsing does
+    /// not stop at errors, all of them are appended to a_Errors.
+    void parseRules(std::istream &a_Stream, Rules &a_Rules, std::vector<std::string> &a_Errors)
+    {
+        int lineNo = 0;
         std::string line;
 
-        log("Loading rules from '%s'...\n", a_FileName.c_str());
-        if (!file) {
-            log_error(" Error opening file '%s'!\n", a_FileName.c_str());
-        }
+        auto error = [&](const std::string &a_Message) { a_Errors.push_back(stringf("line %d: %s", lineNo, a_Message.c_str())); };
+        auto syntaxError = [&]() { error(stringf("syntax error: '%s'", line.c_str())); };
+        auto unexpected = [&](const std::string &a_Keyword) { error(stringf("unexpected keyword '%s'", a_Keyword.c_str())); };
+
+        // Parses a list of fields like "<name>=<value>" starting from the
+        // second one on the list
+        auto parseNameValue = [&](const std::vector<std::string> &strs) {
+            std::vector<std::pair<std::string, std::string>> vec;
+
+            for (size_t i = 1; i < strs.size(); ++i) {
+                std::string name, value;
+                if (splitNameValue(strs[i], name, value)) {
+                    vec.push_back(std::make_pair(name, value));
+                } else {
+                    error(stringf("syntax error: '%s'", strs[i].c_str()));
+                }
+            }
+
+            return vec;
+        };
 
         // Parse each port as if it was associated with its own DSP register.
         // Group them each time a port definition is complete.
@@ -305,51 +483,58 @@ struct DspFF : public Pass {
 
         std::vector<std::string> tok;
 
-        // Parse the file
-        while (1) {
+        const RTLIL::IdString clkId = RTLIL::escape_id("clk");
+        const RTLIL::IdString rstId = RTLIL::escape_id("rst");
+        const RTLIL::IdString enaId = RTLIL::escape_id("ena");
+        const RTLIL::IdString dId = RTLIL::escape_id("d");
+        const RTLIL::IdString qId = RTLIL::escape_id("q");
 
-            // Get line
-            std::getline(file, line);
-            if (!file) {
-                break;
-            }
+        // Parse the stream
+        while (std::getline(a_Stream, line)) {
+            lineNo++;
 
             // Strip comment if any, skip empty lines
-            size_t pos = line.find("#");
+            size_t pos = line.find('#');
             if (pos != std::string::npos) {
-                line = line.substr(0, pos);
+                line.resize(pos);
             }
-            if (line.find_first_not_of(" \r\n\t") == std::string::npos) {
+
+            // Split the line
+            const auto fields = splitFields(line);
+            if (fields.empty()) {
                 continue;
             }
 
-            // Split the line
-            const auto fields = getFields(line);
-            log_assert(fields.size() >= 1);
+            const auto &keyword = fields[0];
+            const std::string block = tok.empty() ? std::string() : tok.back();
 
             // DSP section
-            if (fields[0] == "dsp") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
-                }
+            if (keyword == "dsp") {
                 if (!tok.empty()) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                    unexpected(keyword);
+                    continue;
                 }
-                tok.push_back(fields[0]);
+                if (fields.size() < 2) {
+                    syntaxError();
+                }
+                tok.push_back(keyword);
 
                 dspTypes.resize(dspTypes.size() + 1);
-                dspTypes.back().name = RTLIL::escape_id(fields[1]);
+                if (fields.size() >= 2) {
+                    dspTypes.back().name = RTLIL::escape_id(fields[1]);
+                }
 
                 dspAliases.clear();
                 for (size_t i = 2; i < fields.size(); ++i) {
                     dspAliases.push_back(RTLIL::escape_id(fields[i]));
                 }
-            } else if (fields[0] == "enddsp") {
-                if (fields.size() != 1) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            } else if (keyword == "enddsp") {
+                if (tok.size() != 1 || block != "dsp") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() != 1 || tok.back() != "dsp") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() != 1) {
+                    syntaxError();
                 }
                 tok.pop_back();
 
@@ -362,23 +547,29 @@ struct DspFF : public Pass {
             }
 
             // DSP port section
-            else if (fields[0] == "port") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "port") {
+                if (tok.size() != 1 || block != "dsp") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() != 1 || tok.back() != "dsp") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
                 }
-                tok.push_back(fields[0]);
-
-                auto spec = parsePortName(fields[1]);
+                tok.push_back(keyword);
 
                 portType = PortType();
-                portType.name = RTLIL::escape_id(std::get<0>(spec));
-                portType.bits = std::make_pair(std::get<2>(spec), std::get<1>(spec));
-                portType.assoc.insert(std::make_pair(RTLIL::escape_id("clk"), std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
-                portType.assoc.insert(std::make_pair(RTLIL::escape_id("rst"), std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
-                portType.assoc.insert(std::make_pair(RTLIL::escape_id("ena"), std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
+                if (fields.size() >= 2) {
+                    std::string name;
+                    int hi, lo;
+                    if (!parsePortName(fields[1], name, hi, lo)) {
+                        error(stringf("invalid port spec: '%s'", fields[1].c_str()));
+                    }
+                    portType.name = RTLIL::escape_id(name);
+                    portType.bits = std::make_pair(lo, hi);
+                }
+                portType.assoc.insert(std::make_pair(clkId, std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
+                portType.assoc.insert(std::make_pair(rstId, std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
+                portType.assoc.insert(std::make_pair(enaId, std::make_pair(RTLIL::IdString(), RTLIL::Sx)));
 
                 registerType = RegisterType();
 
@@ -387,12 +578,13 @@ struct DspFF : public Pass {
                     portNames.push_back(fields[i]);
                 }
 
-            } else if (fields[0] == "endport") {
-                if (fields.size() != 1) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            } else if (keyword == "endport") {
+                if (tok.size() != 2 || block != "port") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() != 2 || tok.back() != "port") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() != 1) {
+                    syntaxError();
                 }
                 tok.pop_back();
 
@@ -401,125 +593,97 @@ struct DspFF : public Pass {
                 dspType.registers[registerType].push_back(portType);
 
                 // Store any extra DSP ports belonging to the same register
-                for (const auto &name : portNames) {
-                    auto spec = parsePortName(name);
+                for (const auto &portName : portNames) {
+                    std::string name;
+                    int hi, lo;
+                    if (!parsePortName(portName, name, hi, lo)) {
+                        error(stringf("invalid port spec: '%s'", portName.c_str()));
+                    }
 
                     PortType portTypeCopy = portType;
-                    portTypeCopy.name = RTLIL::escape_id(std::get<0>(spec));
-                    portTypeCopy.bits = std::make_pair(std::get<2>(spec), std::get<1>(spec));
+                    portTypeCopy.name = RTLIL::escape_id(name);
+                    portTypeCopy.bits = std::make_pair(lo, hi);
 
                     dspType.registers[registerType].push_back(portTypeCopy);
                 }
             }
 
             // Flip-flop type section
-            else if (fields[0] == "ff") {
-                if (fields.size() != 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
-                }
+            else if (keyword == "ff") {
                 if (!tok.empty()) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                    unexpected(keyword);
+                    continue;
                 }
-                tok.push_back(fields[0]);
+                if (fields.size() != 2) {
+                    syntaxError();
+                }
+                tok.push_back(keyword);
 
                 flopTypes.resize(flopTypes.size() + 1);
-                flopTypes.back().name = RTLIL::escape_id(fields[1]);
-                flopTypes.back().ports.insert(std::make_pair(RTLIL::escape_id("clk"), RTLIL::IdString()));
-                flopTypes.back().ports.insert(std::make_pair(RTLIL::escape_id("rst"), RTLIL::IdString()));
-                flopTypes.back().ports.insert(std::make_pair(RTLIL::escape_id("ena"), RTLIL::IdString()));
-                flopTypes.back().ports.insert(std::make_pair(RTLIL::escape_id("d"), RTLIL::IdString()));
-                flopTypes.back().ports.insert(std::make_pair(RTLIL::escape_id("q"), RTLIL::IdString()));
-            } else if (fields[0] == "endff") {
-                if (fields.size() != 1) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+                if (fields.size() >= 2) {
+                    flopTypes.back().name = RTLIL::escape_id(fields[1]);
+                }
+                flopTypes.back().ports.insert(std::make_pair(clkId, RTLIL::IdString()));
+                flopTypes.back().ports.insert(std::make_pair(rstId, RTLIL::IdString()));
+                flopTypes.back().ports.insert(std::make_pair(enaId, RTLIL::IdString()));
+                flopTypes.back().ports.insert(std::make_pair(dId, RTLIL::IdString()));
+                flopTypes.back().ports.insert(std::make_pair(qId, RTLIL::IdString()));
+            } else if (keyword == "endff") {
+                if (tok.size() != 1 || block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() != 1 || tok.back() != "ff") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() != 1) {
+                    syntaxError();
                 }
                 tok.pop_back();
             }
 
-            // Signals
-            else if (fields[0] == "clk") {
-                if (tok.size() == 0 || (tok.back() != "port" && tok.back() != "ff")) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
-                }
-
-                // Associated clock
-                if (tok.back() == "port") {
-                    if (fields.size() != 3) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
-                    }
-                    portType.assoc[RTLIL::escape_id("clk")] = std::make_pair(RTLIL::escape_id(fields[1]), RTLIL::Const::from_string(fields[2]));
-                } else if (tok.back() == "ff") {
-                    if (fields.size() != 2) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
-                    }
-                    flopTypes.back().ports[RTLIL::escape_id("clk")] = RTLIL::escape_id(fields[1]);
-                }
-            } else if (fields[0] == "rst") {
-                if (tok.size() == 0 || (tok.back() != "port" && tok.back() != "ff")) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
-                }
+            // Control signals
+            else if (keyword == "clk" || keyword == "rst" || keyword == "ena") {
+                const RTLIL::IdString key = RTLIL::escape_id(keyword);
 
-                // Associated reset
-                if (tok.back() == "port") {
+                // Associated clock / reset / enable
+                if (block == "port") {
                     if (fields.size() != 3) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
-                    }
-                    portType.assoc[RTLIL::escape_id("rst")] = std::make_pair(RTLIL::escape_id(fields[1]), RTLIL::Const::from_string(fields[2]));
-                } else if (tok.back() == "ff") {
-                    if (fields.size() != 2) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
-                    }
-                    flopTypes.back().ports[RTLIL::escape_id("rst")] = RTLIL::escape_id(fields[1]);
-                }
-            } else if (fields[0] == "ena") {
-                if (tok.size() == 0 || (tok.back() != "port" && tok.back() != "ff")) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
-                }
-
-                // Associated enable
-                if (tok.back() == "port") {
-                    if (fields.size() != 3) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
+                        syntaxError();
+                        continue;
                     }
-                    portType.assoc[RTLIL::escape_id("ena")] = std::make_pair(RTLIL::escape_id(fields[1]), RTLIL::Const::from_string(fields[2]));
-                } else if (tok.back() == "ff") {
+                    portType.assoc[key] = std::make_pair(RTLIL::escape_id(fields[1]), RTLIL::Const::from_string(fields[2]));
+                } else if (block == "ff") {
                     if (fields.size() != 2) {
-                        log_error(" syntax error: '%s'\n", line.c_str());
+                        syntaxError();
+                        continue;
                     }
-                    flopTypes.back().ports[RTLIL::escape_id("ena")] = RTLIL::escape_id(fields[1]);
+                    flopTypes.back().ports[key] = RTLIL::escape_id(fields[1]);
+                } else {
+                    unexpected(keyword);
                 }
             }
 
-            else if (fields[0] == "d") {
-                if (fields.size() != 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
-                }
-                if (tok.size() == 0 || tok.back() != "ff") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+            // Data signals
+            else if (keyword == "d" || keyword == "q") {
+                if (block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-
-                flopTypes.back().ports[RTLIL::escape_id("d")] = RTLIL::escape_id(fields[1]);
-            } else if (fields[0] == "q") {
                 if (fields.size() != 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
-                }
-                if (tok.size() == 0 || tok.back() != "ff") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                    syntaxError();
+                    continue;
                 }
 
-                flopTypes.back().ports[RTLIL::escape_id("q")] = RTLIL::escape_id(fields[1]);
+                flopTypes.back().ports[RTLIL::escape_id(keyword)] = RTLIL::escape_id(fields[1]);
             }
 
             // Parameters that must be set to certain values
-            else if (fields[0] == "require") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "require") {
+                if (block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() == 0 || tok.back() != "ff") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
+                    continue;
                 }
 
                 const auto vec = parseNameValue(fields);
@@ -528,12 +692,14 @@ struct DspFF : public Pass {
                 }
             }
             // Parameters that has to match for a flip-flop
-            else if (fields[0] == "match") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "match") {
+                if (block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() == 0 || tok.back() != "ff") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
+                    continue;
                 }
 
                 for (size_t i = 1; i < fields.size(); ++i) {
@@ -541,12 +707,14 @@ struct DspFF : public Pass {
                 }
             }
             // Parameters to set
-            else if (fields[0] == "set") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "set") {
+                if (block != "port" && block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() == 0 || (tok.back() != "port" && tok.back() != "ff")) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
+                    continue;
                 }
 
                 const auto vec = parseNameValue(fields);
@@ -555,19 +723,21 @@ struct DspFF : public Pass {
                     set.insert(std::make_pair(RTLIL::escape_id(it.first), RTLIL::Const(it.second)));
                 }
 
-                if (tok.back() == "port") {
+                if (block == "port") {
                     registerType.params.set.swap(set);
-                } else if (tok.back() == "ff") {
+                } else {
                     flopTypes.back().params.set.swap(set);
                 }
             }
             // Parameters to copy / map
-            else if (fields[0] == "map") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "map") {
+                if (block != "port" && block != "ff") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() == 0 || (tok.back() != "port" && tok.back() != "ff")) {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
+                    continue;
                 }
 
                 const auto vec = parseNameValue(fields);
@@ -576,19 +746,21 @@ struct DspFF : public Pass {
                     map.insert(std::make_pair(RTLIL::escape_id(it.first), RTLIL::escape_id(it.second)));
                 }
 
-                if (tok.back() == "port") {
+                if (block == "port") {
                     registerType.params.map.swap(map);
-                } else if (tok.back() == "ff") {
+                } else {
                     flopTypes.back().params.map.swap(map);
                 }
             }
             // Connections to make
-            else if (fields[0] == "con") {
-                if (fields.size() < 2) {
-                    log_error(" syntax error: '%s'\n", line.c_str());
+            else if (keyword == "con") {
+                if (block != "port") {
+                    unexpected(keyword);
+                    continue;
                 }
-                if (tok.size() == 0 || tok.back() != "port") {
-                    log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                if (fields.size() < 2) {
+                    syntaxError();
+                    continue;
                 }
 
                 const auto vec = parseNameValue(fields);
@@ -598,23 +770,331 @@ struct DspFF : public Pass {
             }
 
             else {
-                log_error(" unexpected keyword '%s'\n", fields[0].c_str());
+                unexpected(keyword);
             }
         }
 
+        if (!tok.empty()) {
+            error(stringf("missing 'end%s'", tok.back().c_str()));
+        }
+
         // Convert lists to maps
         for (const auto &it : dspTypes) {
-            if (m_DspTypes.count(it.name)) {
-                log_error(" duplicated rule for DSP '%s'\n", it.name.c_str());
+            if (it.name.empty()) {
+                continue;
+            }
+            if (a_Rules.dspTypes.count(it.name)) {
+                a_Errors.push_back(stringf("duplicated rule for DSP '%s'", it.name.c_str()));
+                continue;
             }
-            m_DspTypes.insert(std::make_pair(it.name, it));
+            a_Rules.dspTypes.insert(std::make_pair(it.name, it));
         }
         for (const auto &it : flopTypes) {
-            if (m_FlopTypes.count(it.name)) {
-                log_error(" duplicated rule for flip-flop '%s'\n", it.name.c_str());
+            if (it.name.empty()) {
+                continue;
+            }
+            if (a_Rules.flopTypes.count(it.name)) {
+                a_Errors.push_back(stringf("duplicated rule for flip-flop '%s'", it.name.c_str()));
+                continue;
+            }
+            a_Rules.flopTypes.insert(std::make_pair(it.name, it));
+        }
+    }
+
+    // ..........................................
+
+    /// Magic string and version at the beginning of a compiled rules file
+    static constexpr const char *COMPILED_RULES_MAGIC = "DSPFFBIN";
+    static constexpr uint32_t COMPILED_RULES_VERSION = 1;
+
+    /// Writes rules in the compiled (binary) format
+    struct CompiledRulesWriter {
+        std::ostream &os;
+
+        CompiledRulesWriter(std::ostream &_os) : os(_os) {}
+
+        void u32(uint32_t value)
+        {
+            for (int i = 0; i < 4; ++i) {
+                os.put((char)((value >> (8 * i)) & 0xFF));
+            }
+        }
+        void i32(int32_t value) { u32((uint32_t)value); }
+        void str(const std::string &value)
+        {
+            u32(value.size());
+            os.write(value.data(), value.size());
+        }
+        void id(const RTLIL::IdString &value) { str(value.empty() ? std::string() : value.str()); }
+        void cnst(const RTLIL::Const &value)
+        {
+            u32(value.flags);
+            str(value.as_string());
+        }
+
+        /// Dicts are stored in insertion order (the reverse of the iteration
+        /// order) so that reading them back gives the same iteration order.
+        template <typename T, typename F> void items(const T &a_Dict, F a_Func)
+        {
+            std::vector<typename T::const_iterator> its;
+            for (auto it = a_Dict.begin(); it != a_Dict.end(); ++it) {
+                its.push_back(it);
+            }
+            u32(its.size());
+            for (auto it = its.rbegin(); it != its.rend(); ++it) {
+                a_Func((*it)->first, (*it)->second);
+            }
+        }
+
+        void constDict(const dict<RTLIL::IdString, RTLIL::Const> &a_Dict)
+        {
+            items(a_Dict, [&](const RTLIL::IdString &k, const RTLIL::Const &v) {
+                id(k);
+                cnst(v);
+            });
+        }
+        void idDict(const dict<RTLIL::IdString, RTLIL::IdString> &a_Dict)
+        {
+            items(a_Dict, [&](const RTLIL::IdString &k, const RTLIL::IdString &v) {
+                id(k);
+                id(v);
+            });
+        }
+
+        void write(const Rules &a_Rules)
+        {
+            os.write(COMPILED_RULES_MAGIC, strlen(COMPILED_RULES_MAGIC));
+            u32(COMPILED_RULES_VERSION);
+
+            items(a_Rules.dspTypes, [&](const RTLIL::IdString &, const DspType &dspType) {
+                id(dspType.name);
+                items(dspType.registers, [&](const RegisterType &reg, const std::vector<PortType> &ports) {
+                    constDict(reg.params.set);
+                    idDict(reg.params.map);
+                    constDict(reg.connect);
+                    u32(ports.size());
+                    for (const auto &port : ports) {
+                        id(port.name);
+                        i32(port.bits.first);
+                        i32(port.bits.second);
+                        items(port.assoc, [&](const RTLIL::IdString &k, const std::pair<RTLIL::IdString, RTLIL::Const> &v) {
+                            id(k);
+                            id(v.first);
+                            cnst(v.second);
+                        });
+                    }
+                });
+            });
+
+            items(a_Rules.flopTypes, [&](const RTLIL::IdString &, const FlopType &flopType) {
+                id(flopType.name);
+                idDict(flopType.ports);
+                u32(flopType.params.matching.size());
+                for (const auto &it : flopType.params.matching) {
+                    id(it);
+                }
+                constDict(flopType.params.required);
+                constDict(flopType.params.set);
+                idDict(flopType.params.map);
+            });
+        }
+    };
+
+    /// Reads rules in the compiled (binary) format
+    struct CompiledRulesReader {
+        std::istream &is;
+        bool ok = true;
+
+        CompiledRulesReader(std::istream &_is) : is(_is) {}
+
+        uint32_t u32()
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < 4; ++i) {
+                int c = is.get();
+                if (c == EOF) {
+                    ok = false;
+                    return 0;
+                }
+                value |= (uint32_t)(c & 0xFF) << (8 * i);
+            }
+            return value;
+        }
+        int32_t i32() { return (int32_t)u32(); }
+        std::string str()
+        {
+            uint32_t size = u32();
+            std::string value(ok ? size : 0, '\0');
+            if (ok && size && !is.read(&value[0], size)) {
+                ok = false;
+            }
+            return value;
+        }
+        RTLIL::IdString id()
+        {
+            auto value = str();
+            return value.empty() ? RTLIL::IdString() : RTLIL::IdString(value);
+        }
+        RTLIL::Const cnst()
+        {
+            int flags = u32();
+            RTLIL::Const value = RTLIL::Const::from_string(str());
+            value.flags = flags;
+            return value;
+        }
+
+        /// Calls a_Func for each item of a stored list, stops on error
+        template <typename F> void items(F a_Func)
+        {
+            uint32_t count = u32();
+            for (uint32_t i = 0; ok && i < count; ++i) {
+                a_Func();
+            }
+        }
+
+        void constDict(dict<RTLIL::IdString, RTLIL::Const> &a_Dict)
+        {
+            items([&]() {
+                auto k = id();
+                a_Dict[k] = cnst();
+            });
+        }
+        void idDict(dict<RTLIL::IdString, RTLIL::IdString> &a_Dict)
+        {
+            items([&]() {
+                auto k = id();
+                a_Dict[k] = id();
+            });
+        }
+
+        /// Returns true if the stream holds compiled rules. Consumes the
+        /// header if so, rewinds the stream otherwise.
+        bool checkHeader()
+        {
+            const size_t len = strlen(COMPILED_RULES_MAGIC);
+            std::string magic(len, '\0');
+            if (is.read(&magic[0], len) && magic == COMPILED_RULES_MAGIC) {
+                return true;
             }
-            m_FlopTypes.insert(std::make_pair(it.name, it));
+
+            is.clear();
+            is.seekg(0);
+            return false;
         }
+
+        void read(Rules &a_Rules, std::vector<std::string> &a_Errors)
+        {
+            uint32_t version = u32();
+            if (!ok || version != COMPILED_RULES_VERSION) {
+                a_Errors.push_back(stringf("unsupported compiled rules version %u", version));
+                return;
+            }
+
+            items([&]() {
+                DspType dspType;
+                dspType.name = id();
+                items([&]() {
+                    RegisterType reg;
+                    constDict(reg.params.set);
+                    idDict(reg.params.map);
+                    constDict(reg.connect);
+
+                    auto &ports = dspType.registers[reg];
+                    items([&]() {
+                        PortType port;
+                        port.name = id();
+                        port.bits.first = i32();
+                        port.bits.second = i32();
+                        items([&]() {
+                            auto k = id();
+                            auto first = id();
+                            port.assoc[k] = std::make_pair(first, cnst());
+                        });
+                        ports.push_back(port);
+                    });
+                });
+                a_Rules.dspTypes[dspType.name] = dspType;
+            });
+
+            items([&]() {
+                FlopType flopType;
+                flopType.name = id();
+                idDict(flopType.ports);
+                items([&]() { flopType.params.matching.push_back(id()); });
+                constDict(flopType.params.required);
+                constDict(flopType.params.set);
+                idDict(flopType.params.map);
+                a_Rules.flopTypes[flopType.name] = flopType;
+            });
+
+            if (!ok) {
+                a_Errors.push_back("truncated compiled rules file");
+            }
+        }
+    };
+
+    /// Compiled rules cache, shared by all invocations within the process
+    /// and keyed by file path
+    dict<std::string, CachedRules> m_RulesCache;
+
+    /// Loads FF and DSP integration rules from a file, either in the text or
+    /// in the compiled format. Rules are compiled once and reused as long as
+    /// the file modification time and size stay the same. All errors found
+    /// in the file are reported at once.
+    const Rules &load_rules(const std::string &a_FileName)
+    {
+        struct stat st;
+        if (stat(a_FileName.c_str(), &st) != 0) {
+            log_error(" Error opening file '%s'!\n", a_FileName.c_str());
+        }
+
+        auto it = m_RulesCache.find(a_FileName);
+        if (it != m_RulesCache.end() && it->second.mtime == st.st_mtime && it->second.size == st.st_size) {
+            log("Using cached rules from '%s'.\n", a_FileName.c_str());
+            return it->second.rules;
+        }
+
+        std::ifstream file(a_FileName, std::ios::binary);
+
+        log("Loading rules from '%s'...\n", a_FileName.c_str());
+        if (!file) {
+            log_error(" Error opening file '%s'!\n", a_FileName.c_str());
+        }
+
+        CachedRules entry;
+        entry.mtime = st.st_mtime;
+        entry.size = st.st_size;
+
+        std::vector<std::string> errors;
+        CompiledRulesReader reader(file);
+        if (reader.checkHeader()) {
+            reader.read(entry.rules, errors);
+        } else {
+            parseRules(file, entry.rules, errors);
+        }
+
+        if (!errors.empty()) {
+            std::string message;
+            for (const auto &error : errors) {
+                message += stringf("  %s\n", error.c_str());
+            }
+            log_error("Found %zu error(s) in rules file '%s':\n%s", errors.size(), a_FileName.c_str(), message.c_str());
+        }
+
+        m_RulesCache[a_FileName] = entry;
+        return m_RulesCache.at(a_FileName).rules;
+    }
+
+    /// Writes rules to a file in the compiled format
+    void write_compiled_rules(const std::string &a_FileName, const Rules &a_Rules)
+    {
+        std::ofstream file(a_FileName, std::ios::binary);
+        if (!file) {
+            log_error(" Error opening file '%s' for writing!\n", a_FileName.c_str());
+        }
+
+        log("Writing compiled rules to '%s'...\n", a_FileName.c_str());
+        CompiledRulesWriter(file).write(a_Rules);
     }
 
     void dump_rules()
@@ -704,20 +1184,14 @@ struct DspFF : public Pass {
 
     // ..........................................
 
-    /// Temporary SigBit to SigBit helper map.
-    SigMap m_SigMap;
-    /// Module connection map
-    ConnMap m_ConnMap;
-
-    /// Cells to be removed (per module!)
-    pool<RTLIL::Cell *> m_CellsToRemove;
-    /// DSP cells that got changed
-    dict<RTLIL::Cell *, DspChanges> m_DspChanges;
-
     /// DSP types
     dict<RTLIL::IdString, DspType> m_DspTypes;
     /// Flip-flop types
     dict<RTLIL::IdString, FlopType> m_FlopTypes;
+    /// Register slots of DSP types
+    dict<RTLIL::IdString, std::vector<RegisterSlot>> m_DspSlots;
+    /// Directions of cell ports seen in the design so far
+    PortDirs m_PortDirs;
 
     // ..........................................
 
@@ -726,10 +1200,34 @@ struct DspFF : public Pass {
     void help() override
     {
         log("\n");
-        log("    dsp_ff -rules <rules.txt> [selection]\n");
+        log("    dsp_ff -rules <rules.txt> [options] [selection]\n");
         log("\n");
         log("Integrates flip-flops with DSP blocks and enables their internal registers.\n");
         log("\n");
+        log("    -rules <file>\n");
+        log("        Rules file, either in the text format described below or in the\n");
+        log("        compiled format written by '-compile'. Rules are compiled once\n");
+        log("        per process and reused as long as the file does not change.\n");
+        log("\n");
+        log("    -compile <file>\n");
+        log("        Write the loaded rules to <file> in the compiled (binary) format.\n");
+        log("\n");
+        log("    -validate\n");
+        log("        Only load and check the rules, do not process the design. All\n");
+        log("        errors found in a rules file are reported at once.\n");
+        log("\n");
+        log("    -report <file>\n");
+        log("        Write a JSON report explaining for each register of each DSP cell\n");
+        log("        whether flip-flops got integrated into it and if not, why. For each\n");
+        log("        DSP port it lists the number of bits absorbed and the number of bits\n");
+        log("        rejected per reason (multi-sink, non-ff, control-conflict,\n");
+        log("        param-conflict, module-edge). Also includes totals per DSP type and\n");
+        log("        the runtime of the pass in seconds.\n");
+        log("\n");
+        log("    -threads <N>\n");
+        log("        Number of threads used to analyze modules concurrently. Defaults\n");
+        log("        to the number of available cores.\n");
+        log("\n");
         log("The pass loads a set of rules from the file given with the '-rules' parameter.\n");
         log("The rules define what ports of a DSP module have internal registers and what\n");
         log("has to be done to enable them. They also define compatible flip-flop cell\n");
@@ -794,13 +1292,25 @@ struct DspFF : public Pass {
         log("The 'set' and 'map' statements serve the same function as in the DSP port\n");
         log("section but here they may differ depending on the flip-flop type being\n");
         log("integrated.\n");
+        log("\n");
+        log("Port sections of a DSP that list the same set of ports define successive\n");
+        log("stages of a register pipeline on these ports, in the order of appearance.\n");
+        log("A stage is used only after all previous ones are. A stage may 'set' a\n");
+        log("parameter set by a previous stage to a different value (eg. a register\n");
+        log("depth). Integration is repeated until no more flip-flops can be absorbed\n");
+        log("so a chain of flip-flops ends up in consecutive stages.\n");
     }
 
     void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
     {
         log_header(a_Design, "Executing DSP_FF pass.\n");
+        const auto startTime = std::chrono::steady_clock::now();
 
         std::string rulesFile;
+        std::string compiledFile;
+        std::string reportFile;
+        bool validateOnly = false;
+        int numThreads = default_thread_count();
 
         // Parse args
         size_t argidx;
@@ -809,6 +1319,22 @@ struct DspFF : public Pass {
                 rulesFile = a_Args[++argidx];
                 continue;
             }
+            if (a_Args[argidx] == "-compile" && (argidx + 1) < a_Args.size()) {
+                compiledFile = a_Args[++argidx];
+                continue;
+            }
+            if (a_Args[argidx] == "-validate") {
+                validateOnly = true;
+                continue;
+            }
+            if (a_Args[argidx] == "-report" && (argidx + 1) < a_Args.size()) {
+                reportFile = a_Args[++argidx];
+                continue;
+            }
+            if (a_Args[argidx] == "-threads" && (argidx + 1) < a_Args.size()) {
+                numThreads = std::max(1, atoi(a_Args[++argidx].c_str()));
+                continue;
+            }
 
             break;
         }
@@ -819,55 +1345,338 @@ struct DspFF : public Pass {
             log_cmd_error("No rules file specified!");
         }
 
-        // Reset state
-        m_CellsToRemove.clear();
-        m_DspChanges.clear();
-        m_DspTypes.clear();
-        m_FlopTypes.clear();
-
         // Load rules
         rewrite_filename(rulesFile);
-        load_rules(rulesFile);
+        const auto &rules = load_rules(rulesFile);
+        m_DspTypes = rules.dspTypes;
+        m_FlopTypes = rules.flopTypes;
+        buildRegisterSlots();
         if (log_force_debug) {
             dump_rules();
         }
 
-        // Process modules
+        if (!compiledFile.empty()) {
+            rewrite_filename(compiledFile);
+            write_compiled_rules(compiledFile, rules);
+        }
+
+        if (validateOnly) {
+            log("Rules OK: %d DSP type(s), %d flip-flop type(s).\n", GetSize(m_DspTypes), GetSize(m_FlopTypes));
+            return;
+        }
+
+        // Set up contexts. Selection queries are done here as they are not
+        // safe to do concurrently.
+        m_PortDirs.clear();
+        std::vector<ModuleContext> contexts;
         for (auto module : a_Design->selected_modules()) {
+            contexts.emplace_back(module);
+        }
+
+        // Integrate flip-flops in rounds until nothing changes. Each round
+        // absorbs at most one more stage of a register pipeline.
+        std::vector<ModuleContext *> pending;
+        for (auto &ctx : contexts) {
+            pending.push_back(&ctx);
+        }
 
-            // Setup the SigMap
-            m_SigMap.clear();
-            m_SigMap.set(module);
+        int round = 0;
+        while (!pending.empty()) {
+            round++;
 
-            // Build the connection map
-            m_ConnMap.clear();
-            m_ConnMap.build(module, m_SigMap);
+            // Analyze modules concurrently. This only reads the netlist and
+            // the port directions resolved here beforehand.
+            for (auto *ctx : pending) {
+                resolvePortDirs(ctx->module);
+            }
+            parallel_for(pending.size(), numThreads, [&](size_t i) { analyzeModule(*pending[i]); });
+
+            // Integrate flip-flops, module by module in the selection order so
+            // that the result and the log do not depend on the thread count.
+            std::vector<ModuleContext *> changed;
+            for (auto *ctx : pending) {
+                integrateModule(*ctx, round);
+
+                // Remove cells
+                for (const auto &cell : ctx->cellsToRemove) {
+                    ctx->module->remove(cell);
+                }
+
+                if (!ctx->cellsToRemove.empty()) {
+                    ctx->cellsToRemove.clear();
+                    changed.push_back(ctx);
+                }
+            }
+
+            pending.swap(changed);
+        }
+        log_debug("Flip-flop integration done in %d round(s)\n", round);
 
-            // Look for DSP cells
-            for (auto cell : module->cells()) {
+        if (!reportFile.empty()) {
+            rewrite_filename(reportFile);
+            const std::chrono::duration<double> runtime = std::chrono::steady_clock::now() - startTime;
+            writeReport(reportFile, contexts, runtime.count());
+        }
+    }
 
-                // Not a DSP
-                if (!m_DspTypes.count(cell->type)) {
+    /// Groups register sections of each DSP type into pipeline stages
+    void buildRegisterSlots()
+    {
+        m_DspSlots.clear();
+        for (const auto &it : m_DspTypes) {
+            auto &slots = m_DspSlots[it.first];
+
+            // Keep the processing order of registers. The rules file order
+            // is the reverse of it (the insertion order of the dict).
+            for (const auto &reg : it.second.registers) {
+                slots.emplace_back();
+                slots.back().reg = &reg.first;
+                slots.back().ports = &reg.second;
+            }
+
+            auto portNames = [](const RegisterSlot &slot) {
+                std::set<RTLIL::IdString> names;
+                for (const auto &port : *slot.ports) {
+                    names.insert(port.name);
+                }
+                return names;
+            };
+
+            // Link stages, starting from the first one in the file
+            for (size_t i = slots.size(); i-- > 0;) {
+                auto &slot = slots[i];
+                const auto names = portNames(slot);
+
+                for (size_t j = slots.size(); --j > i;) {
+                    auto &prev = slots[j];
+                    if (portNames(prev) != names) {
+                        continue;
+                    }
+
+                    slot.prevStages.push_back(j);
+                    prev.nextStages.push_back(i);
+                    slot.stage = std::max(slot.stage, prev.stage + 1);
+
+                    for (const auto &param : prev.reg->params.set) {
+                        if (slot.reg->params.set.count(param.first) && slot.reg->params.set.at(param.first) != param.second) {
+                            slot.overrides.insert(param.first);
+                        }
+                    }
+                }
+            }
+        }
+    }
+
+    /// Adds directions of ports of all cells of a module to the port direction
+    /// table. Must not be called concurrently.
+    void resolvePortDirs(RTLIL::Module *a_Module)
+    {
+        for (auto cell : a_Module->cells()) {
+            for (const auto &it : cell->connections()) {
+                auto key = std::make_pair(cell->type.index_, it.first.index_);
+                if (!m_PortDirs.count(key)) {
+                    m_PortDirs[key] = std::make_pair(cell->input(it.first), cell->output(it.first));
+                }
+            }
+        }
+    }
+
+    /// Builds the SigMap and the connection map of a module and collects its
+    /// DSP cells. Does not modify the netlist nor log so it is safe to run
+    /// for different modules concurrently.
+    void analyzeModule(ModuleContext &a_Ctx)
+    {
+        // Setup the SigMap
+        a_Ctx.sigMap.set(a_Ctx.module);
+
+        // Build the connection map
+        a_Ctx.connMap.build(a_Ctx.module, a_Ctx.sigMap, m_PortDirs);
+
+        // Look for DSP cells
+        a_Ctx.dspCells.clear();
+        for (auto cell : a_Ctx.module->cells()) {
+            if (m_DspTypes.count(cell->type)) {
+                a_Ctx.dspCells.push_back(cell);
+            }
+        }
+    }
+
+    /// Returns true if a register slot of a DSP cell is in use. It is when
+    /// flip-flops were integrated into it, its control parameters are set
+    /// already or a later stage of the pipeline is in use.
+    bool isSlotUsed(const ModuleContext &a_Ctx, RTLIL::Cell *a_Cell, const std::vector<RegisterSlot> &a_Slots, size_t a_Index)
+    {
+        const auto &slot = a_Slots[a_Index];
+
+        if (a_Ctx.dspChanges.count(a_Cell) && a_Ctx.dspChanges.at(a_Cell).slots.count(a_Index)) {
+            return true;
+        }
+
+        for (const auto &it : slot.reg->params.set) {
+            if (a_Cell->hasParam(it.first) && a_Cell->getParam(it.first) == it.second) {
+                return true;
+            }
+        }
+
+        for (auto next : slot.nextStages) {
+            if (isSlotUsed(a_Ctx, a_Cell, a_Slots, next)) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /// Attempts to integrate flip-flops into free register slots of all DSP
+    /// cells of a module
+    void integrateModule(ModuleContext &a_Ctx, int a_Round)
+    {
+        for (auto cell : a_Ctx.dspCells) {
+            const auto &slots = m_DspSlots.at(cell->type);
+            auto &decisions = a_Ctx.decisions[cell];
+
+            // Slots that got flip-flops in this round. A next stage has to
+            // wait for the next round as the connectivity has changed.
+            pool<size_t> absorbed;
+
+            for (size_t i = 0; i < slots.size(); ++i) {
+                const auto &slot = slots[i];
+                auto &decision = decisions[i];
+
+                if (isSlotUsed(a_Ctx, cell, slots, i)) {
+                    if (decision.round == 0) {
+                        log_debug(" register %zu of %s is already in use\n", i, cell->name.c_str());
+                        decision.reason = "register already in use";
+                    }
+                    continue;
+                }
+
+                decision.round = a_Round;
+
+                bool ready = true;
+                for (auto prev : slot.prevStages) {
+                    if (!isSlotUsed(a_Ctx, cell, slots, prev) || absorbed.count(prev)) {
+                        decision.reason = stringf("stage %d is not used", slots[prev].stage);
+                        ready = false;
+                        break;
+                    }
+                }
+                if (!ready) {
                     continue;
                 }
 
-                // Process all registers
-                auto &dspType = m_DspTypes.at(cell->type);
-                for (auto &rule : dspType.registers) {
-                    processRegister(cell, rule.first, rule.second);
+                decision.reason.clear();
+                decision.rejection = Rejection::NONE;
+                decision.ports.clear();
+                decision.absorbed = processRegister(a_Ctx, cell, slot, decision);
+                if (decision.absorbed) {
+                    a_Ctx.dspChanges[cell].slots.insert(i);
+                    absorbed.insert(i);
                 }
             }
+        }
+    }
+
+    /// Writes the JSON report of integration decisions
+    static json11::Json::object statsToJson(const PortStats &a_Stats)
+    {
+        json11::Json::object reasons;
+        for (const auto &it : a_Stats.rejected) {
+            reasons[rejectionName(it.first)] = it.second;
+        }
+
+        return json11::Json::object{
+            {"absorbed", a_Stats.absorbed},
+            {"rejected", a_Stats.rejectedCount()},
+            {"reasons", reasons},
+        };
+    }
+
+    void writeReport(const std::string &a_FileName, const std::vector<ModuleContext> &a_Contexts, double a_Runtime)
+    {
+        std::ofstream file(a_FileName);
+        if (!file) {
+            log_error(" Error opening file '%s' for writing!\n", a_FileName.c_str());
+        }
 
-            // Remove cells
-            for (const auto &cell : m_CellsToRemove) {
-                module->remove(cell);
+        json11::Json::array cells;
+        std::map<std::string, std::pair<int, PortStats>> types;
+        for (const auto &ctx : a_Contexts) {
+            for (auto cell : ctx.dspCells) {
+                const auto &slots = m_DspSlots.at(cell->type);
+                const auto &decisions = ctx.decisions.at(cell);
+
+                // Port statistics summed over all stages, in the order of
+                // the first appearance of the port
+                std::vector<std::pair<RTLIL::IdString, PortStats>> portStats;
+                dict<RTLIL::IdString, size_t> portIndex;
+
+                json11::Json::array registers;
+                for (size_t i = 0; i < slots.size(); ++i) {
+                    const auto &slot = slots[i];
+                    const auto &decision = decisions.at(i);
+
+                    json11::Json::array ports;
+                    for (const auto &port : *slot.ports) {
+                        ports.push_back(RTLIL::unescape_id(port.name));
+                    }
+
+                    for (const auto &port : *slot.ports) {
+                        if (!portIndex.count(port.name)) {
+                            portIndex[port.name] = portStats.size();
+                            portStats.push_back(std::make_pair(port.name, PortStats()));
+                        }
+                    }
+                    for (const auto &it : decision.ports) {
+                        portStats[portIndex.at(it.first)].second.add(it.second);
+                    }
+
+                    registers.push_back(json11::Json::object{
+                        {"ports", ports},
+                        {"stage", slot.stage},
+                        {"round", decision.round},
+                        {"absorbed", decision.absorbed},
+                        {"reason", decision.reason},
+                        {"category", rejectionName(decision.rejection)},
+                    });
+                }
+
+                auto &type = types[RTLIL::unescape_id(cell->type)];
+                type.first++;
+
+                json11::Json::array ports;
+                for (const auto &it : portStats) {
+                    auto stats = statsToJson(it.second);
+                    stats["port"] = RTLIL::unescape_id(it.first);
+                    ports.push_back(stats);
+                    type.second.add(it.second);
+                }
+
+                cells.push_back(json11::Json::object{
+                    {"module", RTLIL::unescape_id(ctx.module->name)},
+                    {"cell", RTLIL::unescape_id(cell->name)},
+                    {"type", RTLIL::unescape_id(cell->type)},
+                    {"ports", ports},
+                    {"registers", registers},
+                });
             }
-            m_CellsToRemove.clear();
         }
 
-        // Clear maps
-        m_SigMap.clear();
-        m_ConnMap.clear();
+        json11::Json::object dspTypes;
+        for (const auto &it : types) {
+            auto stats = statsToJson(it.second.second);
+            stats["cells"] = it.second.first;
+            dspTypes[it.first] = stats;
+        }
+
+        json11::Json report = json11::Json::object{
+            {"dsp_cells", cells},
+            {"dsp_types", dspTypes},
+            {"runtime_s", a_Runtime},
+        };
+
+        log("Writing report to '%s'...\n", a_FileName.c_str());
+        file << report.dump() << std::endl;
     }
 
     // ..........................................
@@ -903,11 +1712,13 @@ struct DspFF : public Pass {
         return isOk;
     }
 
-    bool checkFlopDataAgainstDspRegister(const FlopData &a_FlopData, RTLIL::Cell *a_Cell, const RegisterType &a_Register,
-                                         const std::vector<PortType> &a_Ports)
+    bool checkFlopDataAgainstDspRegister(ModuleContext &a_Ctx, const FlopData &a_FlopData, RTLIL::Cell *a_Cell, const RegisterSlot &a_Slot,
+                                         Rejection &a_Rejection)
     {
+        const auto &a_Register = *a_Slot.reg;
+        const auto &a_Ports = *a_Slot.ports;
         const auto &flopType = m_FlopTypes.at(a_FlopData.type);
-        const auto &changes = m_DspChanges[a_Cell];
+        const auto &changes = a_Ctx.dspChanges[a_Cell];
         bool isOk = true;
 
         log_debug("  checking connected flip-flop settings against the DSP register... ");
@@ -924,13 +1735,23 @@ struct DspFF : public Pass {
                     auto sigbits = sigspec.bits();
                     log_assert(sigbits.size() <= 1);
                     if (!sigbits.empty()) {
-                        conn = m_SigMap(sigbits[0]);
+                        conn = a_Ctx.sigMap(sigbits[0]);
                     }
                 }
 
+                // A flip-flop without the signal needs the default value,
+                // eg. one connected by a previous pipeline stage
+                RTLIL::SigBit flopConn = RTLIL::SigBit(RTLIL::SigChunk(it.second.second));
+                if (a_FlopData.conns.count(key)) {
+                    flopConn = a_FlopData.conns.at(key);
+                }
+
                 if (conn.is_wire() || (!conn.is_wire() && conn.data != RTLIL::Sx)) {
-                    if (conn != a_FlopData.conns.at(key)) {
+                    if (conn != flopConn) {
                         log_debug("\n   connection to port '%s' mismatch", port.c_str());
+                        if (isOk) {
+                            a_Rejection = Rejection::CONTROL_CONFLICT;
+                        }
                         isOk = false;
                     }
                 }
@@ -938,9 +1759,12 @@ struct DspFF : public Pass {
         }
 
         auto checkParam = [&](const RTLIL::IdString &name, const RTLIL::Const &curr, const RTLIL::Const &next) {
-            if (curr != next && changes.params.count(name)) {
+            if (curr != next && changes.params.count(name) && !a_Slot.overrides.count(name)) {
                 log_debug("\n   the param '%s' mismatch ('%s' instead of '%s')", name.c_str(), curr.decode_string().c_str(),
                           next.decode_string().c_str());
+                if (isOk) {
+                    a_Rejection = Rejection::PARAM_CONFLICT;
+                }
                 isOk = false;
                 return false;
             }
@@ -1016,20 +1840,46 @@ struct DspFF : public Pass {
 
     // ..........................................
 
-    void processRegister(RTLIL::Cell *a_Cell, const RegisterType &a_Register, const std::vector<PortType> &a_Ports)
+    /// Integrates flip-flops connected to ports of a DSP register slot.
+    /// Returns true on success. Records the outcome in a_Decision.
+    bool processRegister(ModuleContext &a_Ctx, RTLIL::Cell *a_Cell, const RegisterSlot &a_Slot, SlotDecision &a_Decision)
     {
-
-        // The cell register control parameter(s) must not be set
-        for (const auto &it : a_Register.params.set) {
-            const auto curr = a_Cell->getParam(it.first);
-            if (curr == it.second) {
-                log_debug(" the param '%s' is already set to '%s'\n", it.first.c_str(), it.second.decode_string().c_str());
-                return;
-            }
-        }
+        const auto &a_Register = *a_Slot.reg;
+        const auto &a_Ports = *a_Slot.ports;
 
         pool<FlopData> groups;
         dict<RTLIL::IdString, std::vector<RTLIL::Cell *>> flops;
+        dict<RTLIL::IdString, std::vector<Rejection>> rejections;
+
+        // Records the reason for not integrating a bit. The first one is the
+        // reason for not using the register.
+        auto reject = [&](const PortType &port, size_t bit, Rejection rejection, const char *reason) {
+            rejections[port.name][bit] = rejection;
+            if (a_Decision.reason.empty()) {
+                a_Decision.reason = stringf("%s[%zu]: %s", RTLIL::unescape_id(port.name).c_str(), bit, reason);
+                a_Decision.rejection = rejection;
+            }
+        };
+
+        // Collects port statistics. Flip-flops that were fine on their own
+        // but could not be integrated count with the register rejection.
+        auto account = [&](bool absorbed) {
+            for (const auto &it : flops) {
+                auto &stats = a_Decision.ports[it.first];
+                const auto &bitRejections = rejections.at(it.first);
+                for (size_t i = 0; i < it.second.size(); ++i) {
+                    if (bitRejections[i] != Rejection::NONE) {
+                        stats.rejected[bitRejections[i]]++;
+                    } else if (it.second[i] != nullptr) {
+                        if (absorbed) {
+                            stats.absorbed++;
+                        } else {
+                            stats.rejected[a_Decision.rejection]++;
+                        }
+                    }
+                }
+            }
+        };
 
         // Process ports
         bool flopsOk = true;
@@ -1047,8 +1897,9 @@ struct DspFF : public Pass {
             auto sigbits = sigspec.bits();
 
             flops[port.name] = std::vector<RTLIL::Cell *>(sigbits.size(), nullptr);
+            rejections[port.name] = std::vector<Rejection>(sigbits.size(), Rejection::NONE);
             for (size_t i = 0; i < sigbits.size(); ++i) {
-                auto sigbit = m_SigMap(sigbits[i]);
+                auto sigbit = a_Ctx.sigMap(sigbits[i]);
 
                 log_debug("  %2zu. ", i);
 
@@ -1069,9 +1920,9 @@ struct DspFF : public Pass {
                 // Get sinks(s), discard the port completely if more than one sink
                 // is found.
                 if (a_Cell->output(port.name)) {
-                    if (m_ConnMap.sinks.count(sigbit)) {
-                        for (const auto &sink : m_ConnMap.sinks.at(sigbit)) {
-                            if (sink.cell != nullptr && m_CellsToRemove.count(sink.cell)) {
+                    if (a_Ctx.connMap.sinks.count(sigbit)) {
+                        for (const auto &sink : a_Ctx.connMap.sinks.at(sigbit)) {
+                            if (sink.cell != nullptr && a_Ctx.cellsToRemove.count(sink.cell)) {
                                 continue;
                             }
                             others.insert(sink);
@@ -1081,13 +1932,14 @@ struct DspFF : public Pass {
                 }
                 // Get driver. Discard if the driver drives something else too
                 else if (a_Cell->input(port.name)) {
-                    if (m_ConnMap.drivers.count(sigbit)) {
-                        auto driver = m_ConnMap.drivers.at(sigbit);
+                    if (a_Ctx.connMap.drivers.count(sigbit)) {
+                        auto driver = a_Ctx.connMap.drivers.at(sigbit);
 
-                        if (m_ConnMap.sinks.count(sigbit)) {
-                            auto sinks = m_ConnMap.sinks.at(sigbit);
+                        if (a_Ctx.connMap.sinks.count(sigbit)) {
+                            const auto &sinks = a_Ctx.connMap.sinks.at(sigbit);
                             if (sinks.size() > 1) {
                                 log_debug("multiple sinks (%zu)\n", others.size());
+                                reject(port, i, Rejection::MULTI_SINK, "multiple sinks");
                                 flopsOk = false;
                                 continue;
                             }
@@ -1105,6 +1957,7 @@ struct DspFF : public Pass {
 
                 if (others.size() > 1) {
                     log_debug("multiple sinks (%zu)\n", others.size());
+                    reject(port, i, Rejection::MULTI_SINK, "multiple sinks");
                     flopsOk = false;
                     continue;
                 }
@@ -1114,8 +1967,9 @@ struct DspFF : public Pass {
                 auto *flop = other.cell;
 
                 if (flop == nullptr) {
-                    if (!other.port.empty()) {
+                    if (other.port != 0) {
                         log_debug("connection reaches module edge\n");
+                        reject(port, i, Rejection::MODULE_EDGE, "connection reaches module edge");
                         flopsOk = false;
                     }
                     log_debug("unconnected\n");
@@ -1124,6 +1978,7 @@ struct DspFF : public Pass {
 
                 if (!m_FlopTypes.count(flop->type)) {
                     log_debug("non-flip-flop connected\n");
+                    reject(port, i, Rejection::NON_FLOP, "non-flip-flop connected");
                     flopsOk = false;
                     continue;
                 }
@@ -1137,14 +1992,16 @@ struct DspFF : public Pass {
                     flopPort = flopType.ports.at(RTLIL::escape_id("q"));
                 }
 
-                if (flopPort != other.port) {
+                if (!other.isPort(flopPort)) {
                     log_debug("connection to non-data port of a flip-flip");
+                    reject(port, i, Rejection::NON_FLOP, "connection to non-data port of a flip-flop");
                     flopsOk = false;
                     continue;
                 }
 
                 // Check the flip-flop configuration
                 if (!checkFlop(flop)) {
+                    reject(port, i, Rejection::PARAM_CONFLICT, "flip-flop configuration not supported");
                     flopsOk = false;
                     continue;
                 }
@@ -1160,7 +2017,7 @@ struct DspFF : public Pass {
                 }
 
                 // Store the flop and its data
-                groups.insert(getFlopData(flop, mappedParams));
+                groups.insert(getFlopData(a_Ctx, flop, mappedParams));
                 flops[port.name][i] = flop;
             }
         }
@@ -1168,28 +2025,43 @@ struct DspFF : public Pass {
         // Cannot integrate for various reasons
         if (!flopsOk) {
             log_debug(" cannot use the DSP register\n");
-            return;
+            account(false);
+            return false;
         }
 
         // No matching flip-flop groups
         if (groups.empty()) {
             log_debug(" no matching flip-flops found\n");
-            return;
+            a_Decision.reason = "no flip-flops found";
+            return false;
         }
 
-        // Do not allow more than a single group
+        // Do not allow more than a single group. Tell apart groups that
+        // differ in control signals from those that differ in parameters.
         if (groups.size() != 1) {
             log_debug(" %zu flip-flop groups, only a single one allowed\n", groups.size());
-            return;
+            a_Decision.reason = stringf("%zu incompatible flip-flop groups", groups.size());
+            a_Decision.rejection = Rejection::PARAM_CONFLICT;
+            for (const auto &group : groups) {
+                if (group.conns != groups.begin()->conns) {
+                    a_Decision.rejection = Rejection::CONTROL_CONFLICT;
+                }
+            }
+            account(false);
+            return false;
         }
 
         // Validate the flip flop data agains the DSP cell
         const auto &flopData = *groups.begin();
-        if (!checkFlopDataAgainstDspRegister(flopData, a_Cell, a_Register, a_Ports)) {
+        if (!checkFlopDataAgainstDspRegister(a_Ctx, flopData, a_Cell, a_Slot, a_Decision.rejection)) {
             log_debug(" flip-flops vs. DSP check failed\n");
-            return;
+            a_Decision.reason = "flip-flop settings conflict with the DSP";
+            account(false);
+            return false;
         }
 
+        account(true);
+
         // Log connections
         for (const auto &port : a_Ports) {
 
@@ -1248,7 +2120,7 @@ struct DspFF : public Pass {
                     sigbits[i] = sigspec.bits()[0];
                 }
 
-                m_CellsToRemove.insert(flop);
+                a_Ctx.cellsToRemove.insert(flop);
             }
 
             a_Cell->setPort(port.name, RTLIL::SigSpec(sigbits));
@@ -1268,7 +2140,7 @@ struct DspFF : public Pass {
 
                 log_debug(" connecting %s.%s to %s\n", a_Cell->type.c_str(), port.c_str(), sigBitName(conn).c_str());
                 a_Cell->setPort(port, conn);
-                m_DspChanges[a_Cell].conns.insert(port);
+                a_Ctx.dspChanges[a_Cell].conns.insert(port);
             }
         }
 
@@ -1276,7 +2148,7 @@ struct DspFF : public Pass {
         for (const auto &it : a_Register.connect) {
             log_debug(" connecting %s.%s to %s\n", a_Cell->type.c_str(), it.first.c_str(), it.second.as_string().c_str());
             a_Cell->setPort(it.first, it.second);
-            m_DspChanges[a_Cell].conns.insert(it.first);
+            a_Ctx.dspChanges[a_Cell].conns.insert(it.first);
         }
 
         // Map parameters (register rule)
@@ -1285,7 +2157,7 @@ struct DspFF : public Pass {
                 const auto &param = flopData.params.dsp.at(it.second);
                 log_debug(" setting param '%s' to '%s'\n", it.first.c_str(), param.decode_string().c_str());
                 a_Cell->setParam(it.first, param);
-                m_DspChanges[a_Cell].params.insert(it.first);
+                a_Ctx.dspChanges[a_Cell].params.insert(it.first);
             }
         }
 
@@ -1295,7 +2167,7 @@ struct DspFF : public Pass {
                 const auto &param = flopData.params.dsp.at(it.second);
                 log_debug(" setting param '%s' to '%s'\n", it.first.c_str(), param.decode_string().c_str());
                 a_Cell->setParam(it.first, param);
-                m_DspChanges[a_Cell].params.insert(it.first);
+                a_Ctx.dspChanges[a_Cell].params.insert(it.first);
             }
         }
 
@@ -1303,22 +2175,24 @@ struct DspFF : public Pass {
         for (const auto &it : a_Register.params.set) {
             log_debug(" setting param '%s' to '%s'\n", it.first.c_str(), it.second.decode_string().c_str());
             a_Cell->setParam(it.first, it.second);
-            m_DspChanges[a_Cell].params.insert(it.first);
+            a_Ctx.dspChanges[a_Cell].params.insert(it.first);
         }
 
         // Set parameters (flip-flop rule)
         for (const auto &it : flopType.params.set) {
             log_debug(" setting param '%s' to '%s'\n", it.first.c_str(), it.second.decode_string().c_str());
             a_Cell->setParam(it.first, it.second);
-            m_DspChanges[a_Cell].params.insert(it.first);
+            a_Ctx.dspChanges[a_Cell].params.insert(it.first);
         }
+
+        return true;
     }
 
     // ..........................................
 
     /// Collects flip-flop connectivity data and parameters which defines the
     /// group it belongs to.
-    FlopData getFlopData(RTLIL::Cell *a_Cell, const dict<RTLIL::IdString, RTLIL::Const> &a_ExtraParams)
+    FlopData getFlopData(ModuleContext &a_Ctx, RTLIL::Cell *a_Cell, const dict<RTLIL::IdString, RTLIL::Const> &a_ExtraParams)
     {
         FlopData data(a_Cell->type);
 
@@ -1338,7 +2212,7 @@ struct DspFF : public Pass {
                 auto sigbits = sigspec.bits();
                 log_assert(sigbits.size() <= 1);
                 if (!sigbits.empty()) {
-                    data.conns[it.first] = m_SigMap(sigbits[0]);
+                    data.conns[it.first] = a_Ctx.sigMap(sigbits[0]);
                 }
             }
         }
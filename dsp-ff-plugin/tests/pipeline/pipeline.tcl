@@ -0,0 +1,68 @@
+yosys -import
+if { [info procs dsp_ff] == {} } { plugin -i dsp-ff }
+yosys -import  ;# ingest plugin commands
+
+set DSP_RULES [file dirname $::env(DESIGN_TOP)]/pipeline_rules.txt
+set REPORT [test_output_path "pipeline.json"]
+
+read_verilog $::env(DESIGN_TOP).v
+design -save read
+
+# Both flip-flop stages go into the DSP
+set TOP "pipe_a2"
+design -load read
+hierarchy -top ${TOP}
+proc
+techmap
+opt_clean
+dsp_ff -rules ${DSP_RULES} -report ${REPORT}
+yosys cd ${TOP}
+stat
+select -assert-count 1 t:DSP_PIPE
+select -assert-count 1 r:AREG=2
+select -assert-count 0 t:\$_DFF_P_
+
+set fp [open ${REPORT} r]
+set report [read $fp]
+close $fp
+if { ![string match {*"stage": 2*} $report] || [string match {*"absorbed": false*} $report] } {
+    error "Unexpected report: $report"
+}
+
+# Only two out of three stages fit
+set TOP "pipe_a3"
+design -load read
+hierarchy -top ${TOP}
+proc
+techmap
+opt_clean
+dsp_ff -rules ${DSP_RULES}
+yosys cd ${TOP}
+stat
+select -assert-count 1 t:DSP_PIPE
+select -assert-count 1 r:AREG=2
+select -assert-count 8 t:\$_DFF_P_
+
+# The first stage has another sink so only the second one is absorbed
+set TOP "pipe_fanout"
+design -load read
+hierarchy -top ${TOP}
+proc
+techmap
+opt_clean
+dsp_ff -rules ${DSP_RULES} -report ${REPORT}
+yosys cd ${TOP}
+stat
+select -assert-count 1 t:DSP_PIPE
+select -assert-count 1 r:AREG=1
+select -assert-count 8 t:\$_DFF_P_
+
+set fp [open ${REPORT} r]
+set report [read $fp]
+close $fp
+if { ![string match {*multiple sinks*} $report] || ![string match {*"multi-sink": 8*} $report] } {
+    error "Unexpected report: $report"
+}
+if { ![string match {*"dsp_types": {"DSP_PIPE": *"absorbed": 8*} $report] } {
+    error "Unexpected report: $report"
+}
@@ -0,0 +1,97 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+(* blackbox *)
+module DSP_PIPE (
+    input  wire       CLK,
+    input  wire       CE,
+    input  wire       RST,
+    input  wire [7:0] A,
+    output wire [7:0] Z
+);
+    parameter AREG = "0";
+endmodule
+
+module pipe_a2 (
+    input  wire       clk,
+    input  wire [7:0] a,
+    output wire [7:0] z
+);
+
+    reg [7:0] a1;
+    reg [7:0] a2;
+
+    always @(posedge clk) begin
+        a1 <= a;
+        a2 <= a1;
+    end
+
+    DSP_PIPE dsp (
+        .CLK(clk),
+        .A  (a2),
+        .Z  (z)
+    );
+
+endmodule
+
+module pipe_a3 (
+    input  wire       clk,
+    input  wire [7:0] a,
+    output wire [7:0] z
+);
+
+    reg [7:0] a1;
+    reg [7:0] a2;
+    reg [7:0] a3;
+
+    always @(posedge clk) begin
+        a1 <= a;
+        a2 <= a1;
+        a3 <= a2;
+    end
+
+    DSP_PIPE dsp (
+        .CLK(clk),
+        .A  (a3),
+        .Z  (z)
+    );
+
+endmodule
+
+module pipe_fanout (
+    input  wire       clk,
+    input  wire [7:0] a,
+    output wire [7:0] z,
+    output wire [7:0] t
+);
+
+    reg [7:0] a1;
+    reg [7:0] a2;
+
+    always @(posedge clk) begin
+        a1 <= a;
+        a2 <= a1;
+    end
+
+    assign t = a1;
+
+    DSP_PIPE dsp (
+        .CLK(clk),
+        .A  (a2),
+        .Z  (z)
+    );
+
+endmodule
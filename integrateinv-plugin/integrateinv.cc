@@ -21,42 +21,101 @@
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
 
+#include "../common/parallel.h"
+
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
 /// A structure representing a pin
+///
+/// The port name is referenced rather than copied. Pins are created while
+/// modules are analyzed concurrently and copying an RTLIL::IdString is not
+/// thread-safe. The referenced name is either a key of the cell connection
+/// dict or the name of a wire, both of which outlive the analysis.
 struct Pin {
-    RTLIL::Cell *cell;    /// Cell pointer
-    RTLIL::IdString port; /// Cell port name
-    int bit;              /// Port bit index
+    RTLIL::Cell *cell;           /// Cell pointer
+    const RTLIL::IdString *port; /// Cell port name
+    int bit;                     /// Port bit index
 
-    Pin(RTLIL::Cell *_cell, const RTLIL::IdString &_port, int _bit = 0) : cell(_cell), port(_port), bit(_bit) {}
+    Pin(RTLIL::Cell *_cell, const RTLIL::IdString &_port, int _bit = 0) : cell(_cell), port(&_port), bit(_bit) {}
 
     Pin(const Pin &ref) = default;
 
     unsigned int hash() const
     {
         if (cell == nullptr) {
-            return mkhash_add(port.hash(), bit);
+            return mkhash_add(port->hash(), bit);
         } else {
-            return mkhash_add(mkhash(cell->hash(), port.hash()), bit);
+            return mkhash_add(mkhash(cell->hash(), port->hash()), bit);
         }
     };
 };
 
-bool operator==(const Pin &lhs, const Pin &rhs) { return (lhs.cell == rhs.cell) && (lhs.port == rhs.port) && (lhs.bit == rhs.bit); }
+bool operator==(const Pin &lhs, const Pin &rhs) { return (lhs.cell == rhs.cell) && (*lhs.port == *rhs.port) && (lhs.bit == rhs.bit); }
+
+/// An input port connection of a cell. Resolved before the concurrent
+/// analysis as port directions and cell type modules are looked up by
+/// IdString, which copies it.
+struct InputPort {
+    RTLIL::Cell *cell;              /// Cell pointer
+    const RTLIL::IdString *port;    /// Cell port name, a key of the cell connection dict
+    const RTLIL::SigSpec *sigspec;  /// Port connection
+    bool selected;                  /// Whether the cell is selected
+    bool known;                     /// Whether the port is known to be an input
+    std::string invParam;           /// Inversion parameter name, empty if the pin is not invertible
+};
 
-struct IntegrateInv : public Pass {
+/// Per-module working state of the pass
+struct ModuleContext {
+    /// The module
+    RTLIL::Module *module;
+    /// Selected cells of the module
+    std::vector<RTLIL::Cell *> cells;
+    pool<RTLIL::Cell *> selected;
+
+    /// Input ports of all cells of the module
+    std::vector<InputPort> inputs;
+    /// Inverter cells in cell order and their input and output bits
+    std::vector<RTLIL::Cell *> notCells;
+    dict<RTLIL::Cell *, std::pair<RTLIL::SigBit, RTLIL::SigBit>> notPorts;
+    /// Output ports and kept wires. Collected only in the collapse mode.
+    std::vector<RTLIL::Wire *> keptWires;
 
     /// Temporary SigBit to SigBit helper map.
-    SigMap m_SigMap;
+    SigMap sigMap;
     /// Map of SigBit objects to inverter cells.
-    dict<RTLIL::SigBit, RTLIL::Cell *> m_InvMap;
+    dict<RTLIL::SigBit, RTLIL::Cell *> invMap;
     /// Map of inverter cells that can potentially be integrated and invertable
     /// pins that they are connected to
-    dict<RTLIL::Cell *, pool<Pin>> m_Inverters;
+    dict<RTLIL::Cell *, pool<Pin>> inverters;
     /// Map of invertable pins and names of parameters controlling inversions
-    dict<Pin, RTLIL::IdString> m_InvParams;
+    dict<Pin, std::string> invParams;
+    /// Map of inverter output SigBits to all sink pins they drive
+    dict<RTLIL::SigBit, pool<Pin>> sinkMap;
+    /// Inverters that drive only invertable pins
+    pool<RTLIL::Cell *> integrable;
+
+    /// Whether inverter chains are collapsed and inverters integrated into
+    /// a subset of their sinks
+    bool collapse = false;
+    /// Bits that have to stay driven regardless of their cell sinks (output
+    /// ports and kept wires). Collected only in the collapse mode.
+    pool<RTLIL::SigBit> keptBits;
+    /// Inverters that drive nothing but other such inverters. Collected only
+    /// in the collapse mode.
+    pool<RTLIL::Cell *> unused;
+    /// Sink pins of inverter chains and the bits they are to be reconnected
+    /// to in order to bypass the chains
+    std::vector<std::pair<Pin, RTLIL::SigBit>> bypasses;
+
+    /// Inverter cell type. Created up front since IdStrings must not be
+    /// created during the concurrent analysis.
+    RTLIL::IdString notType;
+
+    ModuleContext(RTLIL::Module *a_Module, bool a_Collapse) : module(a_Module), collapse(a_Collapse), notType(ID($_NOT_)) {}
+};
+
+struct IntegrateInv : public Pass {
 
     IntegrateInv()
         : Pass("integrateinv", "Integrates inverters ($_NOT_ cells) into ports "
@@ -67,7 +126,7 @@ struct IntegrateInv : public Pass {
     void help() override
     {
         log("\n");
-        log("    integrateinv [selection]");
+        log("    integrateinv [options] [selection]");
         log("\n");
         log("This pass integrates inverters into cells that have ports with the\n");
         log("'invertible_pin' attribute set. The attribute should contain the name\n");
@@ -75,261 +134,520 @@ struct IntegrateInv : public Pass {
         log("\n");
         log("This pass is essentially the opposite of the 'extractinv' pass.\n");
         log("\n");
+        log("By default an inverter is integrated only if all of its sinks are\n");
+        log("invertible pins.\n");
+        log("\n");
+        log("    -collapse\n");
+        log("        Also apply transformations that never add cells and that shorten\n");
+        log("        paths through inverters:\n");
+        log("          - sinks of chains of inverters are reconnected to the chain\n");
+        log("            input (even number of inversions) or to the output of its\n");
+        log("            first inverter (odd number of inversions),\n");
+        log("          - invertible sinks of an inverter that also drives other sinks\n");
+        log("            are moved to the inverter input, the inverter is kept for the\n");
+        log("            remaining sinks,\n");
+        log("          - selected inverters left without sinks are removed. Ports\n");
+        log("            of unknown direction count as sinks.\n");
+        log("\n");
+        log("    -threads <N>\n");
+        log("        Number of threads used to analyze modules concurrently. Defaults\n");
+        log("        to the number of available cores.\n");
+        log("\n");
     }
 
     void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
     {
         log_header(a_Design, "Executing INTEGRATEINV pass (integrating pin inverters).\n");
 
-        extra_args(a_Args, 1, a_Design);
+        int numThreads = default_thread_count();
+        bool collapse = false;
+
+        size_t argidx;
+        for (argidx = 1; argidx < a_Args.size(); argidx++) {
+            if (a_Args[argidx] == "-collapse") {
+                collapse = true;
+                continue;
+            }
+            if (a_Args[argidx] == "-threads" && argidx + 1 < a_Args.size()) {
+                numThreads = std::max(1, atoi(a_Args[++argidx].c_str()));
+                continue;
+            }
+            break;
+        }
+        extra_args(a_Args, argidx, a_Design);
+
+        // Set up contexts. Selection queries and everything that copies
+        // IdStrings are done here as they are not safe to do concurrently.
+        std::vector<ModuleContext> contexts;
+        auto setupContexts = [&]() {
+            contexts.clear();
+            for (auto module : a_Design->selected_modules()) {
+                contexts.emplace_back(module, collapse);
+                contexts.back().cells = module->selected_cells();
+            }
+            for (auto &ctx : contexts) {
+                resolvePorts(ctx);
+            }
+        };
+        setupContexts();
+
+        // Bypass inverter chains. The netlist changes so start over with
+        // fresh contexts afterwards.
+        if (collapse) {
+            parallel_for(contexts.size(), numThreads, [&](size_t i) { analyzeChains(contexts[i]); });
+
+            for (auto &ctx : contexts) {
+                bypassChains(ctx);
+            }
+
+            setupContexts();
+        }
+
+        // Analyze modules concurrently. This only reads the netlist.
+        parallel_for(contexts.size(), numThreads, [&](size_t i) { analyzeModule(contexts[i]); });
+
+        // Integrate inverters, module by module
+        for (auto &ctx : contexts) {
+            integrateInverters(ctx);
+        }
+    }
+
+    void resolvePorts(ModuleContext &a_Ctx)
+    {
+        a_Ctx.selected.insert(a_Ctx.cells.begin(), a_Ctx.cells.end());
+        auto design = a_Ctx.module->design;
 
-        // Process modules
-        for (auto module : a_Design->selected_modules()) {
+        for (auto cell : a_Ctx.module->cells()) {
+            if (cell->type == a_Ctx.notType) {
+                a_Ctx.notCells.push_back(cell);
+                a_Ctx.notPorts[cell] = std::make_pair(cell->getPort(ID::A)[0], cell->getPort(ID::Y)[0]);
+            }
 
-            // Setup the SigMap
-            m_SigMap.clear();
-            m_SigMap.set(module);
+            auto cellModule = design->module(cell->type);
+            for (auto &conn : cell->connections()) {
+                // Ports of unknown direction (cells of unknown types, ports
+                // missing in the cell type module) are treated as sinks too
+                bool known = cell->input(conn.first);
+                if (!known && cell->output(conn.first)) {
+                    continue;
+                }
 
-            m_Inverters.clear();
-            m_InvParams.clear();
+                InputPort input = {cell, &conn.first, &conn.second, a_Ctx.selected.count(cell) != 0, known, std::string()};
 
-            // Setup inverter map
-            buildInverterMap(module);
+                // Check if the pin has an embedded inverter
+                auto wire = cellModule ? cellModule->wire(conn.first) : nullptr;
+                if (wire) {
+                    auto it = wire->attributes.find(ID::invertible_pin);
+                    if (it != wire->attributes.end()) {
+                        input.invParam = RTLIL::escape_id(it->second.decode_string());
+                    }
+                }
 
-            // Identify inverters that can be integrated and assign them with
-            // lists of cells and ports to integrate with
-            for (auto cell : module->selected_cells()) {
-                collectInverters(cell);
+                a_Ctx.inputs.push_back(input);
             }
+        }
 
-            // Integrate inverters
-            integrateInverters();
+        if (a_Ctx.collapse) {
+            for (auto wire : a_Ctx.module->wires()) {
+                if (wire->port_output || wire->get_bool_attribute(ID::keep)) {
+                    a_Ctx.keptWires.push_back(wire);
+                }
+            }
         }
+    }
 
-        // Clear maps
-        m_SigMap.clear();
+    void analyzeModule(ModuleContext &a_Ctx)
+    {
+        // Setup the SigMap
+        a_Ctx.sigMap.set(a_Ctx.module);
+
+        // Setup inverter map
+        buildInverterMap(a_Ctx);
+        // Setup inverter sink map
+        buildSinkMap(a_Ctx);
+
+        // Identify inverters that can be integrated and assign them with
+        // lists of cells and ports to integrate with
+        collectInverters(a_Ctx);
+
+        // Collect bits that have to stay driven
+        for (auto wire : a_Ctx.keptWires) {
+            for (int i = 0; i < wire->width; ++i) {
+                a_Ctx.keptBits.insert(a_Ctx.sigMap(RTLIL::SigBit(wire, i)));
+            }
+        }
 
-        m_InvMap.clear();
-        m_Inverters.clear();
-        m_InvParams.clear();
+        // Identify selected inverters that drive nothing but other such
+        // inverters
+        if (a_Ctx.collapse) {
+            bool changed = true;
+            while (changed) {
+                changed = false;
+                for (auto &it : a_Ctx.invMap) {
+                    if (!a_Ctx.selected.count(it.second) || a_Ctx.unused.count(it.second) || a_Ctx.keptBits.count(it.first)) {
+                        continue;
+                    }
+                    if (getSinksForDriver(a_Ctx, it.second).empty()) {
+                        a_Ctx.unused.insert(it.second);
+                        changed = true;
+                    }
+                }
+            }
+        }
+
+        // Identify inverters that drive only invertable pins
+        for (auto &it : a_Ctx.inverters) {
+            if (a_Ctx.collapse && a_Ctx.keptBits.count(a_Ctx.sigMap(a_Ctx.notPorts.at(it.first).second))) {
+                continue;
+            }
+            if (getSinksForDriver(a_Ctx, it.first) == it.second) {
+                a_Ctx.integrable.insert(it.first);
+            }
+        }
     }
 
-    void buildInverterMap(RTLIL::Module *a_Module)
+    void analyzeChains(ModuleContext &a_Ctx)
     {
-        m_InvMap.clear();
+        // Setup the SigMap
+        a_Ctx.sigMap.set(a_Ctx.module);
+
+        // Setup inverter map
+        buildInverterMap(a_Ctx);
+
+        // The first inverter (in cell order) driven by each bit
+        dict<RTLIL::SigBit, RTLIL::Cell *> firstInverters;
+        for (auto cell : a_Ctx.notCells) {
+            auto sigbit = a_Ctx.sigMap(a_Ctx.notPorts.at(cell).first);
+            if (!firstInverters.count(sigbit)) {
+                firstInverters[sigbit] = cell;
+            }
+        }
+
+        // Resolves an inverter output to the input of its chain and whether
+        // the number of inversions along the chain is odd. Loops of inverters
+        // resolve to the bit itself.
+        dict<RTLIL::SigBit, std::pair<RTLIL::SigBit, bool>> resolved;
+        auto resolve = [&](const RTLIL::SigBit &a_Sigbit) {
+            auto it = resolved.find(a_Sigbit);
+            if (it != resolved.end()) {
+                return it->second;
+            }
+
+            auto result = std::make_pair(a_Sigbit, false);
+            for (size_t steps = 0;; ++steps) {
+                auto inv = a_Ctx.invMap.find(result.first);
+                if (inv == a_Ctx.invMap.end()) {
+                    break;
+                }
+                if (steps > a_Ctx.invMap.size()) {
+                    result = std::make_pair(a_Sigbit, false);
+                    break;
+                }
+
+                result.first = a_Ctx.sigMap(a_Ctx.notPorts.at(inv->second).first);
+                result.second = !result.second;
+            }
 
-        for (auto cell : a_Module->cells()) {
+            resolved[a_Sigbit] = result;
+            return result;
+        };
 
-            // Skip non-inverters
-            if (cell->type != RTLIL::escape_id("$_NOT_")) {
+        // Look for input pins driven by chains of at least two inverters
+        for (auto &input : a_Ctx.inputs) {
+            if (!input.selected || !input.known) {
                 continue;
             }
+            auto cell = input.cell;
+            auto &port = *input.port;
+            auto &sigspec = *input.sigspec;
+
+            for (int bit = 0; bit < sigspec.size(); ++bit) {
+
+                auto sigbit = sigspec[bit];
+                if (!sigbit.wire) {
+                    continue;
+                }
+
+                // Driven by an inverter which is driven by an inverter
+                sigbit = a_Ctx.sigMap(sigbit);
+                auto inv = a_Ctx.invMap.find(sigbit);
+                if (inv == a_Ctx.invMap.end()) {
+                    continue;
+                }
+                if (!a_Ctx.invMap.count(a_Ctx.sigMap(a_Ctx.notPorts.at(inv->second).first))) {
+                    continue;
+                }
+
+                auto chain = resolve(sigbit);
+                if (chain.first == sigbit) {
+                    continue;
+                }
+
+                // Connect to the chain input or to its first inverter
+                RTLIL::SigBit driver = chain.first;
+                if (chain.second) {
+                    driver = a_Ctx.notPorts.at(firstInverters.at(chain.first)).second;
+                }
+
+                a_Ctx.bypasses.push_back(std::make_pair(Pin(cell, port, bit), driver));
+            }
+        }
+    }
+
+    void bypassChains(ModuleContext &a_Ctx)
+    {
+        if (a_Ctx.bypasses.empty()) {
+            return;
+        }
+
+        log("Bypassing inverter chains in module %s:\n", log_id(a_Ctx.module->name));
+
+        // Bypasses of a port are consecutive, rewrite each port once
+        auto &bypasses = a_Ctx.bypasses;
+        for (size_t i = 0; i < bypasses.size();) {
+            auto cell = bypasses[i].first.cell;
+            auto &port = *bypasses[i].first.port;
+
+            auto sigspec = cell->getPort(port);
+            for (; i < bypasses.size() && bypasses[i].first.cell == cell && *bypasses[i].first.port == port; ++i) {
+                auto &pin = bypasses[i].first;
+                log(" %s.%s[%d] -> %s\n", log_id(cell->name), log_id(port), pin.bit, log_signal(bypasses[i].second));
+                sigspec[pin.bit] = bypasses[i].second;
+            }
+
+            cell->setPort(port, sigspec);
+        }
+    }
+
+    void buildInverterMap(ModuleContext &a_Ctx)
+    {
+        for (auto cell : a_Ctx.notCells) {
 
             // Get output connection
-            auto sigspec = cell->getPort(RTLIL::escape_id("Y"));
-            auto sigbit = m_SigMap(sigspec.bits().at(0));
+            auto sigbit = a_Ctx.sigMap(a_Ctx.notPorts.at(cell).second);
 
             // Store
-            log_assert(m_InvMap.count(sigbit) == 0);
-            m_InvMap[sigbit] = cell;
+            log_assert(a_Ctx.invMap.count(sigbit) == 0);
+            a_Ctx.invMap[sigbit] = cell;
         }
     }
 
-    void collectInverters(RTLIL::Cell *a_Cell)
+    void buildSinkMap(ModuleContext &a_Ctx)
     {
-        auto module = a_Cell->module;
-        auto design = module->design;
+        // Look for sinks (inputs) of inverter outputs
+        for (auto &input : a_Ctx.inputs) {
+            auto cell = input.cell;
+            auto &port = *input.port;
+            auto &sigspec = *input.sigspec;
 
-        for (auto conn : a_Cell->connections()) {
-            auto port = conn.first;
-            auto sigspec = conn.second;
+            // Check all sigbits
+            for (int bit = 0; bit < sigspec.size(); ++bit) {
 
-            // Consider only inputs.
-            if (!a_Cell->input(port)) {
-                continue;
-            }
+                auto sigbit = sigspec[bit];
+                if (!sigbit.wire) {
+                    continue;
+                }
 
-            // Get the cell module
-            auto cellModule = design->module(a_Cell->type);
-            if (!cellModule) {
-                continue;
+                // Got a sink pin of an inverter
+                sigbit = a_Ctx.sigMap(sigbit);
+                if (a_Ctx.invMap.count(sigbit)) {
+                    a_Ctx.sinkMap[sigbit].insert(Pin(cell, port, bit));
+                }
             }
+        }
 
-            // Get wire.
-            auto wire = cellModule->wire(port);
-            if (!wire) {
-                continue;
+        // Look for connected top-level output ports
+        for (auto &conn : a_Ctx.module->connections()) {
+            auto &dst = conn.first;
+
+            for (int bit = 0; bit < dst.size(); ++bit) {
+
+                auto sigbit = dst[bit];
+                if (!sigbit.wire) {
+                    continue;
+                }
+
+                if (!sigbit.wire->port_output) {
+                    continue;
+                }
+
+                sigbit = a_Ctx.sigMap(sigbit);
+                if (a_Ctx.invMap.count(sigbit)) {
+                    a_Ctx.sinkMap[sigbit].insert(Pin(nullptr, sigbit.wire->name, bit));
+                }
             }
+        }
+    }
 
-            // Check if the pin has an embedded inverter.
-            auto it = wire->attributes.find(ID::invertible_pin);
-            if (it == wire->attributes.end()) {
+    void collectInverters(ModuleContext &a_Ctx)
+    {
+        for (auto &input : a_Ctx.inputs) {
+            auto &port = *input.port;
+            auto &sigspec = *input.sigspec;
+            auto &paramName = input.invParam;
+
+            // Consider only invertible pins of selected cells
+            if (!input.selected || !input.known || paramName.empty()) {
                 continue;
             }
 
-            // Decode the parameter name.
-            RTLIL::IdString paramName = RTLIL::escape_id(it->second.decode_string());
-
             // Look for connected inverters
-            auto sigbits = sigspec.bits();
-            for (size_t bit = 0; bit < sigbits.size(); ++bit) {
+            for (int bit = 0; bit < sigspec.size(); ++bit) {
 
-                auto sigbit = sigbits[bit];
+                auto sigbit = sigspec[bit];
                 if (!sigbit.wire) {
                     continue;
                 }
 
-                sigbit = m_SigMap(sigbit);
+                sigbit = a_Ctx.sigMap(sigbit);
 
                 // Get the inverter if any
-                if (!m_InvMap.count(sigbit)) {
+                auto inv = a_Ctx.invMap.find(sigbit);
+                if (inv == a_Ctx.invMap.end()) {
                     continue;
                 }
-                auto inv = m_InvMap.at(sigbit);
 
                 // Save the inverter pin and the parameter name
-                auto pin = Pin(a_Cell, port, bit);
+                auto pin = Pin(input.cell, port, bit);
 
-                auto &list = m_Inverters[inv];
+                auto &list = a_Ctx.inverters[inv->second];
                 list.insert(pin);
 
-                log_assert(m_InvParams.count(pin) == 0);
-                m_InvParams[pin] = paramName;
+                log_assert(a_Ctx.invParams.count(pin) == 0);
+                a_Ctx.invParams[pin] = paramName;
             }
         }
     }
 
-    void integrateInverters()
+    /// Pending inverter integrations into a single cell port
+    struct PortUpdate {
+        RTLIL::Cell *cell;                                 /// Cell
+        RTLIL::IdString port;                              /// Port name
+        RTLIL::IdString paramName;                         /// Inversion parameter name
+        std::vector<std::pair<int, RTLIL::SigBit>> bits; /// Bits to integrate into and their new drivers
+    };
+
+    void integrateInverters(ModuleContext &a_Ctx)
     {
+        // Updates grouped by cell port
+        std::vector<PortUpdate> updates;
+        dict<std::pair<RTLIL::Cell *, RTLIL::IdString>, size_t> updateIndex;
+        // Inverters to remove once integrated
+        std::vector<RTLIL::Cell *> integrated;
 
-        for (auto it : m_Inverters) {
+        for (auto &it : a_Ctx.inverters) {
             auto inv = it.first;
-            auto pins = it.second;
-
-            // List all sinks of the inverter
-            auto sinks = getSinksForDriver(Pin(inv, RTLIL::escape_id("Y")));
+            auto &pins = it.second;
+
+            // If the inverter drives only invertable pins then integrate it.
+            // In the collapse mode integrate it into its invertable pins
+            // anyway but keep it for the other sinks.
+            bool integrable = a_Ctx.integrable.count(inv);
+            if (integrable || a_Ctx.collapse) {
+                if (integrable) {
+                    log("Integrating inverter %s into:\n", log_id(inv->name));
+                } else {
+                    log("Partially integrating inverter %s into:\n", log_id(inv->name));
+                }
 
-            // If the inverter drives only invertable pins then integrate it
-            if (sinks == pins) {
-                log("Integrating inverter %s into:\n", log_id(inv->name));
+                auto driver = inv->getPort(ID::A)[0];
 
                 // Integrate into each pin
-                for (auto pin : pins) {
+                for (auto &pin : pins) {
                     log_assert(pin.cell != nullptr);
-                    log(" %s.%s[%d]\n", log_id(pin.cell->name), log_id(pin.port), pin.bit);
-
-                    // Change the connection
-                    auto sigspec = pin.cell->getPort(pin.port);
-                    auto sigbits = sigspec.bits();
-
-                    log_assert((size_t)pin.bit < sigbits.size());
-                    sigbits[pin.bit] = RTLIL::SigBit(inv->getPort(RTLIL::escape_id("A"))[0]);
-                    pin.cell->setPort(pin.port, RTLIL::SigSpec(sigbits));
-
-                    // Get the control parameter
-                    log_assert(m_InvParams.count(pin) != 0);
-                    auto paramName = m_InvParams[pin];
-
-                    RTLIL::Const invMask;
-                    auto param = pin.cell->parameters.find(paramName);
-                    if (param == pin.cell->parameters.end()) {
-                        invMask = RTLIL::Const(0, sigspec.size());
-                    } else {
-                        invMask = RTLIL::Const(param->second);
-                    }
-
-                    // Check width.
-                    if (invMask.size() != sigspec.size()) {
-                        log_error("The inversion parameter needs to be the same width as "
-                                  "the port (%s port %s parameter %s)",
-                                  log_id(pin.cell->name), log_id(pin.port), log_id(paramName));
-                    }
+                    log(" %s.%s[%d]\n", log_id(pin.cell->name), log_id(*pin.port), pin.bit);
 
-                    // Toggle bit in the control parameter bitmask
-                    if (invMask[pin.bit] == RTLIL::State::S0) {
-                        invMask[pin.bit] = RTLIL::State::S1;
-                    } else if (invMask[pin.bit] == RTLIL::State::S1) {
-                        invMask[pin.bit] = RTLIL::State::S0;
-                    } else {
-                        log_error("The inversion parameter must contain only 0s and 1s (%s "
-                                  "parameter %s)\n",
-                                  log_id(pin.cell->name), log_id(paramName));
+                    auto key = std::make_pair(pin.cell, *pin.port);
+                    auto ins = updateIndex.emplace(key, updates.size());
+                    if (ins.second) {
+                        log_assert(a_Ctx.invParams.count(pin) != 0);
+                        updates.push_back(PortUpdate{pin.cell, *pin.port, a_Ctx.invParams.at(pin), {}});
                     }
-
-                    // Set the parameter back
-                    pin.cell->setParam(paramName, invMask);
+                    updates[ins.first->second].bits.push_back(std::make_pair(pin.bit, driver));
                 }
 
-                // Remove the inverter
-                inv->module->remove(inv);
+                if (integrable) {
+                    integrated.push_back(inv);
+                }
             }
         }
-    }
 
-    pool<Pin> getSinksForDriver(const Pin &a_Driver)
-    {
-        auto module = a_Driver.cell->module;
-        pool<Pin> sinks;
+        // Apply the updates, each port and parameter is rewritten once
+        for (auto &update : updates) {
+            auto cell = update.cell;
 
-        // The driver has to be an output pin
-        if (!a_Driver.cell->output(a_Driver.port)) {
-            return sinks;
-        }
+            // Change the connection
+            auto sigspec = cell->getPort(update.port);
 
-        // Get the driver sigbit
-        auto driverSigspec = a_Driver.cell->getPort(a_Driver.port);
-        auto driverSigbit = m_SigMap(driverSigspec.bits().at(a_Driver.bit));
+            // Get the control parameter
+            RTLIL::Const invMask;
+            auto param = cell->parameters.find(update.paramName);
+            if (param == cell->parameters.end()) {
+                invMask = RTLIL::Const(0, sigspec.size());
+            } else {
+                invMask = RTLIL::Const(param->second);
+            }
 
-        // Look for connected sinks
-        for (auto cell : module->cells()) {
-            for (auto conn : cell->connections()) {
-                auto port = conn.first;
-                auto sigspec = conn.second;
+            // Check width.
+            if (invMask.size() != sigspec.size()) {
+                log_error("The inversion parameter needs to be the same width as "
+                          "the port (%s port %s parameter %s)",
+                          log_id(cell->name), log_id(update.port), log_id(update.paramName));
+            }
 
-                // Consider only sinks (inputs)
-                if (!cell->input(port)) {
-                    continue;
+            for (auto &bit : update.bits) {
+                log_assert(bit.first < sigspec.size());
+                sigspec[bit.first] = bit.second;
+
+                // Toggle bit in the control parameter bitmask
+                if (invMask[bit.first] == RTLIL::State::S0) {
+                    invMask[bit.first] = RTLIL::State::S1;
+                } else if (invMask[bit.first] == RTLIL::State::S1) {
+                    invMask[bit.first] = RTLIL::State::S0;
+                } else {
+                    log_error("The inversion parameter must contain only 0s and 1s (%s "
+                              "parameter %s)\n",
+                              log_id(cell->name), log_id(update.paramName));
                 }
+            }
 
-                // Check all sigbits
-                auto sigbits = sigspec.bits();
-                for (size_t bit = 0; bit < sigbits.size(); ++bit) {
-
-                    auto sigbit = sigbits[bit];
-                    if (!sigbit.wire) {
-                        continue;
-                    }
+            // Set the port and the parameter back
+            cell->setPort(update.port, sigspec);
+            cell->setParam(update.paramName, invMask);
+        }
 
-                    // Got a sink pin of another cell
-                    sigbit = m_SigMap(sigbit);
-                    if (sigbit == driverSigbit) {
-                        sinks.insert(Pin(cell, port, bit));
-                    }
-                }
-            }
+        // Remove integrated inverters
+        for (auto inv : integrated) {
+            inv->module->remove(inv);
         }
 
-        // Look for connected top-level output ports
-        for (auto conn : module->connections()) {
-            auto dst = conn.first;
-            auto src = conn.second;
+        // Remove inverters that drive nothing
+        for (auto inv : a_Ctx.unused) {
+            log("Removing unused inverter %s\n", log_id(inv->name));
+            inv->module->remove(inv);
+        }
+    }
 
-            auto sigbits = dst.bits();
-            for (size_t bit = 0; bit < sigbits.size(); ++bit) {
+    pool<Pin> getSinksForDriver(ModuleContext &a_Ctx, RTLIL::Cell *a_Inverter)
+    {
+        // Get the driver sigbit
+        auto driverSigbit = a_Ctx.sigMap(a_Ctx.notPorts.at(a_Inverter).second);
 
-                auto sigbit = sigbits[bit];
-                if (!sigbit.wire) {
-                    continue;
-                }
+        // Look up its sinks
+        auto it = a_Ctx.sinkMap.find(driverSigbit);
+        if (it == a_Ctx.sinkMap.end()) {
+            return pool<Pin>();
+        }
 
-                if (!sigbit.wire->port_output) {
-                    continue;
-                }
+        if (a_Ctx.unused.empty()) {
+            return it->second;
+        }
 
-                sigbit = m_SigMap(sigbit);
-                if (sigbit == driverSigbit) {
-                    sinks.insert(Pin(nullptr, sigbit.wire->name, bit));
-                }
+        // Skip sinks that are going to be removed
+        pool<Pin> sinks;
+        for (auto &pin : it->second) {
+            if (!a_Ctx.unused.count(pin.cell)) {
+                sinks.insert(pin);
             }
         }
 
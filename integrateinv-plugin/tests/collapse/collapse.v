@@ -0,0 +1,60 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+(* blackbox *)
+module box(
+    (* invertible_pin="INV_A" *)
+    input  wire A,
+    output wire Y
+);
+
+    parameter [0:0] INV_A = 1'b0;
+
+endmodule
+
+(* blackbox *)
+module plain(
+    input  wire A,
+    output wire Y
+);
+
+endmodule
+
+
+module top(
+    input  wire [2:0]  di,
+    output wire [3:0]  do
+);
+
+    wire [5:0] d;
+
+    // Double inversion
+    \$_NOT_ n0 (.A(di[0]), .Y(d[0]));
+    \$_NOT_ n1 (.A(d[0]),  .Y(d[1]));
+    box b0 (.A(d[1]), .Y(do[0]));
+
+    // An invertible and a non-invertible sink
+    \$_NOT_ n2 (.A(di[1]), .Y(d[2]));
+    box   b1 (.A(d[2]), .Y(do[1]));
+    plain p0 (.A(d[2]), .Y(do[2]));
+
+    // Triple inversion
+    \$_NOT_ n3 (.A(di[2]), .Y(d[3]));
+    \$_NOT_ n4 (.A(d[3]),  .Y(d[4]));
+    \$_NOT_ n5 (.A(d[4]),  .Y(d[5]));
+    box b2 (.A(d[5]), .Y(do[3]));
+
+endmodule
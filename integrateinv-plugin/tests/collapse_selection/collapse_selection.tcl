@@ -0,0 +1,15 @@
+yosys -import
+if { [info procs integrateinv] == {} } { plugin -i integrateinv }
+yosys -import  ;# ingest plugin commands
+
+# No hierarchy pass, the type of x0 stays unknown
+read_verilog -icells $::env(DESIGN_TOP).v
+
+debug integrateinv -collapse c:* c:u0 %d
+
+# Only the selected unused inverter is removed and the one driving a port
+# of unknown direction is kept
+select c:u0 -assert-count 1
+select c:u1 -assert-none
+select c:n0 -assert-count 1
+select t:\$_NOT_ -assert-count 2
@@ -0,0 +1,32 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+module top(
+    input  wire [1:0]  di,
+    output wire        do
+);
+
+    wire [2:0] d;
+
+    // Unused inverters, u0 is left out of the selection
+    \$_NOT_ u0 (.A(di[0]), .Y(d[0]));
+    \$_NOT_ u1 (.A(di[0]), .Y(d[1]));
+
+    // An inverter driving a cell of an unknown type
+    \$_NOT_ n0 (.A(di[1]), .Y(d[2]));
+    unknown x0 (.A(d[2]), .Y(do));
+
+endmodule
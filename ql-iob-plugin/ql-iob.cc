@@ -23,8 +23,12 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 
+#include <algorithm>
+#include <climits>
+#include <cstdint>
 #include <regex>
 #include <sstream>
+#include <unordered_set>
 
 #ifndef YS_OVERRIDE
 #define YS_OVERRIDE override
@@ -46,12 +50,29 @@ struct QuicklogicIob : public Pass {
         }
     };
 
+    /// A pinmap site chosen for a pad and a particular IO cell type
+    struct PadSite {
+        std::string locName;  // Location string (eg. "X10Y20")
+        std::string cellType; // IO cell type as given in the pinmap
+        int preference = -1;  // Index of cellType in the IO cell preferred types, -1 if not preferred
+    };
+
+    /// A PCF constraint resolved against the pinmap
+    struct PadConstraint {
+        std::string netName;        // Net name as written in the PCF
+        std::string padName;        // Name of the pad
+        std::vector<PadSite> sites; // Preferred site for each IO cell type, empty if the pad is not in the pinmap
+    };
+
+    /// A (top-level port wire, bit offset) key of the constraint index
+    typedef std::pair<RTLIL::IdString, int> NetBit;
+
     QuicklogicIob() : Pass("quicklogic_iob", "Map IO buffers to cells that correspond to their assigned locations") {}
 
     void help() YS_OVERRIDE
     {
         log("\n");
-        log("    quicklogic_iob <PCF file> <pinmap file> [<io cell specs>]");
+        log("    quicklogic_iob [options] <PCF file> <pinmap file> [<io cell specs>]");
         log("\n");
         log("This command assigns certain parameters of the specified IO cell types\n");
         log("basing on the placement constraints and the pin map of the target device\n");
@@ -78,35 +99,63 @@ struct QuicklogicIob : public Pass {
         log("        The third argument is a comma-separated list of preferred IO cell\n");
         log("        types in order of preference.\n");
         log("\n");
+        log("Options:\n");
+        log("\n");
+        log("    -auto_assign\n");
+        log("        Assign free pads from the pinmap to top-level ports that are not\n");
+        log("        constrained by the PCF file. Bits of a bus are placed on adjacent\n");
+        log("        pads (in pinmap order) when possible and only pads that provide\n");
+        log("        one of the preferred types of the IO cell are used.\n");
+        log("\n");
     }
 
     void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) YS_OVERRIDE
     {
-        if (a_Args.size() < 3) {
-            log_cmd_error("    Usage: quicklogic_iob <PCF file> <pinmap file> [<io cell specs>]");
+        bool autoAssign = false;
+
+        std::vector<std::string> args;
+        for (size_t i = 1; i < a_Args.size(); ++i) {
+            if (a_Args[i] == "-auto_assign") {
+                autoAssign = true;
+                continue;
+            }
+            args.push_back(a_Args[i]);
+        }
+
+        if (args.size() < 2) {
+            log_cmd_error("    Usage: quicklogic_iob [options] <PCF file> <pinmap file> [<io cell specs>]");
         }
 
-        // A map of IO cell types and their port names that should go to a pad
-        std::unordered_map<std::string, IoCellType> ioCellTypes;
+        // A list of IO cell types and their port names that should go to a pad
+        std::vector<IoCellType> ioCellTypes;
+        // IO cell type list index by the (escaped) cell type name
+        dict<RTLIL::IdString, size_t> ioCellTypeIndex;
+
+        auto addIoCellType = [&](const IoCellType &a_IoCellType) {
+            auto ins = ioCellTypeIndex.emplace(RTLIL::escape_id(a_IoCellType.type), ioCellTypes.size());
+            if (ins.second) {
+                ioCellTypes.push_back(a_IoCellType);
+            }
+        };
 
         // Parse io cell specification
-        if (a_Args.size() > 3) {
+        if (args.size() > 2) {
 
             // FIXME: Are these characters set the only ones that can be in
             // cell / port name ?
             std::regex re1("^([\\w$]+):([\\w$]+)$");
             std::regex re2("^([\\w$]+):([\\w$]+):([\\w,$]+)$");
 
-            for (size_t i = 3; i < a_Args.size(); ++i) {
+            for (size_t i = 2; i < args.size(); ++i) {
                 std::cmatch cm;
 
                 // No preffered IO cell types
-                if (std::regex_match(a_Args[i].c_str(), cm, re1)) {
-                    ioCellTypes.emplace(cm[1].str(), IoCellType(cm[1], cm[2]));
+                if (std::regex_match(args[i].c_str(), cm, re1)) {
+                    addIoCellType(IoCellType(cm[1], cm[2]));
                 }
 
                 // With preferred IO cell types
-                else if (std::regex_match(a_Args[i].c_str(), cm, re2)) {
+                else if (std::regex_match(args[i].c_str(), cm, re2)) {
                     std::vector<std::string> preferredTypes;
                     std::stringstream ss(cm[3]);
 
@@ -117,22 +166,22 @@ struct QuicklogicIob : public Pass {
                         preferredTypes.push_back(field);
                     }
 
-                    ioCellTypes.emplace(cm[1].str(), IoCellType(cm[1], cm[2], preferredTypes));
+                    addIoCellType(IoCellType(cm[1], cm[2], preferredTypes));
                 }
 
                 // Invalid
                 else {
-                    log_cmd_error("Invalid IO cell+port spec: '%s'\n", a_Args[i].c_str());
+                    log_cmd_error("Invalid IO cell+port spec: '%s'\n", args[i].c_str());
                 }
             }
         }
 
         // Use the default IO cells for QuickLogic FPGAs
         else {
-            ioCellTypes.emplace("inpad", IoCellType("inpad", "P", {"BIDIR", "SDIOMUX"}));
-            ioCellTypes.emplace("outpad", IoCellType("outpad", "P", {"BIDIR", "SDIOMUX"}));
-            ioCellTypes.emplace("bipad", IoCellType("bipad", "P", {"BIDIR", "SDIOMUX"}));
-            ioCellTypes.emplace("ckpad", IoCellType("ckpad", "P", {"CLOCK", "BIDIR", "SDIOMUX"}));
+            addIoCellType(IoCellType("inpad", "P", {"BIDIR", "SDIOMUX"}));
+            addIoCellType(IoCellType("outpad", "P", {"BIDIR", "SDIOMUX"}));
+            addIoCellType(IoCellType("bipad", "P", {"BIDIR", "SDIOMUX"}));
+            addIoCellType(IoCellType("ckpad", "P", {"CLOCK", "BIDIR", "SDIOMUX"}));
         }
 
         // Get the top module of the design
@@ -142,56 +191,116 @@ struct QuicklogicIob : public Pass {
         }
 
         // Read and parse the PCF file
-        log("Loading PCF from '%s'...\n", a_Args[1].c_str());
+        log("Loading PCF from '%s'...\n", args[0].c_str());
         auto pcfParser = PcfParser();
-        if (!pcfParser.parse(a_Args[1])) {
+        if (!pcfParser.parse(args[0])) {
             log_cmd_error("Failed to parse the PCF file!\n");
         }
 
-        // Build a map of net names to constraints
-        std::unordered_map<std::string, const PcfParser::Constraint> constraintMap;
+        // Read and parse pinmap CSV file
+        log("Loading pinmap CSV from '%s'...\n", args[1].c_str());
+        auto pinmapParser = PinmapParser();
+        if (!pinmapParser.parse(args[1])) {
+            log_cmd_error("Failed to parse the pinmap CSV file!\n");
+        }
+
+        // Build a map of pad names to entries. Keep pad names in the pinmap
+        // order too.
+        const auto pinmapEntries = pinmapParser.getEntries();
+        std::unordered_map<std::string, std::vector<const PinmapParser::Entry *>> pinmapMap;
+        std::vector<std::string> padNames;
+        for (auto &entry : pinmapEntries) {
+            auto it = entry.find("name");
+            if (it != entry.end()) {
+                auto &entries = pinmapMap[it->second];
+                if (entries.empty()) {
+                    padNames.push_back(it->second);
+                }
+                entries.push_back(&entry);
+            }
+        }
+
+        // Resolve each constraint against the pinmap once. For every IO cell
+        // type pick the preferred pinmap entry of the constrained pad.
+        std::vector<PadConstraint> constraints;
+        std::unordered_set<std::string> constrainedNets;
         for (auto &constraint : pcfParser.getConstraints()) {
-            if (constraintMap.count(constraint.netName) != 0) {
+            if (!constrainedNets.insert(constraint.netName).second) {
                 log_cmd_error("The net '%s' is constrained twice!", constraint.netName.c_str());
             }
-            constraintMap.emplace(constraint.netName, constraint);
-        }
 
-        // Read and parse pinmap CSV file
-        log("Loading pinmap CSV from '%s'...\n", a_Args[2].c_str());
-        auto pinmapParser = PinmapParser();
-        if (!pinmapParser.parse(a_Args[2])) {
-            log_cmd_error("Failed to parse the pinmap CSV file!\n");
+            PadConstraint padConstraint;
+            padConstraint.netName = constraint.netName;
+            padConstraint.padName = constraint.padName;
+
+            auto it = pinmapMap.find(constraint.padName);
+            if (it != pinmapMap.end()) {
+                padConstraint.sites = resolvePadSites(it->second, ioCellTypes);
+            }
+
+            constraints.push_back(padConstraint);
         }
 
-        // Build a map of pad names to entries
-        std::unordered_map<std::string, std::vector<PinmapParser::Entry>> pinmapMap;
-        for (auto &entry : pinmapParser.getEntries()) {
-            if (entry.count("name") != 0) {
-                auto &name = entry.at("name");
+        // Normalize PCF net names into (port wire, bit) keys. A name that
+        // matches a top-level port as a whole constrains all of its bits,
+        // "name[i]" and "name(i)" constrain a single bit. When several names
+        // refer to the same bit the first in that order wins.
+        dict<NetBit, std::pair<int, size_t>> rankedIndex;
+        for (size_t i = 0; i < constraints.size(); ++i) {
+            const auto &netName = constraints[i].netName;
+
+            auto addKey = [&](const NetBit &a_Key, int a_Rank) {
+                auto ins = rankedIndex.emplace(a_Key, std::make_pair(a_Rank, i));
+                if (!ins.second && ins.first->second.first > a_Rank) {
+                    ins.first->second = std::make_pair(a_Rank, i);
+                }
+            };
 
-                if (pinmapMap.count(name) == 0) {
-                    pinmapMap[name] = std::vector<PinmapParser::Entry>();
+            RTLIL::Wire *wire = topModule->wire(RTLIL::escape_id(netName));
+            if (wire != nullptr && (wire->port_input || wire->port_output)) {
+                for (int bit = 0; bit < wire->width; ++bit) {
+                    addKey(NetBit(wire->name, bit), 0);
                 }
+            }
 
-                pinmapMap[name].push_back(entry);
+            std::string baseName;
+            int bit = 0;
+            int rank = splitNetName(netName, baseName, bit);
+            if (rank != 0) {
+                wire = topModule->wire(RTLIL::escape_id(baseName));
+                if (wire != nullptr && (wire->port_input || wire->port_output) && bit < wire->width) {
+                    addKey(NetBit(wire->name, bit), rank);
+                }
             }
         }
 
+        dict<NetBit, size_t> constraintIndex;
+        for (auto &it : rankedIndex) {
+            constraintIndex.emplace(it.first, it.second.second);
+        }
+
+        // Assign free pads to unconstrained ports
+        if (autoAssign) {
+            autoAssignPads(topModule, ioCellTypes, ioCellTypeIndex, pinmapMap, padNames, constraints, constraintIndex);
+        }
+
         // Check all IO cells
         log("Processing cells...");
         log("\n");
         log("  type       | net        | pad        | loc      | type     | instance\n");
         log(" ------------+------------+------------+----------+----------+-----------\n");
         for (auto cell : topModule->cells()) {
-            auto ysCellType = RTLIL::unescape_id(cell->type);
 
             // Not an IO cell
-            if (ioCellTypes.count(ysCellType) == 0) {
+            auto typeIt = ioCellTypeIndex.find(cell->type);
+            if (typeIt == ioCellTypeIndex.end()) {
                 continue;
             }
 
-            log("  %-10s ", ysCellType.c_str());
+            const size_t typeIndex = typeIt->second;
+            const auto &ioCellType = ioCellTypes[typeIndex];
+
+            log("  %-10s ", ioCellType.type.c_str());
 
             std::string netName;
             std::string padName;
@@ -199,91 +308,340 @@ struct QuicklogicIob : public Pass {
             std::string cellType;
 
             // Get connections to the specified port
-            const auto &ioCellType = ioCellTypes.at(ysCellType);
-            const std::string port = RTLIL::escape_id(ioCellType.port);
-            if (cell->connections().count(port)) {
-
-                // Get the sigspec of the connection
-                auto sigspec = cell->connections().at(port);
+            const RTLIL::IdString port = RTLIL::escape_id(ioCellType.port);
+            if (cell->hasPort(port)) {
 
                 // Get the connected wire
-                for (auto sigbit : sigspec.bits()) {
+                for (auto sigbit : cell->getPort(port)) {
                     if (sigbit.wire != nullptr) {
                         auto wire = sigbit.wire;
 
                         // Has to be top level wire
                         if (wire->port_input || wire->port_output) {
 
-                            // Check if the wire is constrained. Get pad name.
-                            std::string baseName = RTLIL::unescape_id(wire->name);
-                            std::string netNames[] = {
-                              baseName,
-                              stringf("%s[%d]", baseName.c_str(), sigbit.offset),
-                              stringf("%s(%d)", baseName.c_str(), sigbit.offset),
-                            };
-
                             padName = "";
                             netName = "";
 
-                            for (auto &name : netNames) {
-                                if (constraintMap.count(name)) {
-                                    auto constraint = constraintMap.at(name);
-                                    padName = constraint.padName;
-                                    netName = name;
-                                    break;
+                            // Check if the wire is constrained. Get pad name.
+                            auto it = constraintIndex.find(NetBit(wire->name, sigbit.offset));
+                            if (it != constraintIndex.end()) {
+                                const auto &constraint = constraints[it->second];
+                                padName = constraint.padName;
+                                netName = constraint.netName;
+
+                                // Use the pinmap site preferred by the cell
+                                if (!constraint.sites.empty()) {
+                                    locName = constraint.sites[typeIndex].locName;
+                                    cellType = constraint.sites[typeIndex].cellType;
                                 }
                             }
+                        }
+                    }
+                }
+            }
+
+            log("| %-10s | %-10s | %-8s | %-8s | %s\n", netName.c_str(), padName.c_str(), locName.c_str(), cellType.c_str(), cell->name.c_str());
+
+            // Annotate the cell by setting its parameters
+            cell->setParam(ID(IO_PAD), padName);
+            cell->setParam(ID(IO_LOC), locName);
+            cell->setParam(ID(IO_TYPE), cellType);
+        }
+    }
 
-                            // Check if there is an entry in the pinmap for this pad name
-                            if (pinmapMap.count(padName)) {
+    /// Splits a PCF net name of the form "<name>[<bit>]" or "<name>(<bit>)"
+    /// into the base name and the bit index. Returns 1 for the "[]" form, 2
+    /// for the "()" form and 0 if the name is not indexed.
+    static int splitNetName(const std::string &a_Name, std::string &a_BaseName, int &a_Bit)
+    {
+        if (a_Name.empty()) {
+            return 0;
+        }
 
-                                // Choose a correct entry for the cell
-                                auto entry = choosePinmapEntry(pinmapMap.at(padName), ioCellType);
+        const char close = a_Name.back();
+        const char open = (close == ']') ? '[' : (close == ')') ? '(' : '\0';
+        if (open == '\0') {
+            return 0;
+        }
 
-                                // Location string
-                                if (entry.count("x") && entry.count("y")) {
-                                    locName = stringf("X%sY%s", entry.at("x").c_str(), entry.at("y").c_str());
-                                }
+        const size_t pos = a_Name.rfind(open);
+        if (pos == std::string::npos || pos == 0 || pos + 2 >= a_Name.size()) {
+            return 0;
+        }
 
-                                // Cell type
-                                if (entry.count("type")) {
-                                    cellType = entry.at("type");
-                                }
-                            }
-                        }
+        // Only plain decimal indices, as printed by "%d"
+        const size_t first = pos + 1;
+        const size_t last = a_Name.size() - 1;
+        if (a_Name[first] == '0' && last - first > 1) {
+            return 0;
+        }
+
+        long bit = 0;
+        for (size_t i = first; i < last; ++i) {
+            if (a_Name[i] < '0' || a_Name[i] > '9' || bit > INT_MAX / 10) {
+                return 0;
+            }
+            bit = bit * 10 + (a_Name[i] - '0');
+        }
+        if (bit > INT_MAX) {
+            return 0;
+        }
+
+        a_BaseName = a_Name.substr(0, pos);
+        a_Bit = (int)bit;
+        return (open == '[') ? 1 : 2;
+    }
+
+    /// Returns the preferred pinmap site of a pad for each IO cell type
+    std::vector<PadSite> resolvePadSites(const std::vector<const PinmapParser::Entry *> &a_Entries, const std::vector<IoCellType> &a_IoCellTypes)
+    {
+        std::vector<PadSite> sites;
+
+        for (auto &ioCellType : a_IoCellTypes) {
+            const auto &entry = choosePinmapEntry(a_Entries, ioCellType);
+
+            PadSite site;
+            if (entry.count("x") && entry.count("y")) {
+                site.locName = stringf("X%sY%s", entry.at("x").c_str(), entry.at("y").c_str());
+            }
+            if (entry.count("type")) {
+                site.cellType = entry.at("type");
+            }
+
+            if (ioCellType.preferredTypes.empty()) {
+                site.preference = 0;
+            } else {
+                const auto &types = ioCellType.preferredTypes;
+                auto it = std::find(types.begin(), types.end(), site.cellType);
+                if (it != types.end()) {
+                    site.preference = it - types.begin();
+                }
+            }
+
+            sites.push_back(site);
+        }
+
+        return sites;
+    }
+
+    /// Assigns free pads to IO cell port bits that are not constrained. Each
+    /// assignment is appended to the constraint list and index as if it came
+    /// from the PCF file.
+    ///
+    /// Ports are placed one by one, those whose IO cell type has the fewest
+    /// pads of its most preferred type first (eg. clocks), then wider buses
+    /// first. A port goes to the window of consecutive free pads (in pinmap
+    /// order) with the best total preference. If no such window exists its
+    /// bits are spread over the best remaining pads individually.
+    void autoAssignPads(RTLIL::Module *a_Module, const std::vector<IoCellType> &a_IoCellTypes, const dict<RTLIL::IdString, size_t> &a_IoCellTypeIndex,
+                        const std::unordered_map<std::string, std::vector<const PinmapParser::Entry *>> &a_PinmapMap,
+                        const std::vector<std::string> &a_PadNames, std::vector<PadConstraint> &a_Constraints, dict<NetBit, size_t> &a_ConstraintIndex)
+    {
+        // A group of unconstrained bits of one port driven by one IO cell type
+        struct PortGroup {
+            RTLIL::Wire *wire;
+            size_t typeIndex;
+            std::vector<int> bits;
+        };
+
+        // Collect unconstrained port bits per (port, IO cell type)
+        std::vector<PortGroup> groups;
+        dict<std::pair<RTLIL::IdString, size_t>, size_t> groupIndex;
+        pool<NetBit> seenBits;
+
+        for (auto cell : a_Module->cells()) {
+            auto typeIt = a_IoCellTypeIndex.find(cell->type);
+            if (typeIt == a_IoCellTypeIndex.end()) {
+                continue;
+            }
+
+            const RTLIL::IdString port = RTLIL::escape_id(a_IoCellTypes[typeIt->second].port);
+            if (!cell->hasPort(port)) {
+                continue;
+            }
+
+            for (auto sigbit : cell->getPort(port)) {
+                auto wire = sigbit.wire;
+                if (wire == nullptr || !(wire->port_input || wire->port_output)) {
+                    continue;
+                }
+
+                NetBit netBit(wire->name, sigbit.offset);
+                if (a_ConstraintIndex.count(netBit) || !seenBits.insert(netBit).second) {
+                    continue;
+                }
+
+                auto ins = groupIndex.emplace(std::make_pair(wire->name, typeIt->second), groups.size());
+                if (ins.second) {
+                    groups.push_back(PortGroup{wire, typeIt->second, {}});
+                }
+                groups[ins.first->second].bits.push_back(sigbit.offset);
+            }
+        }
+
+        if (groups.empty()) {
+            return;
+        }
+
+        // Free pads in pinmap order along with their sites
+        std::unordered_set<std::string> usedPadNames;
+        for (auto &constraint : a_Constraints) {
+            usedPadNames.insert(constraint.padName);
+        }
+
+        std::vector<std::string> freePads;
+        std::vector<std::vector<PadSite>> freeSites;
+        for (auto &padName : a_PadNames) {
+            if (!usedPadNames.count(padName)) {
+                freePads.push_back(padName);
+                freeSites.push_back(resolvePadSites(a_PinmapMap.at(padName), a_IoCellTypes));
+            }
+        }
+
+        // Count pads of the most preferred type per IO cell type
+        std::vector<size_t> bestPadCount(a_IoCellTypes.size(), 0);
+        for (auto &sites : freeSites) {
+            for (size_t t = 0; t < sites.size(); ++t) {
+                if (sites[t].preference == 0) {
+                    bestPadCount[t]++;
+                }
+            }
+        }
+
+        // Order ports: scarce IO cell types first, then wide buses first
+        for (auto &group : groups) {
+            std::sort(group.bits.begin(), group.bits.end());
+        }
+        std::stable_sort(groups.begin(), groups.end(), [&](const PortGroup &a, const PortGroup &b) {
+            if (bestPadCount[a.typeIndex] != bestPadCount[b.typeIndex]) {
+                return bestPadCount[a.typeIndex] < bestPadCount[b.typeIndex];
+            }
+            if (a.bits.size() != b.bits.size()) {
+                return a.bits.size() > b.bits.size();
+            }
+            return a.wire->name.str() < b.wire->name.str();
+        });
+
+        std::vector<bool> padUsed(freePads.size(), false);
+        size_t numAssigned = 0;
+        size_t numUnassigned = 0;
+
+        auto assignPad = [&](const PortGroup &a_Group, int a_Bit, size_t a_Pad) {
+            padUsed[a_Pad] = true;
+
+            PadConstraint constraint;
+            constraint.padName = freePads[a_Pad];
+            constraint.sites = freeSites[a_Pad];
+            if (a_Group.wire->width == 1) {
+                constraint.netName = RTLIL::unescape_id(a_Group.wire->name);
+            } else {
+                constraint.netName = stringf("%s(%d)", RTLIL::unescape_id(a_Group.wire->name).c_str(), a_Bit);
+            }
+
+            log_debug("Auto-assigned '%s' to pad '%s'\n", constraint.netName.c_str(), constraint.padName.c_str());
+
+            a_ConstraintIndex[NetBit(a_Group.wire->name, a_Bit)] = a_Constraints.size();
+            a_Constraints.push_back(constraint);
+            numAssigned++;
+        };
+
+        for (auto &group : groups) {
+            const size_t t = group.typeIndex;
+            const size_t width = group.bits.size();
+
+            // Free pads that are legal for this IO cell type, in pinmap order.
+            // Pads in between that are taken or illegal break adjacency.
+            std::vector<size_t> candidates;
+            std::vector<size_t> runStart;
+            bool inRun = false;
+            for (size_t i = 0; i < freePads.size(); ++i) {
+                if (padUsed[i] || freeSites[i][t].preference < 0) {
+                    inRun = false;
+                    continue;
+                }
+                if (!inRun) {
+                    runStart.push_back(candidates.size());
+                    inRun = true;
+                }
+                candidates.push_back(i);
+            }
+            runStart.push_back(candidates.size());
+
+            // Slide a window of the port width over each run of adjacent
+            // candidates and keep the one with the best total preference.
+            size_t bestStart = SIZE_MAX;
+            long bestCost = LONG_MAX;
+            for (size_t r = 0; r + 1 < runStart.size(); ++r) {
+                const size_t begin = runStart[r];
+                const size_t end = runStart[r + 1];
+                if (end - begin < width) {
+                    continue;
+                }
+
+                long cost = 0;
+                for (size_t i = begin; i < begin + width; ++i) {
+                    cost += freeSites[candidates[i]][t].preference;
+                }
+                for (size_t i = begin;; ++i) {
+                    if (cost < bestCost) {
+                        bestCost = cost;
+                        bestStart = i;
+                    }
+                    if (i + width >= end) {
+                        break;
                     }
+                    cost += freeSites[candidates[i + width]][t].preference - freeSites[candidates[i]][t].preference;
                 }
             }
 
-            log("| %-10s | %-10s | %-8s | %-8s | %s\n", netName.c_str(), padName.c_str(), locName.c_str(), cellType.c_str(), cell->name.c_str());
+            if (bestStart != SIZE_MAX) {
+                for (size_t i = 0; i < width; ++i) {
+                    assignPad(group, group.bits[i], candidates[bestStart + i]);
+                }
+                continue;
+            }
 
-            // Annotate the cell by setting its parameters
-            cell->setParam(RTLIL::escape_id("IO_PAD"), padName);
-            cell->setParam(RTLIL::escape_id("IO_LOC"), locName);
-            cell->setParam(RTLIL::escape_id("IO_TYPE"), cellType);
+            // No room for the whole bus, place bits individually on the most
+            // preferred legal pads.
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [&](size_t a, size_t b) { return freeSites[a][t].preference < freeSites[b][t].preference; });
+
+            for (size_t i = 0; i < width; ++i) {
+                if (i < candidates.size()) {
+                    assignPad(group, group.bits[i], candidates[i]);
+                } else {
+                    numUnassigned++;
+                }
+            }
+        }
+
+        log("Auto-assigned %zu IO(s) to free pads.\n", numAssigned);
+        if (numUnassigned) {
+            log_warning("No legal free pad left for %zu unconstrained IO(s).\n", numUnassigned);
         }
     }
 
-    PinmapParser::Entry choosePinmapEntry(const std::vector<PinmapParser::Entry> &a_Entries, const IoCellType &a_IoCellType)
+    const PinmapParser::Entry &choosePinmapEntry(const std::vector<const PinmapParser::Entry *> &a_Entries, const IoCellType &a_IoCellType)
     {
         // No preferred types, pick the first one
         if (a_IoCellType.preferredTypes.empty()) {
-            return a_Entries[0];
+            return *a_Entries[0];
         }
 
         // Loop over preferred types
         for (auto &type : a_IoCellType.preferredTypes) {
 
             // Find an entry for that type. If found then return it.
-            for (auto &entry : a_Entries) {
-                if (type == entry.at("type")) {
-                    return entry;
+            for (auto entry : a_Entries) {
+                auto it = entry->find("type");
+                if (it != entry->end() && type == it->second) {
+                    return *entry;
                 }
             }
         }
 
         // No preferred type was found, pick the first one.
-        return a_Entries[0];
+        return *a_Entries[0];
     }
 
 } QuicklogicIob;
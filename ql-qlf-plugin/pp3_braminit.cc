@@ -19,20 +19,15 @@
 
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
-#include <bitset>
-#include <stdio.h>
-#include <stdlib.h>
+
+#include "../common/mem_init.h"
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
-static void run_pp3_braminit(Module *module)
+static void run_pp3_braminit(Module *module, bool binary)
 {
     for (auto cell : module->selected_cells()) {
-        uint32_t mem[2048];
-        int32_t ramDataWidth = 32;
-        int32_t ramDataDepth = 512;
-
         log("cell type %s\n", RTLIL::id2cstr(cell->name));
 
         /* Only consider cells we're interested in */
@@ -46,90 +41,22 @@ static void run_pp3_braminit(Module *module)
         if (init_file == "")
             continue;
 
-        /* Open file */
+        /* Load file, parsed once per path and shared by all cells */
         log("Processing %s : %s\n", RTLIL::id2cstr(cell->name), init_file.c_str());
-        ramDataWidth = cell->getParam(ID(data_width_int)).as_int();
-        ramDataDepth = cell->getParam(ID(data_depth_int)).as_int();
+        int ramDataWidth = cell->getParam(ID(data_width_int)).as_int();
+        int ramDataDepth = cell->getParam(ID(data_depth_int)).as_int();
 
-        std::ifstream f;
-        f.open(init_file.c_str());
-        if (f.fail()) {
+        const mem_init_file *mem = load_mem_init_file(init_file, binary);
+        if (mem == nullptr) {
             log("Can not open file `%s`.\n", init_file.c_str());
             continue;
         }
 
-        /* Defaults to 0 */
-        memset(mem, 0x00, sizeof(mem));
-
-        /* Process each line */
-        bool in_comment = false;
-        int cursor = 0;
-
-        while (!f.eof()) {
-            std::string line, token;
-            std::getline(f, line);
-
-            for (int i = 0; i < GetSize(line); i++) {
-                if (in_comment && line.compare(i, 2, "*/") == 0) {
-                    line[i] = ' ';
-                    line[i + 1] = ' ';
-                    in_comment = false;
-                    continue;
-                }
-                if (!in_comment && line.compare(i, 2, "/*") == 0)
-                    in_comment = true;
-                if (in_comment)
-                    line[i] = ' ';
-            }
-
-            while (1) {
-                bool set_cursor = false;
-                long value;
-
-                token = next_token(line, " \t\r\n");
-                if (token.empty() || token.compare(0, 2, "//") == 0)
-                    break;
-
-                if (token[0] == '@') {
-                    token = token.substr(1);
-                    set_cursor = true;
-                }
-
-                const char *nptr = token.c_str();
-                char *endptr;
-                value = strtol(nptr, &endptr, 16);
-                if (!*nptr || *endptr) {
-                    log("Can not parse %s `%s` for %s.\n", set_cursor ? "address" : "value", nptr, token.c_str());
-                    continue;
-                }
-
-                if (set_cursor)
-                    cursor = value;
-                else if (cursor >= 0 && cursor < ramDataDepth)
-                    mem[cursor++] = value;
-                else
-                    log("Attempt to initialize non existent address %d\n", cursor);
-            }
-        }
-
-        // TODO: Support RAM initialization for other widths than 8, 16 and 32
-        if (ramDataWidth != 8 && ramDataWidth != 16 && ramDataWidth != 32) {
-            log("WARNING: The RAM cell '%s' has data width of %d. Initialization of this width from a file is not supported yet!\n",
-                RTLIL::id2cstr(cell->name), ramDataWidth);
-            continue;
-        }
-
-        /* Set attributes */
-        std::string val = "";
-        for (int i = ramDataDepth - 1; i >= 0; i--) {
-            if (ramDataWidth == 8)
-                val += std::bitset<8>(mem[i]).to_string();
-            else if (ramDataWidth == 16)
-                val += std::bitset<16>(mem[i]).to_string();
-            else if (ramDataWidth == 32)
-                val += std::bitset<32>(mem[i]).to_string();
-        }
-        cell->setParam(RTLIL::escape_id("INIT"), RTLIL::Const::from_string(val));
+        /* Set attributes, words not in the file default to 0 */
+        int outOfRange;
+        cell->setParam(RTLIL::escape_id("INIT"), mem_init_to_const(*mem, ramDataWidth, ramDataDepth, RTLIL::State::S0, outOfRange));
+        if (outOfRange > 0)
+            log("Attempt to initialize %d non existent address(es) of %s\n", outOfRange, RTLIL::id2cstr(cell->name));
     }
 }
 
@@ -139,20 +66,35 @@ struct PP3BRAMInitPass : public Pass {
     {
         //   |---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|---v---|
         log("\n");
-        log("    pp3_braminit\n");
+        log("    pp3_braminit [options] [selection]\n");
         log("\n");
         log("This command processes all PP3 RAM blocks with a non-empty INIT_FILE\n");
         log("parameter and converts it into the required INIT attributes\n");
         log("\n");
+        log("INIT_FILE uses the $readmemh syntax and may hold words of any width.\n");
+        log("Each file is parsed once and shared by all RAM blocks that use it.\n");
+        log("\n");
+        log("    -readmemb\n");
+        log("        Parse INIT_FILE in $readmemb syntax, i.e. with binary words.\n");
+        log("\n");
     }
     void execute(std::vector<std::string> args, RTLIL::Design *design) override
     {
         log_header(design, "Executing PP3_BRAMINIT pass.\n");
 
-        extra_args(args, 1, design);
+        bool binary = false;
+        size_t argidx;
+        for (argidx = 1; argidx < args.size(); argidx++) {
+            if (args[argidx] == "-readmemb") {
+                binary = true;
+                continue;
+            }
+            break;
+        }
+        extra_args(args, argidx, design);
 
         for (auto module : design->selected_modules())
-            run_pp3_braminit(module);
+            run_pp3_braminit(module, binary);
     }
 } PP3BRAMInitPass;
 
@@ -0,0 +1,388 @@
+// Copyright (C) 2020-2022  The SymbiFlow Authors.
+//
+// Use of this source code is governed by a ISC-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/ISC
+//
+// SPDX-License-Identifier:ISC
+
+#include "kernel/log.h"
+#include "kernel/register.h"
+#include "kernel/rtlil.h"
+#include "kernel/sigtools.h"
+
+#include "../common/parallel.h"
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+// ============================================================================
+
+struct QlAbcJobsPass : public Pass {
+
+    QlAbcJobsPass() : Pass("ql_abc_jobs", "Map register-bounded logic partitions with concurrent ABC runs") {}
+
+    void help() override
+    {
+        log("\n");
+        log("    ql_abc_jobs [options] [selection]\n");
+        log("\n");
+        log("    This pass maps the gate-level combinational logic of the selected\n");
+        log("    modules to LUTs like the 'abc' pass, but splits it into partitions\n");
+        log("    first and maps the partitions with independent ABC runs that are\n");
+        log("    executed concurrently in separate Yosys processes. The mapped\n");
+        log("    partitions are stitched back into their modules.\n");
+        log("\n");
+        log("    A partition is made of connected components of the gate graph, so\n");
+        log("    every partition is bounded by registers, ports and non-gate cells\n");
+        log("    and no logic crosses partition boundaries. The components are\n");
+        log("    balanced by gate count over the requested number of jobs. Modules\n");
+        log("    that have a single component are mapped with the 'abc' pass.\n");
+        log("\n");
+        log("    -jobs <N>\n");
+        log("        number of concurrent ABC runs. Default: number of CPU cores\n");
+        log("\n");
+        log("    -lut <N>\n");
+        log("    -script <file>\n");
+        log("    -fast\n");
+        log("        passed to each ABC run, see 'help abc'. The 'abc.*' scratchpad\n");
+        log("        variables are passed on as well.\n");
+        log("\n");
+        log("    -check\n");
+        log("        also map each module with a single ABC run and compare the LUT\n");
+        log("        count and the LUT depth of both results. A warning is printed\n");
+        log("        when the partitioned result is worse.\n");
+        log("\n");
+    }
+
+    // ..........................................
+
+    /// Combinational gate cells that the 'abc' pass maps
+    const pool<RTLIL::IdString> m_GateTypes = {
+      ID($_BUF_),    ID($_NOT_),   ID($_AND_), ID($_NAND_), ID($_OR_),   ID($_NOR_),  ID($_XOR_),  ID($_XNOR_),
+      ID($_ANDNOT_), ID($_ORNOT_), ID($_MUX_), ID($_NMUX_), ID($_AOI3_), ID($_OAI3_), ID($_AOI4_), ID($_OAI4_),
+    };
+
+    /// Groups the gates of a module into connected components. Two gates are
+    /// connected when one of them drives an input of the other.
+    std::vector<std::vector<RTLIL::Cell *>> findComponents(RTLIL::Module *a_Module)
+    {
+        SigMap sigmap(a_Module);
+
+        std::vector<RTLIL::Cell *> gates;
+        dict<RTLIL::SigBit, int> drivers;
+        for (auto cell : a_Module->selected_cells()) {
+            if (!m_GateTypes.count(cell->type) || cell->has_keep_attr()) {
+                continue;
+            }
+            for (auto bit : sigmap(cell->getPort(ID::Y))) {
+                drivers[bit] = gates.size();
+            }
+            gates.push_back(cell);
+        }
+
+        std::vector<int> parent(gates.size());
+        for (size_t i = 0; i < parent.size(); ++i) {
+            parent[i] = i;
+        }
+
+        auto find = [&](int a_Index) {
+            while (parent[a_Index] != a_Index) {
+                parent[a_Index] = parent[parent[a_Index]];
+                a_Index = parent[a_Index];
+            }
+            return a_Index;
+        };
+
+        for (size_t i = 0; i < gates.size(); ++i) {
+            for (auto &conn : gates[i]->connections()) {
+                if (conn.first == ID::Y) {
+                    continue;
+                }
+                for (auto bit : sigmap(conn.second)) {
+                    auto it = drivers.find(bit);
+                    if (it != drivers.end()) {
+                        parent[find(i)] = find(it->second);
+                    }
+                }
+            }
+        }
+
+        dict<int, int> componentIndex;
+        std::vector<std::vector<RTLIL::Cell *>> components;
+        for (size_t i = 0; i < gates.size(); ++i) {
+            int root = find(i);
+            if (!componentIndex.count(root)) {
+                componentIndex[root] = components.size();
+                components.emplace_back();
+            }
+            components[componentIndex.at(root)].push_back(gates[i]);
+        }
+
+        return components;
+    }
+
+    /// Distributes components over the given number of partitions, largest
+    /// component first into the currently smallest partition.
+    static std::vector<std::vector<RTLIL::Cell *>> balance(std::vector<std::vector<RTLIL::Cell *>> a_Components, int a_Count)
+    {
+        auto bySize = [](const std::vector<RTLIL::Cell *> &a, const std::vector<RTLIL::Cell *> &b) { return a.size() < b.size(); };
+        std::sort(a_Components.rbegin(), a_Components.rend(), bySize);
+
+        std::vector<std::vector<RTLIL::Cell *>> partitions(a_Count);
+        for (auto &component : a_Components) {
+            auto smallest = std::min_element(partitions.begin(), partitions.end(), bySize);
+            smallest->insert(smallest->end(), component.begin(), component.end());
+        }
+
+        return partitions;
+    }
+
+    /// Replaces a partition instance with the contents of the mapped
+    /// partition module. Public names are kept when they are still free.
+    static void inlinePartition(RTLIL::Module *a_Module, RTLIL::Cell *a_Instance, RTLIL::Module *a_Partition)
+    {
+        dict<RTLIL::Wire *, RTLIL::SigSpec> wireMap;
+        for (auto wire : a_Partition->wires()) {
+            if (wire->port_id > 0) {
+                wireMap[wire] = a_Instance->getPort(wire->name);
+                continue;
+            }
+            RTLIL::IdString name = wire->name.isPublic() && !a_Module->wire(wire->name) ? wire->name : NEW_ID;
+            RTLIL::Wire *newWire = a_Module->addWire(name, wire);
+            newWire->port_id = 0;
+            newWire->port_input = false;
+            newWire->port_output = false;
+            wireMap[wire] = newWire;
+        }
+
+        auto mapSig = [&](const RTLIL::SigSpec &a_Sig) {
+            RTLIL::SigSpec result;
+            for (auto &chunk : a_Sig.chunks()) {
+                if (chunk.wire == nullptr) {
+                    result.append(chunk);
+                } else {
+                    result.append(wireMap.at(chunk.wire).extract(chunk.offset, chunk.width));
+                }
+            }
+            return result;
+        };
+
+        for (auto cell : a_Partition->cells()) {
+            RTLIL::IdString name = a_Module->cell(cell->name) ? NEW_ID : cell->name;
+            RTLIL::Cell *newCell = a_Module->addCell(name, cell);
+            for (auto &conn : cell->connections()) {
+                newCell->setPort(conn.first, mapSig(conn.second));
+            }
+        }
+
+        for (auto &conn : a_Partition->connections()) {
+            a_Module->connect(mapSig(conn.first), mapSig(conn.second));
+        }
+
+        a_Module->remove(a_Instance);
+    }
+
+    /// Counts the LUTs of a module and the number of LUTs on its longest
+    /// combinational path.
+    static void lutStats(RTLIL::Module *a_Module, int &a_Count, int &a_Depth)
+    {
+        SigMap sigmap(a_Module);
+
+        dict<RTLIL::SigBit, RTLIL::Cell *> drivers;
+        std::vector<RTLIL::Cell *> luts;
+        for (auto cell : a_Module->cells()) {
+            if (cell->type != ID($lut)) {
+                continue;
+            }
+            for (auto bit : sigmap(cell->getPort(ID::Y))) {
+                drivers[bit] = cell;
+            }
+            luts.push_back(cell);
+        }
+
+        // Depth of each LUT, 0 while it is being computed so that
+        // combinational loops terminate.
+        dict<RTLIL::Cell *, int> depth;
+        std::function<int(RTLIL::Cell *)> lutDepth = [&](RTLIL::Cell *a_Cell) {
+            auto it = depth.find(a_Cell);
+            if (it != depth.end()) {
+                return it->second;
+            }
+            depth[a_Cell] = 0;
+            int result = 0;
+            for (auto bit : sigmap(a_Cell->getPort(ID::A))) {
+                auto driver = drivers.find(bit);
+                if (driver != drivers.end()) {
+                    result = std::max(result, lutDepth(driver->second));
+                }
+            }
+            depth[a_Cell] = result + 1;
+            return result + 1;
+        };
+
+        a_Count = luts.size();
+        a_Depth = 0;
+        for (auto cell : luts) {
+            a_Depth = std::max(a_Depth, lutDepth(cell));
+        }
+    }
+
+    void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
+    {
+        log_header(a_Design, "Executing QL_ABC_JOBS pass.\n");
+
+        int jobs = default_thread_count();
+        std::string abcArgs;
+        bool check = false;
+
+        size_t argidx;
+        for (argidx = 1; argidx < a_Args.size(); argidx++) {
+            if (a_Args[argidx] == "-jobs" && argidx + 1 < a_Args.size()) {
+                jobs = std::max(atoi(a_Args[++argidx].c_str()), 1);
+                continue;
+            }
+            if ((a_Args[argidx] == "-lut" || a_Args[argidx] == "-script") && argidx + 1 < a_Args.size()) {
+                abcArgs += " " + a_Args[argidx] + " " + a_Args[argidx + 1];
+                argidx++;
+                continue;
+            }
+            if (a_Args[argidx] == "-fast") {
+                abcArgs += " -fast";
+                continue;
+            }
+            if (a_Args[argidx] == "-check") {
+                check = true;
+                continue;
+            }
+            break;
+        }
+        extra_args(a_Args, argidx, a_Design);
+
+        std::string yosysExe = proc_self_dirname() + "yosys";
+
+        for (auto module : a_Design->selected_whole_modules_warn()) {
+
+            int singleCount = 0, singleDepth = 0;
+            if (check) {
+                RTLIL::Design *reference = new RTLIL::Design;
+                reference->add(module->clone());
+                for (const auto &it : a_Design->scratchpad) {
+                    if (it.first.compare(0, 4, "abc.") == 0) {
+                        reference->scratchpad[it.first] = it.second;
+                    }
+                }
+                log_push();
+                Pass::call(reference, "abc" + abcArgs);
+                log_pop();
+                lutStats(reference->module(module->name), singleCount, singleDepth);
+                delete reference;
+            }
+
+            auto components = findComponents(module);
+            int count = std::min((int)components.size(), jobs);
+
+            if (count < 2) {
+                log("Module %s has %zu component(s), mapping it with a single ABC run.\n", log_id(module), components.size());
+                Pass::call_on_module(a_Design, module, "abc" + abcArgs);
+            } else {
+                auto partitions = balance(components, count);
+
+                log("Mapping module %s in %d partition(s) of %zu component(s).\n", log_id(module), count, components.size());
+                for (int i = 0; i < count; ++i) {
+                    log("  partition %d: %zu gate(s)\n", i, partitions[i].size());
+                    for (auto cell : partitions[i]) {
+                        cell->set_string_attribute(ID::submod, stringf("ql_abc_part%d", i));
+                    }
+                }
+
+                pool<RTLIL::IdString> existing;
+                for (auto other : a_Design->modules()) {
+                    existing.insert(other->name);
+                }
+
+                log_push();
+                Pass::call_on_module(a_Design, module, "submod");
+                log_pop();
+
+                std::vector<RTLIL::Cell *> instances;
+                for (auto cell : module->cells()) {
+                    if (a_Design->module(cell->type) && !existing.count(cell->type)) {
+                        instances.push_back(cell);
+                    }
+                }
+
+                // Write the partitions out and prepare one Yosys process per
+                // partition.
+                std::string tempDir = make_temp_dir("/tmp/yosys-ql-abc-jobs-XXXXXX");
+                std::vector<std::string> commands;
+                for (size_t i = 0; i < instances.size(); ++i) {
+                    std::string prefix = stringf("%s/part%zu", tempDir.c_str(), i);
+
+                    RTLIL::Design *partition = new RTLIL::Design;
+                    partition->add(a_Design->module(instances[i]->type)->clone());
+                    Pass::call(partition, std::vector<std::string>{"write_rtlil", prefix + "_in.il"});
+                    delete partition;
+
+                    // The 'abc' settings in the scratchpad apply to the
+                    // partitions too
+                    std::ofstream script(prefix + ".ys");
+                    script << "read_rtlil " << prefix << "_in.il\n";
+                    for (const auto &it : a_Design->scratchpad) {
+                        if (it.first.compare(0, 4, "abc.") == 0) {
+                            script << "scratchpad -set " << it.first << " \"" << it.second << "\"\n";
+                        }
+                    }
+                    script << "abc" << abcArgs << "\n";
+                    script << "opt_clean\n";
+                    script << "write_rtlil " << prefix << "_out.il\n";
+                    script.close();
+
+                    commands.push_back(stringf("\"%s\" -q -s %s.ys > %s.log 2>&1", yosysExe.c_str(), prefix.c_str(), prefix.c_str()));
+                }
+
+                std::vector<int> status(instances.size());
+                parallel_for(instances.size(), jobs, [&](size_t i) { status[i] = run_command(commands[i]); });
+
+                // Read the mapped partitions back and stitch them into the
+                // module.
+                for (size_t i = 0; i < instances.size(); ++i) {
+                    std::string prefix = stringf("%s/part%zu", tempDir.c_str(), i);
+                    if (status[i] != 0) {
+                        log_error("ABC run for partition %zu of module %s failed, see '%s.log'.\n", i, log_id(module), prefix.c_str());
+                    }
+
+                    RTLIL::Design *mapped = new RTLIL::Design;
+                    log_push();
+                    Pass::call(mapped, std::vector<std::string>{"read_rtlil", prefix + "_out.il"});
+                    log_pop();
+
+                    RTLIL::IdString partitionName = instances[i]->type;
+                    inlinePartition(module, instances[i], mapped->module(partitionName));
+                    delete mapped;
+
+                    a_Design->remove(a_Design->module(partitionName));
+                }
+
+                remove_directory(tempDir);
+            }
+
+            if (check) {
+                int lutCount, lutDepth;
+                lutStats(module, lutCount, lutDepth);
+                log("Module %s: %d LUT(s), depth %d; single ABC run: %d LUT(s), depth %d.\n", log_id(module), lutCount, lutDepth, singleCount,
+                    singleDepth);
+                if (lutCount > singleCount || lutDepth > singleDepth) {
+                    log_warning("Partitioned mapping of module %s is worse than a single ABC run.\n", log_id(module));
+                }
+            }
+        }
+    }
+
+} QlAbcJobsPass;
+
+PRIVATE_NAMESPACE_END
@@ -1,12 +1,35 @@
 #include "kernel/sigtools.h"
 #include "kernel/yosys.h"
 
+#include <chrono>
+
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
 #include "pmgen/ql-bram-asymmetric-wider-read.h"
 #include "pmgen/ql-bram-asymmetric-wider-write.h"
 
+// Returns the wire behind a matched port connection, or nullptr if the port
+// is not connected to a whole wire of the module. With a_AllowSlice set, a
+// port connected to a slice of a wider wire (e.g. a narrower address port)
+// yields the wire of its first chunk.
+static RTLIL::Wire *get_port_wire(const RTLIL::Module *a_Module, const RTLIL::SigSpec &a_Sig, bool a_AllowSlice = false)
+{
+    RTLIL::Wire *wire = nullptr;
+    if (a_Sig.is_wire()) {
+        wire = a_Sig.as_wire();
+    } else if (a_AllowSlice && !a_Sig.chunks().empty()) {
+        const auto &chunk = a_Sig.chunks()[0];
+        if (chunk.is_wire()) {
+            wire = chunk.wire;
+        }
+    }
+    if (wire != nullptr && wire->module != a_Module) {
+        return nullptr;
+    }
+    return wire;
+}
+
 void test_ql_bram_asymmetric_wider_read(ql_bram_asymmetric_wider_read_pm &pm)
 {
     auto mem = pm.st_ql_bram_asymmetric_wider_read.mem;
@@ -32,32 +55,25 @@ void test_ql_bram_asymmetric_wider_read(ql_bram_asymmetric_wider_read_pm &pm)
     // Set new type for cell so that it won't be processed by memory_bram pass
     cell->type = IdString(RTLIL::escape_id("_$_mem_v2_asymmetric"));
 
-    // Prepare wires from memory cell side to compare against module wires
-    if (!mux_s.is_wire())
+    // Take the wires straight from the matched port connections
+    RTLIL::Wire *wr_en_w = get_port_wire(pm.module, mux_s);
+    if (!wr_en_w)
         log_error("WR_EN input wire not found\n");
-    RTLIL::Wire *wr_en_cw = mux_s.as_wire();
 
     // The WR address wire can be narrower
-    RTLIL::Wire *wr_addr_cw = nullptr;
-    if (mem_wr_addr.is_wire())
-        wr_addr_cw = mem_wr_addr.as_wire();
-    else if (!mem_wr_addr.chunks().empty()) {
-        auto chunk = mem_wr_addr.chunks()[0];
-        if (chunk.is_wire())
-            wr_addr_cw = chunk.wire;
-    }
-    if (!wr_addr_cw)
+    RTLIL::Wire *wr_addr_w = get_port_wire(pm.module, mem_wr_addr, true);
+    if (!wr_addr_w)
         log_error("WR_ADDR input wire not found\n");
 
-    if (!wr_data_shift_a.is_wire())
+    RTLIL::Wire *wr_data_w = get_port_wire(pm.module, wr_data_shift_a);
+    if (!wr_data_w)
         log_error("WR_DATA input wire not found\n");
-    RTLIL::Wire *wr_data_cw = wr_data_shift_a.as_wire();
-    if (!mem_rd_addr.is_wire())
+    RTLIL::Wire *rd_addr_w = get_port_wire(pm.module, mem_rd_addr);
+    if (!rd_addr_w)
         log_error("RD_ADDR input wire not found\n");
-    RTLIL::Wire *rd_addr_cw = mem_rd_addr.as_wire();
-    if (!mem_rd_data.is_wire())
+    RTLIL::Wire *rd_data_w = get_port_wire(pm.module, mem_rd_data);
+    if (!rd_data_w)
         log_error("RD_DATA input wire not found\n");
-    RTLIL::Wire *rd_data_cw = mem_rd_data.as_wire();
 
     // Check if wr_en_and cell has one of its inputs connected to write address
     RTLIL::Wire *wr_en_and_a_w = nullptr;
@@ -73,32 +89,9 @@ void test_ql_bram_asymmetric_wider_read(ql_bram_asymmetric_wider_read_pm &pm)
     }
     if (!has_wire)
         log_error("RD_ADDR $and cell input wire not found\n");
-    if ((wr_en_and_a_w != wr_addr_cw) & (wr_en_and_b_w != wr_addr_cw))
+    if ((wr_en_and_a_w != wr_addr_w) & (wr_en_and_b_w != wr_addr_w))
         log_error("This is not the $and cell we are looking for\n");
 
-    // Compare and assign wires
-    RTLIL::Wire *wr_en_w = nullptr;
-    RTLIL::Wire *wr_addr_w = nullptr;
-    RTLIL::Wire *wr_data_w = nullptr;
-    RTLIL::Wire *rd_addr_w = nullptr;
-    RTLIL::Wire *rd_data_w = nullptr;
-
-    for (auto wire : pm.module->wires_) {
-        if (wire.second == wr_en_cw)
-            wr_en_w = wire.second;
-        if (wire.second == wr_addr_cw)
-            wr_addr_w = wire.second;
-        if (wire.second == wr_data_cw)
-            wr_data_w = wire.second;
-        if (wire.second == rd_data_cw)
-            rd_data_w = wire.second;
-        if (wire.second == rd_addr_cw)
-            rd_addr_w = wire.second;
-    }
-
-    if (!wr_en_w | !wr_addr_w | !wr_data_w | !rd_data_w | !rd_addr_w)
-        log_error("Match between RAM input wires and memory cell ports not found\n");
-
     // Get address and data lines widths
     int rd_addr_width = rd_addr_w->width;
     int wr_addr_width = wr_addr_w->width;
@@ -159,12 +152,13 @@ void test_ql_bram_asymmetric_wider_read(ql_bram_asymmetric_wider_read_pm &pm)
     // Bypass shift on write address line
     cell->setPort(RTLIL::escape_id("WR_EN"), RTLIL::SigSpec(wr_en_w));
 
-    // Cleanup the module from unused cells
-    pm.module->remove(mem);
-    pm.module->remove(mux);
-    pm.module->remove(wr_en_shift);
-    pm.module->remove(wr_en_and);
-    pm.module->remove(wr_data_shift);
+    // Cleanup the module from unused cells. The cells are removed once the
+    // matcher is done so that its index stays valid for further matches.
+    pm.autoremove(mem);
+    pm.autoremove(mux);
+    pm.autoremove(wr_en_shift);
+    pm.autoremove(wr_en_and);
+    pm.autoremove(wr_data_shift);
 }
 
 void test_ql_bram_asymmetric_wider_write(ql_bram_asymmetric_wider_write_pm &pm)
@@ -195,97 +189,48 @@ void test_ql_bram_asymmetric_wider_write(ql_bram_asymmetric_wider_write_pm &pm)
     // Set new type for cell so that it won't be processed by memory_bram pass
     cell->type = IdString(RTLIL::escape_id("_$_mem_v2_asymmetric"));
 
-    // Prepare wires from memory cell side to compare against module wires
-    RTLIL::Wire *rd_data_wc = nullptr;
-    RTLIL::Wire *rd_en_wc = nullptr;
-    RTLIL::Wire *clk_wc = nullptr;
-    RTLIL::Wire *rd_addr_and_a_wc = nullptr;
-    RTLIL::Wire *rd_addr_and_b_wc = nullptr;
+    // Take the wires straight from the matched port connections
+    RTLIL::Wire *rd_data_w = nullptr;
+    RTLIL::Wire *rd_en_w = nullptr;
+    RTLIL::Wire *rd_clk_w = nullptr;
+    RTLIL::Wire *rd_addr_and_a_w = nullptr;
+    RTLIL::Wire *rd_addr_and_b_w = nullptr;
 
     if (rd_data_ff) {
-        if (!rd_data_ff_q.is_wire())
+        rd_data_w = get_port_wire(pm.module, rd_data_ff_q);
+        if (!rd_data_w)
             log_error("RD_DATA input wire not found\n");
-        rd_data_wc = rd_data_ff_q.as_wire();
-        if (!rd_data_ff_en.is_wire())
+        rd_en_w = get_port_wire(pm.module, rd_data_ff_en);
+        if (!rd_en_w)
             log_error("RD_EN input wire not found\n");
-        rd_en_wc = rd_data_ff_en.as_wire();
-        if (!rd_data_ff_clk.is_wire())
+        rd_clk_w = get_port_wire(pm.module, rd_data_ff_clk);
+        if (!rd_clk_w)
             log_error("RD_CLK input wire not found\n");
-        clk_wc = rd_data_ff_clk.as_wire();
     } else {
         log_error("output FF not found\n");
     }
 
     if (rd_addr_and) {
-        bool has_wire = false;
-        if (rd_addr_and_a.is_wire()) {
-            has_wire = true;
-            rd_addr_and_a_wc = rd_addr_and_a.as_wire();
-        }
-        if (rd_addr_and_b.is_wire()) {
-            has_wire = true;
-            rd_addr_and_b_wc = rd_addr_and_b.as_wire();
-        }
-        if (!has_wire)
+        rd_addr_and_a_w = get_port_wire(pm.module, rd_addr_and_a);
+        rd_addr_and_b_w = get_port_wire(pm.module, rd_addr_and_b);
+        if (!rd_addr_and_a_w && !rd_addr_and_b_w)
             log_error("RD_ADDR $and cell input wire not found\n");
     } else {
         log_debug("RD_ADDR $and cell not found\n");
     }
 
-    RTLIL::Wire *wr_addr_wc;
-    if (wr_addr_ff) {
-        if (!wr_addr_ff_d.is_wire())
-            log_error("WR_ADDR input wire not found\n");
-        wr_addr_wc = wr_addr_ff_d.as_wire();
-    } else {
-        if (!mem_wr_addr.is_wire())
-            log_error("WR_ADDR input wire not found\n");
-        wr_addr_wc = mem_wr_addr.as_wire();
-    }
+    RTLIL::Wire *wr_addr_w = get_port_wire(pm.module, wr_addr_ff ? wr_addr_ff_d : mem_wr_addr);
+    if (!wr_addr_w)
+        log_error("WR_ADDR input wire not found\n");
 
     // The RD address wire can be narrower
-    RTLIL::Wire *rd_addr_wc = nullptr;
-    if (mem_rd_addr.is_wire())
-        rd_addr_wc = mem_rd_addr.as_wire();
-    else if (!mem_rd_addr.chunks().empty()) {
-        auto chunk = mem_rd_addr.chunks()[0];
-        if (chunk.is_wire())
-            rd_addr_wc = chunk.wire;
-    }
-    if (!rd_addr_wc)
+    RTLIL::Wire *rd_addr_w = get_port_wire(pm.module, mem_rd_addr, true);
+    if (!rd_addr_w)
         log_error("RD_ADDR input wire not found\n");
 
-    if (!mem_wr_data.is_wire())
+    RTLIL::Wire *wr_data_w = get_port_wire(pm.module, mem_wr_data);
+    if (!wr_data_w)
         log_error("WR_DATA input wire not found\n");
-    auto wr_data_wc = mem_wr_data.as_wire();
-
-    // Check if wr_en_and cell has one of its inputs connected to write address
-
-    // Compare and assign wires
-    RTLIL::Wire *rd_addr_w = nullptr;
-    RTLIL::Wire *rd_data_w = nullptr;
-    RTLIL::Wire *rd_en_w = nullptr;
-    RTLIL::Wire *rd_clk_w = nullptr;
-    RTLIL::Wire *wr_addr_w = nullptr;
-    RTLIL::Wire *wr_data_w = nullptr;
-
-    for (auto wire : pm.module->wires_) {
-        if (wire.second == rd_addr_wc)
-            rd_addr_w = wire.second;
-        if (wire.second == rd_data_wc)
-            rd_data_w = wire.second;
-        if (wire.second == rd_en_wc)
-            rd_en_w = wire.second;
-        if (wire.second == clk_wc)
-            rd_clk_w = wire.second;
-        if (wire.second == wr_addr_wc)
-            wr_addr_w = wire.second;
-        if (wire.second == wr_data_wc)
-            wr_data_w = wire.second;
-    }
-
-    if (!rd_addr_w | !rd_data_w | !rd_en_w | !rd_clk_w | !wr_addr_w | !wr_data_w)
-        log_error("Match between RAM input wires and memory cell ports not found\n");
 
     // Set shift output SigSpec as RD_DATA
     cell->setPort(RTLIL::escape_id("RD_DATA"), rd_data_shift_y);
@@ -334,18 +279,19 @@ void test_ql_bram_asymmetric_wider_write(ql_bram_asymmetric_wider_write_pm &pm)
     auto rd_en_s = RTLIL::SigSpec(rd_en_w);
     cell->setPort(RTLIL::escape_id("RD_EN"), rd_en_s);
 
-    // Cleanup the module from unused cells
-    pm.module->remove(mem);
-    pm.module->remove(rd_data_shift);
-    pm.module->remove(rd_data_ff);
-    pm.module->remove(wr_en_mux);
+    // Cleanup the module from unused cells. The cells are removed once the
+    // matcher is done so that its index stays valid for further matches.
+    pm.autoremove(mem);
+    pm.autoremove(rd_data_shift);
+    pm.autoremove(rd_data_ff);
+    pm.autoremove(wr_en_mux);
     if (wr_addr_ff)
-        pm.module->remove(wr_addr_ff);
+        pm.autoremove(wr_addr_ff);
     // Check if detected $and is connected to RD_ADDR
-    if ((rd_addr_and_a_wc != rd_addr_w) & (rd_addr_and_b_wc != rd_addr_w))
+    if ((rd_addr_and_a_w != rd_addr_w) & (rd_addr_and_b_w != rd_addr_w))
         log_error("This is not the $and cell we are looking for\n");
     else
-        pm.module->remove(rd_addr_and);
+        pm.autoremove(rd_addr_and);
 }
 
 struct QLBramAsymmetric : public Pass {
@@ -378,12 +324,28 @@ struct QLBramAsymmetric : public Pass {
 
         int found_cells;
         for (auto module : a_Design->selected_modules()) {
-            found_cells = ql_bram_asymmetric_wider_write_pm(module, module->selected_cells())
-                            .run_ql_bram_asymmetric_wider_write(test_ql_bram_asymmetric_wider_write);
-            log_debug("found %d cells matching for wider write port\n", found_cells);
-            found_cells = ql_bram_asymmetric_wider_read_pm(module, module->selected_cells())
-                            .run_ql_bram_asymmetric_wider_read(test_ql_bram_asymmetric_wider_read);
-            log_debug("found %d cells matching for wider read port\n", found_cells);
+            // Each matcher indexes the module once and is kept for all of its
+            // matches. Matched cells are removed when it goes out of scope.
+            {
+                ql_bram_asymmetric_wider_write_pm pm(module, module->selected_cells());
+                found_cells = pm.run_ql_bram_asymmetric_wider_write([&](ql_bram_asymmetric_wider_write_pm &pm) {
+                    auto start = std::chrono::steady_clock::now();
+                    test_ql_bram_asymmetric_wider_write(pm);
+                    log_debug("wider write match %s took %.3f ms\n", log_id(pm.st_ql_bram_asymmetric_wider_write.mem),
+                              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                });
+                log_debug("found %d cells matching for wider write port\n", found_cells);
+            }
+            {
+                ql_bram_asymmetric_wider_read_pm pm(module, module->selected_cells());
+                found_cells = pm.run_ql_bram_asymmetric_wider_read([&](ql_bram_asymmetric_wider_read_pm &pm) {
+                    auto start = std::chrono::steady_clock::now();
+                    test_ql_bram_asymmetric_wider_read(pm);
+                    log_debug("wider read match %s took %.3f ms\n", log_id(pm.st_ql_bram_asymmetric_wider_read.mem),
+                              std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+                });
+                log_debug("found %d cells matching for wider read port\n", found_cells);
+            }
         }
     }
 } QLBramAsymmetric;
@@ -11,6 +11,9 @@
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
 
+#include "../common/affinity.h"
+#include "../common/hierarchy.h"
+
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
@@ -28,6 +31,12 @@ struct QlBramSplitPass : public Pass {
         log("    This pass identifies k6n10f 18K BRAM cells\n");
         log("    and packs pairs of them together into final TDP36K cell that can\n");
         log("    be split into 2x18K BRAMs.\n");
+        log("\n");
+        log("    BRAMs of the same type and configuration are paired by affinity:\n");
+        log("    shared clocks, shared enable and address signals and a shared\n");
+        log("    parent in the design hierarchy. The pairs and their scores are\n");
+        log("    reported together with the BRAM site utilization before and after\n");
+        log("    packing.\n");
     }
 
     // ..........................................
@@ -35,20 +44,26 @@ struct QlBramSplitPass : public Pass {
     /// Describes BRAM config unique to a whole BRAM cell
     struct BramConfig {
 
+        // Cell type
+        RTLIL::IdString type;
+
         // Port connections
         dict<RTLIL::IdString, RTLIL::SigSpec> connections;
 
-        // TODO: Possibly include parameters here. For now we have just
-        // connections.
+        // Parameters shared by both halves of the target cell
+        dict<RTLIL::IdString, RTLIL::Const> parameters;
 
         BramConfig() = default;
 
         BramConfig(const BramConfig &ref) = default;
         BramConfig(BramConfig &&ref) = default;
 
-        unsigned int hash() const { return connections.hash(); }
+        unsigned int hash() const { return mkhash(mkhash(type.hash(), connections.hash()), parameters.hash()); }
 
-        bool operator==(const BramConfig &ref) const { return connections == ref.connections; }
+        bool operator==(const BramConfig &ref) const
+        {
+            return type == ref.type && connections == ref.connections && parameters == ref.parameters;
+        }
     };
 
     // ..........................................
@@ -89,6 +104,23 @@ struct QlBramSplitPass : public Pass {
     // Target BRAM SDP cell type for the split mode
     const std::string m_Bram2x18SDPType = "BRAM2x18_SDP";
 
+    // Source BRAM cell types occupying a whole TDP36K site
+    const std::vector<std::string> m_Bram36Types = {"$__QLF_FACTOR_BRAM36_TDP", "$__QLF_FACTOR_BRAM36_SDP"};
+
+    // Ports considered for pairing by affinity: clocks, enables and addresses
+    const std::vector<std::string> m_BramClockPorts = {"CLK1", "CLK2"};
+    const std::vector<std::string> m_BramEnablePorts = {"A1EN", "B1EN", "C1EN", "D1EN"};
+    const std::vector<std::string> m_BramAddressPorts = {"A1ADDR", "B1ADDR", "C1ADDR", "D1ADDR"};
+
+    // Affinity score weights: per shared clock, enable and address bit and
+    // per shared hierarchy level, and the number of cells each cell is
+    // linked to per key.
+    const int m_AffinityClockBit = 8;
+    const int m_AffinityEnableBit = 2;
+    const int m_AffinityAddressBit = 1;
+    const int m_AffinityHierLevel = 2;
+    const size_t m_AffinityMaxNeighbors = 8;
+
     /// Temporary SigBit to SigBit helper map.
     SigMap m_SigMap;
 
@@ -129,95 +161,135 @@ struct QlBramSplitPass : public Pass {
         }
     }
 
-    void map_pairs(std::vector<RTLIL::Cell *> group, BramConfig config, std::vector<const RTLIL::Cell *> *cellsToRemove, RTLIL::Module *module)
+    void map_pair(const RTLIL::Cell *bram_0, const RTLIL::Cell *bram_1, int score, const BramConfig &config,
+                  std::vector<const RTLIL::Cell *> *cellsToRemove, RTLIL::Module *module)
     {
-        // Ensure an even number
-        size_t count = group.size();
-        if (count & 1)
-            count--;
-
-        // Map SIMD pairs
-        for (size_t i = 0; i < count; i += 2) {
-            const RTLIL::Cell *bram_0 = group[i];
-            const RTLIL::Cell *bram_1 = group[i + 1];
-
-            if (bram_0->type != bram_1->type)
-                log_error("Unsupported BRAM configuration: one half of TDP36K is TDP, second SDP");
-
-            std::vector<std::pair<std::string, std::string>> m_BramDataPorts_0;
-            std::vector<std::pair<std::string, std::string>> m_BramDataPorts_1;
-            std::string m_Bram1x18Type;
-            std::string m_Bram2x18Type;
-            // Distinguish between TDP and SDP
-            if (bram_0->type == RTLIL::escape_id(m_Bram1x18TDPType)) {
-                m_BramDataPorts_0 = m_BramTDPDataPorts_0;
-                m_BramDataPorts_1 = m_BramTDPDataPorts_1;
-                m_Bram1x18Type = m_Bram1x18TDPType;
-                m_Bram2x18Type = m_Bram2x18TDPType;
-            } else {
-                m_BramDataPorts_0 = m_BramSDPDataPorts_0;
-                m_BramDataPorts_1 = m_BramSDPDataPorts_1;
-                m_Bram1x18Type = m_Bram1x18SDPType;
-                m_Bram2x18Type = m_Bram2x18SDPType;
-            }
+        if (bram_0->type != bram_1->type)
+            log_error("Unsupported BRAM configuration: one half of TDP36K is TDP, second SDP");
+
+        std::vector<std::pair<std::string, std::string>> m_BramDataPorts_0;
+        std::vector<std::pair<std::string, std::string>> m_BramDataPorts_1;
+        std::string m_Bram1x18Type;
+        std::string m_Bram2x18Type;
+        // Distinguish between TDP and SDP
+        if (bram_0->type == RTLIL::escape_id(m_Bram1x18TDPType)) {
+            m_BramDataPorts_0 = m_BramTDPDataPorts_0;
+            m_BramDataPorts_1 = m_BramTDPDataPorts_1;
+            m_Bram1x18Type = m_Bram1x18TDPType;
+            m_Bram2x18Type = m_Bram2x18TDPType;
+        } else {
+            m_BramDataPorts_0 = m_BramSDPDataPorts_0;
+            m_BramDataPorts_1 = m_BramSDPDataPorts_1;
+            m_Bram1x18Type = m_Bram1x18SDPType;
+            m_Bram2x18Type = m_Bram2x18SDPType;
+        }
 
-            std::string name = stringf("bram_%s_%s", RTLIL::unescape_id(bram_0->name).c_str(), RTLIL::unescape_id(bram_1->name).c_str());
+        std::string name = stringf("bram_%s_%s", RTLIL::unescape_id(bram_0->name).c_str(), RTLIL::unescape_id(bram_1->name).c_str());
 
-            log(" BRAM: %s (%s) + %s (%s) => %s (%s)\n", RTLIL::unescape_id(bram_0->name).c_str(), RTLIL::unescape_id(bram_0->type).c_str(),
-                RTLIL::unescape_id(bram_1->name).c_str(), RTLIL::unescape_id(bram_1->type).c_str(), RTLIL::unescape_id(name).c_str(),
-                m_Bram2x18Type.c_str());
+        log(" BRAM: %s (%s) + %s (%s) => %s (%s), affinity %d\n", RTLIL::unescape_id(bram_0->name).c_str(),
+            RTLIL::unescape_id(bram_0->type).c_str(), RTLIL::unescape_id(bram_1->name).c_str(), RTLIL::unescape_id(bram_1->type).c_str(),
+            RTLIL::unescape_id(name).c_str(), m_Bram2x18Type.c_str(), score);
 
-            // Create the new cell
-            RTLIL::Cell *bram_2x18 = module->addCell(RTLIL::escape_id(name), RTLIL::escape_id(m_Bram2x18Type));
+        // Create the new cell
+        RTLIL::Cell *bram_2x18 = module->addCell(RTLIL::escape_id(name), RTLIL::escape_id(m_Bram2x18Type));
 
-            // Check if the target cell is known (important to know
-            // its port widths)
-            if (!bram_2x18->known()) {
-                log_error(" The target cell type '%s' is not known!", m_Bram2x18Type.c_str());
-            }
+        // Check if the target cell is known (important to know
+        // its port widths)
+        if (!bram_2x18->known()) {
+            log_error(" The target cell type '%s' is not known!", m_Bram2x18Type.c_str());
+        }
 
-            // Connect shared ports
-            for (const auto &it : m_BramSharedPorts) {
-                auto src = RTLIL::escape_id(it.first);
-                auto dst = RTLIL::escape_id(it.second);
+        // Connect shared ports
+        for (const auto &it : m_BramSharedPorts) {
+            auto src = RTLIL::escape_id(it.first);
+            auto dst = RTLIL::escape_id(it.second);
 
-                bram_2x18->setPort(dst, config.connections.at(src));
-            }
+            bram_2x18->setPort(dst, config.connections.at(src));
+        }
 
-            // Connect data ports
-            // Connect first bram
-            map_ports(m_BramDataPorts_0, bram_0, bram_2x18);
-            // Connect second bram
-            map_ports(m_BramDataPorts_1, bram_1, bram_2x18);
+        // Connect data ports
+        // Connect first bram
+        map_ports(m_BramDataPorts_0, bram_0, bram_2x18);
+        // Connect second bram
+        map_ports(m_BramDataPorts_1, bram_1, bram_2x18);
 
-            // Set bram parameters
-            for (const auto &it : m_BramParams) {
-                auto val = bram_0->getParam(RTLIL::escape_id(it));
-                bram_2x18->setParam(RTLIL::escape_id(it), val);
-            }
+        // Set bram parameters
+        for (const auto &it : m_BramParams) {
+            auto val = bram_0->getParam(RTLIL::escape_id(it));
+            bram_2x18->setParam(RTLIL::escape_id(it), val);
+        }
+
+        // Setting manual parameters
+        if (bram_0->type == RTLIL::escape_id(m_Bram1x18TDPType)) {
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_B"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_D"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_D")));
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_F"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_H"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_D")));
+        } else {
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_B"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
+            bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_D"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
+        }
+        if (bram_0->hasParam(RTLIL::escape_id("INIT")))
+            bram_2x18->setParam(RTLIL::escape_id("INIT0"), bram_0->getParam(RTLIL::escape_id("INIT")));
+        if (bram_1->hasParam(RTLIL::escape_id("INIT")))
+            bram_2x18->setParam(RTLIL::escape_id("INIT1"), bram_1->getParam(RTLIL::escape_id("INIT")));
+
+        // Since in this pass we are mapping the inferred cell directly then mark it as inferred
+        bram_2x18->set_bool_attribute(RTLIL::escape_id("is_inferred"), true);
 
-            // Setting manual parameters
-            if (bram_0->type == RTLIL::escape_id(m_Bram1x18TDPType)) {
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_B"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_D"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_D")));
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_F"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_H"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_D")));
-            } else {
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_B"), bram_0->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
-                bram_2x18->setParam(RTLIL::escape_id("CFG_ENABLE_D"), bram_1->getParam(RTLIL::escape_id("CFG_ENABLE_B")));
+        // Mark BRAM parts for removal
+        cellsToRemove->push_back(bram_0);
+        cellsToRemove->push_back(bram_1);
+    }
+
+    /// Pairs BRAM cells of one group by affinity. Returns the pairs as
+    /// (first, second, score) and sets a_Unpaired to the cell left over.
+    std::vector<std::tuple<int, int, int>> matchGroup(const std::vector<RTLIL::Cell *> &a_Group, int &a_Unpaired)
+    {
+        AffinityMatcher matcher(a_Group.size(), m_AffinityMaxNeighbors);
+
+        // Bucket cells by connected bits and by hierarchy level. Cells are
+        // visited in order so the buckets stay sorted.
+        dict<std::pair<RTLIL::SigBit, int>, std::vector<int>> bitBuckets;
+        dict<std::vector<std::string>, std::vector<int>> hierBuckets;
+        for (size_t i = 0; i < a_Group.size(); ++i) {
+            auto cell = a_Group[i];
+
+            pool<std::pair<RTLIL::SigBit, int>> keys;
+            auto addPorts = [&](const std::vector<std::string> &ports, int weight) {
+                for (const auto &port : ports) {
+                    auto id = RTLIL::escape_id(port);
+                    if (!cell->hasPort(id)) {
+                        continue;
+                    }
+                    for (auto bit : m_SigMap(cell->getPort(id))) {
+                        if (bit.wire != nullptr) {
+                            keys.insert(std::make_pair(bit, weight));
+                        }
+                    }
+                }
+            };
+            addPorts(m_BramClockPorts, m_AffinityClockBit);
+            addPorts(m_BramEnablePorts, m_AffinityEnableBit);
+            addPorts(m_BramAddressPorts, m_AffinityAddressBit);
+            for (const auto &key : keys) {
+                bitBuckets[key].push_back(i);
             }
-            if (bram_0->hasParam(RTLIL::escape_id("INIT")))
-                bram_2x18->setParam(RTLIL::escape_id("INIT0"), bram_0->getParam(RTLIL::escape_id("INIT")));
-            if (bram_1->hasParam(RTLIL::escape_id("INIT")))
-                bram_2x18->setParam(RTLIL::escape_id("INIT1"), bram_1->getParam(RTLIL::escape_id("INIT")));
 
-            // Since in this pass we are mapping the inferred cell directly then mark it as inferred
-            bram_2x18->set_bool_attribute(RTLIL::escape_id("is_inferred"), true);
+            auto path = cell_hier_path(cell);
+            for (size_t level = 1; level <= path.size(); ++level) {
+                hierBuckets[std::vector<std::string>(path.begin(), path.begin() + level)].push_back(i);
+            }
+        }
 
-            // Mark BRAM parts for removal
-            cellsToRemove->push_back(bram_0);
-            cellsToRemove->push_back(bram_1);
+        for (const auto &it : bitBuckets) {
+            matcher.add_key(it.second, it.first.second);
         }
+        for (const auto &it : hierBuckets) {
+            matcher.add_key(it.second, m_AffinityHierLevel);
+        }
+
+        return matcher.match(a_Unpaired);
     }
 
     void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
@@ -235,39 +307,66 @@ struct QlBramSplitPass : public Pass {
             m_SigMap.set(module);
 
             // Assemble BRAM cell groups
-            dict<BramConfig, std::vector<RTLIL::Cell *>> sdp_groups, tdp_groups;
+            dict<BramConfig, std::vector<RTLIL::Cell *>> groups;
+            int bram36Count = 0;
+            int bram18Count = 0;
             for (auto cell : module->selected_cells()) {
 
-                // Skip if it has the (* keep *) attribute set
-                if (cell->has_keep_attr()) {
+                if (std::find(m_Bram36Types.begin(), m_Bram36Types.end(), cell->type.str()) != m_Bram36Types.end()) {
+                    bram36Count++;
+                    continue;
+                }
+                if (cell->type != RTLIL::escape_id(m_Bram1x18TDPType) && cell->type != RTLIL::escape_id(m_Bram1x18SDPType)) {
                     continue;
                 }
+                bram18Count++;
 
-                // Check if this is a BRAM cell and add to a group
-                const auto key = getBramConfig(cell);
-                if (cell->type == RTLIL::escape_id(m_Bram1x18TDPType)) {
-                    tdp_groups[key].push_back(cell);
-                } else if (cell->type == RTLIL::escape_id(m_Bram1x18SDPType)) {
-                    sdp_groups[key].push_back(cell);
-                } else {
+                // Skip if it has the (* keep *) attribute set
+                if (cell->has_keep_attr()) {
                     continue;
                 }
+
+                // Add to a group
+                groups[getBramConfig(cell)].push_back(cell);
+            }
+
+            if (bram36Count + bram18Count == 0) {
+                continue;
             }
 
             std::vector<const RTLIL::Cell *> cellsToRemove;
 
             // Map cell pairs to the target BRAM 2x18 cell
-            for (const auto &it : sdp_groups) {
+            int pairCount = 0;
+            int affinityCount = 0;
+            int totalScore = 0;
+            for (const auto &it : groups) {
                 const auto &group = it.second;
                 const auto &config = it.first;
-                map_pairs(group, config, &cellsToRemove, module);
-            }
-            for (const auto &it : tdp_groups) {
-                const auto &group = it.second;
-                const auto &config = it.first;
-                map_pairs(group, config, &cellsToRemove, module);
+
+                int unpaired;
+                for (const auto &pair : matchGroup(group, unpaired)) {
+                    int score = std::get<2>(pair);
+                    map_pair(group[std::get<0>(pair)], group[std::get<1>(pair)], score, config, &cellsToRemove, module);
+
+                    pairCount++;
+                    if (score > 0) {
+                        affinityCount++;
+                        totalScore += score;
+                    }
+                }
             }
 
+            // Report BRAM site utilization. A TDP36K site holds one 36K BRAM
+            // or two 18K halves.
+            int sitesBefore = bram36Count + bram18Count;
+            int sitesAfter = sitesBefore - pairCount;
+            log("Packed %d BRAM pair(s) in %s: %d by affinity (total score %d), %d in order.\n", pairCount, log_id(module), affinityCount,
+                totalScore, pairCount - affinityCount);
+            log("BRAM sites in %s: %d before, %d after packing; 18K half utilization %.1f%% before, %.1f%% after.\n", log_id(module),
+                sitesBefore, sitesAfter, 100.0 * (2 * bram36Count + bram18Count) / (2 * sitesBefore),
+                100.0 * (2 * bram36Count + bram18Count) / (2 * sitesAfter));
+
             // Remove old cells
             for (const auto &cell : cellsToRemove) {
                 module->remove(const_cast<RTLIL::Cell *>(cell));
@@ -308,6 +407,14 @@ struct QlBramSplitPass : public Pass {
     BramConfig getBramConfig(RTLIL::Cell *a_Cell)
     {
         BramConfig config;
+        config.type = a_Cell->type;
+
+        for (const auto &it : m_BramParams) {
+            auto param = RTLIL::escape_id(it);
+            if (a_Cell->hasParam(param)) {
+                config.parameters[param] = a_Cell->getParam(param);
+            }
+        }
 
         for (const auto &it : m_BramSharedPorts) {
             auto port = RTLIL::escape_id(it.first);
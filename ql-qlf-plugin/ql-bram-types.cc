@@ -0,0 +1,170 @@
+// Copyright (C) 2020-2022  The SymbiFlow Authors.
+//
+// Use of this source code is governed by a ISC-style
+// license that can be found in the LICENSE file or at
+// https://opensource.org/licenses/ISC
+//
+// SPDX-License-Identifier:ISC
+
+#include "kernel/log.h"
+#include "kernel/register.h"
+#include "kernel/rtlil.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+// ============================================================================
+
+struct QlBramTypesPass : public Pass {
+
+    QlBramTypesPass() : Pass("ql_bram_types", "Change TDP36K type to subtypes") {}
+
+    void help() override
+    {
+        log("\n");
+        log("    ql_bram_types [selection]\n");
+        log("\n");
+        log("    This pass changes the type of TDP36K cells to specialized types\n");
+        log("    depending on their configuration. The configuration is read from\n");
+        log("    the 'is_inferred', 'is_fifo', 'sync_fifo', 'is_split',\n");
+        log("    'wr_data_width' and 'rd_data_width' attributes.\n");
+        log("\n");
+        log("    The resulting type name has the following form:\n");
+        log("\n");
+        log("        TDP36K_<BRAM|FIFO_ASYNC|FIFO_SYNC>_WR_X<w>_RD_X<r>_<split|nonsplit>\n");
+        log("\n");
+        log("    Cells with a configuration that has no specialized type are left\n");
+        log("    untouched.\n");
+        log("\n");
+    }
+
+    // ..........................................
+
+    /// Kinds of TDP36K cells
+    enum class Kind { BRAM, FIFO_ASYNC, FIFO_SYNC };
+
+    /// Data width to specialized cell type width maps
+    const dict<int, int> m_DataWidth36 = {{36, 36}, {32, 36}, {18, 18}, {16, 18}, {9, 9}, {8, 9}, {4, 4}, {2, 2}, {1, 1}};
+    const dict<int, int> m_DataWidth18 = {{18, 18}, {16, 18}, {9, 9}, {8, 9}, {4, 4}, {2, 2}, {1, 1}};
+
+    /// Specialized cell types indexed by split mode, kind, write and read
+    /// data widths. Built on first use.
+    dict<std::tuple<bool, int, int, int>, RTLIL::IdString> m_Types;
+
+    void buildTypes()
+    {
+        if (!m_Types.empty()) {
+            return;
+        }
+
+        const std::vector<std::pair<Kind, std::string>> kinds = {
+          {Kind::BRAM, "BRAM"},
+          {Kind::FIFO_ASYNC, "FIFO_ASYNC"},
+          {Kind::FIFO_SYNC, "FIFO_SYNC"},
+        };
+
+        for (bool split : {true, false}) {
+            const auto &dataWidth = split ? m_DataWidth18 : m_DataWidth36;
+            for (const auto &kind : kinds) {
+                for (const auto &ww : dataWidth) {
+                    for (const auto &rw : dataWidth) {
+                        auto key = std::make_tuple(split, (int)kind.first, ww.first, rw.first);
+                        m_Types[key] = RTLIL::escape_id(stringf("TDP36K_%s_WR_X%d_RD_X%d_%s", kind.second.c_str(), ww.second, rw.second,
+                                                                split ? "split" : "nonsplit"));
+                    }
+                }
+            }
+        }
+    }
+
+    /// Reads an integer attribute, returns false if it is not present
+    static bool getIntAttribute(const RTLIL::Cell *a_Cell, const RTLIL::IdString &a_Name, int &a_Value)
+    {
+        if (!a_Cell->has_attribute(a_Name)) {
+            return false;
+        }
+
+        const auto &value = a_Cell->attributes.at(a_Name);
+        if (value.flags & RTLIL::CONST_FLAG_STRING) {
+            a_Value = atoi(value.decode_string().c_str());
+        } else {
+            a_Value = value.as_int();
+        }
+        return true;
+    }
+
+    void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
+    {
+        log_header(a_Design, "Executing QL_BRAM_TYPES pass.\n");
+
+        size_t argidx;
+        for (argidx = 1; argidx < a_Args.size(); argidx++) {
+            break;
+        }
+        extra_args(a_Args, argidx, a_Design);
+
+        buildTypes();
+
+        const RTLIL::IdString tdp36kType = ID(TDP36K);
+        const RTLIL::IdString isInferredAttr = ID(is_inferred);
+        const RTLIL::IdString isFifoAttr = ID(is_fifo);
+        const RTLIL::IdString syncFifoAttr = ID(sync_fifo);
+        const RTLIL::IdString isSplitAttr = ID(is_split);
+        const RTLIL::IdString wrDataWidthAttr = ID(wr_data_width);
+        const RTLIL::IdString rdDataWidthAttr = ID(rd_data_width);
+
+        int count = 0;
+        for (auto module : a_Design->selected_modules()) {
+            for (auto cell : module->selected_cells()) {
+                if (cell->type != tdp36kType) {
+                    continue;
+                }
+
+                int wrDataWidth, rdDataWidth;
+                if (!getIntAttribute(cell, wrDataWidthAttr, wrDataWidth) || !getIntAttribute(cell, rdDataWidthAttr, rdDataWidth)) {
+                    continue;
+                }
+
+                auto isSet = [&](const RTLIL::IdString &a_Name, int a_Value) {
+                    int value;
+                    return getIntAttribute(cell, a_Name, value) && value == a_Value;
+                };
+
+                // Determine the kind. An inferred BRAM takes precedence over
+                // a FIFO.
+                Kind kind;
+                if (isSet(isInferredAttr, 1)) {
+                    kind = Kind::BRAM;
+                } else if (isSet(isFifoAttr, 1) && isSet(syncFifoAttr, 0)) {
+                    kind = Kind::FIFO_ASYNC;
+                } else if (isSet(isFifoAttr, 1) && isSet(syncFifoAttr, 1)) {
+                    kind = Kind::FIFO_SYNC;
+                } else {
+                    continue;
+                }
+
+                // Use the split type if possible, fall back to the non-split
+                // one for widths that do not fit a half of the BRAM.
+                auto it = m_Types.end();
+                if (isSet(isSplitAttr, 1)) {
+                    it = m_Types.find(std::make_tuple(true, (int)kind, wrDataWidth, rdDataWidth));
+                }
+                if (it == m_Types.end()) {
+                    it = m_Types.find(std::make_tuple(false, (int)kind, wrDataWidth, rdDataWidth));
+                }
+                if (it == m_Types.end()) {
+                    continue;
+                }
+
+                log_debug(" %s (%s) -> %s\n", log_id(cell), log_id(module), log_id(it->second));
+                cell->type = it->second;
+                count++;
+            }
+        }
+
+        log("Specialized %d TDP36K cell(s).\n", count);
+    }
+
+} QlBramTypesPass;
+
+PRIVATE_NAMESPACE_END
@@ -0,0 +1,849 @@
+/*
+ * Copyright 2020-2022 F4PGA Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+
+#include "kernel/log.h"
+#include "kernel/register.h"
+#include "kernel/rtlil.h"
+#include "kernel/sigtools.h"
+
+#include "../common/affinity.h"
+#include "../common/hierarchy.h"
+
+USING_YOSYS_NAMESPACE
+PRIVATE_NAMESPACE_BEGIN
+
+#define MODE_BITS_BASE_SIZE 80
+#define MODE_BITS_EXTENSION_SIZE 13
+#define MODE_BITS_REGISTER_INPUTS_ID 92
+#define MODE_BITS_OUTPUT_SELECT_START_ID 81
+#define MODE_BITS_OUTPUT_SELECT_WIDTH 3
+
+// ============================================================================
+
+/// Packs and finalizes QuickLogic k6n10f DSP cells. The packer indexes the
+/// DSP cells and the signals of a module once and then runs SIMD pairing,
+/// mapping to QL_DSP2/QL_DSP3 and IO register classification on that shared
+/// state. The ql_dsp_simd and ql_dsp_io_regs passes run single steps of it.
+struct QlDspPacker {
+
+    /// Kinds of DSP cells handled by the packer
+    enum class Kind { SISD_10X9, SISD_20X18, FINAL };
+
+    /// Describes a DSP cell type
+    struct CellType {
+        Kind kind;
+        bool use_cfg_params;
+    };
+
+    /// Describes DSP config unique to a whole DSP cell
+    struct DspConfig {
+
+        // Port connections
+        dict<RTLIL::IdString, RTLIL::SigSpec> connections;
+
+        // Whether DSPs pass configuration bits through ports of parameters
+        bool use_cfg_params;
+
+        DspConfig() = default;
+
+        DspConfig(const DspConfig &ref) = default;
+        DspConfig(DspConfig &&ref) = default;
+
+        unsigned int hash() const { return connections.hash(); }
+
+        bool operator==(const DspConfig &ref) const { return connections == ref.connections && use_cfg_params == ref.use_cfg_params; }
+    };
+
+    // ..........................................
+
+    /// Handled cell types
+    dict<RTLIL::IdString, CellType> m_Types;
+
+    // Target DSP cell types
+    const RTLIL::IdString m_DspType_cfg_ports = RTLIL::escape_id("QL_DSP2");
+    const RTLIL::IdString m_DspType_cfg_params = RTLIL::escape_id("QL_DSP3");
+
+    // DSP control and config ports to consider and how to map them to ports
+    // of the target DSP cell
+    std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> m_DspCfgPorts;
+    // For QL_DSP2 expand with configuration ports
+    std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> m_DspCfgPorts_expand;
+    // For QL_DSP3 use parameters instead
+    std::vector<RTLIL::IdString> m_DspParams2Mode;
+    // DSP data ports and how to map them to ports of the target DSP cell
+    std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> m_DspDataPorts;
+    // Widths and directions of the data ports of the target DSP cell
+    const std::vector<int> m_DspDataWidths = {20, 18, 6, 38, 18};
+    const std::vector<bool> m_DspDataOutputs = {false, false, false, true, true};
+    // DSP parameters
+    std::vector<RTLIL::IdString> m_DspParams;
+
+    // Ports removed by the IO register classification
+    std::vector<RTLIL::IdString> m_Ports2del_mult;
+    std::vector<RTLIL::IdString> m_Ports2del_mult_acc;
+    std::vector<RTLIL::IdString> m_Ports2del_mult_add;
+    std::vector<RTLIL::IdString> m_Ports2del_extension;
+
+    const RTLIL::IdString m_IsInferred = RTLIL::escape_id("is_inferred");
+    const RTLIL::IdString m_ModeBits = RTLIL::escape_id("MODE_BITS");
+    const RTLIL::IdString m_FMode = RTLIL::escape_id("f_mode");
+    const RTLIL::IdString m_Clk = RTLIL::escape_id("clk");
+    const RTLIL::IdString m_Feedback = RTLIL::escape_id("feedback");
+    const RTLIL::IdString m_RegisterInputs = RTLIL::escape_id("register_inputs");
+    const RTLIL::IdString m_OutputSelect = RTLIL::escape_id("output_select");
+    const RTLIL::IdString m_OperandPortA = RTLIL::escape_id("a_i");
+    const RTLIL::IdString m_OperandPortB = RTLIL::escape_id("b_i");
+    const RTLIL::IdString m_OutputPort = RTLIL::escape_id("z_o");
+
+    // Affinity score weights for SIMD pairing: per shared operand bit, per
+    // shared consumer cell and per shared hierarchy level, and the number
+    // of cells each cell is linked to per key.
+    const int m_AffinityOperandBit = 1;
+    const int m_AffinityConsumer = 4;
+    const int m_AffinityHierLevel = 2;
+    const size_t m_AffinityMaxNeighbors = 8;
+
+    /// Per-module state shared by all the steps
+    RTLIL::Module *m_Module = nullptr;
+    SigMap m_SigMap;
+    std::vector<RTLIL::Cell *> m_SisdCells;
+    std::vector<RTLIL::Cell *> m_FinalCells;
+    int m_SimdCount = 0;
+
+    // ..........................................
+
+    QlDspPacker()
+    {
+        auto ids = [](const std::vector<std::pair<std::string, std::string>> &a_Names) {
+            std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> result;
+            for (const auto &it : a_Names) {
+                result.push_back(std::make_pair(RTLIL::escape_id(it.first), RTLIL::escape_id(it.second)));
+            }
+            return result;
+        };
+
+        auto idList = [](const std::vector<std::string> &a_Names) {
+            std::vector<RTLIL::IdString> result;
+            for (const auto &it : a_Names) {
+                result.push_back(RTLIL::escape_id(it));
+            }
+            return result;
+        };
+
+        m_Types[RTLIL::escape_id("dsp_t1_10x9x32_cfg_ports")] = {Kind::SISD_10X9, false};
+        m_Types[RTLIL::escape_id("dsp_t1_10x9x32_cfg_params")] = {Kind::SISD_10X9, true};
+        m_Types[RTLIL::escape_id("dsp_t1_20x18x64_cfg_ports")] = {Kind::SISD_20X18, false};
+        m_Types[RTLIL::escape_id("dsp_t1_20x18x64_cfg_params")] = {Kind::SISD_20X18, true};
+        m_Types[m_DspType_cfg_ports] = {Kind::FINAL, false};
+        m_Types[m_DspType_cfg_params] = {Kind::FINAL, true};
+
+        m_DspCfgPorts = ids({{"clock_i", "clk"},
+                             {"reset_i", "reset"},
+                             {"feedback_i", "feedback"},
+                             {"load_acc_i", "load_acc"},
+                             {"unsigned_a_i", "unsigned_a"},
+                             {"unsigned_b_i", "unsigned_b"},
+                             {"subtract_i", "subtract"}});
+        m_DspCfgPorts_expand = ids({{"output_select_i", "output_select"},
+                                    {"saturate_enable_i", "saturate_enable"},
+                                    {"shift_right_i", "shift_right"},
+                                    {"round_i", "round"},
+                                    {"register_inputs_i", "register_inputs"}});
+        m_DspParams2Mode = idList({"OUTPUT_SELECT", "SATURATE_ENABLE", "SHIFT_RIGHT", "ROUND", "REGISTER_INPUTS"});
+        m_DspDataPorts = ids({{"a_i", "a"}, {"b_i", "b"}, {"acc_fir_i", "acc_fir"}, {"z_o", "z"}, {"dly_b_o", "dly_b"}});
+        m_DspParams = idList({"COEFF_3", "COEFF_2", "COEFF_1", "COEFF_0"});
+
+        m_Ports2del_mult = idList({"load_acc", "subtract", "acc_fir", "dly_b"});
+        m_Ports2del_mult_acc = idList({"acc_fir", "dly_b"});
+        m_Ports2del_mult_add = idList({"dly_b"});
+        m_Ports2del_extension = idList({"saturate_enable", "shift_right", "round"});
+    }
+
+    /// Sets up the SigMap and collects the DSP cells of a module in a single
+    /// scan.
+    void index(RTLIL::Module *a_Module)
+    {
+        m_Module = a_Module;
+        m_SigMap.set(a_Module);
+        m_SisdCells.clear();
+        m_FinalCells.clear();
+        m_SimdCount = 0;
+
+        for (auto cell : a_Module->selected_cells()) {
+            auto it = m_Types.find(cell->type);
+            if (it == m_Types.end()) {
+                continue;
+            }
+            if (it->second.kind == Kind::FINAL) {
+                m_FinalCells.push_back(cell);
+            } else {
+                m_SisdCells.push_back(cell);
+            }
+        }
+    }
+
+    void clear()
+    {
+        m_Module = nullptr;
+        m_SigMap.clear();
+        m_SisdCells.clear();
+        m_FinalCells.clear();
+    }
+
+    // ..........................................
+
+    /// Looks up port width and direction in the cell definition and returns it.
+    /// Returns (0, false) if it cannot be determined.
+    std::pair<size_t, bool> getPortInfo(RTLIL::Cell *a_Cell, RTLIL::IdString a_Port)
+    {
+        if (!a_Cell->known()) {
+            return std::make_pair(0, false);
+        }
+
+        // Get the module defining the cell (the previous condition ensures
+        // that the pointers are valid)
+        RTLIL::Module *mod = a_Cell->module->design->module(a_Cell->type);
+        if (mod == nullptr) {
+            return std::make_pair(0, false);
+        }
+
+        // Get the wire representing the port
+        RTLIL::Wire *wire = mod->wire(a_Port);
+        if (wire == nullptr) {
+            return std::make_pair(0, false);
+        }
+
+        return std::make_pair(wire->width, wire->port_output);
+    }
+
+    /// Returns the control and config ports of a SISD DSP cell and how they
+    /// map to ports of the target DSP cell
+    std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> cfgPorts(bool a_UseCfgParams)
+    {
+        std::vector<std::pair<RTLIL::IdString, RTLIL::IdString>> ports = m_DspCfgPorts;
+        if (!a_UseCfgParams) {
+            ports.insert(ports.end(), m_DspCfgPorts_expand.begin(), m_DspCfgPorts_expand.end());
+        }
+        return ports;
+    }
+
+    /// Given a DSP cell populates and returns a DspConfig struct for it.
+    DspConfig getDspConfig(RTLIL::Cell *a_Cell)
+    {
+        DspConfig config;
+        config.use_cfg_params = m_Types.at(a_Cell->type).use_cfg_params;
+
+        for (const auto &it : cfgPorts(config.use_cfg_params)) {
+            // Port unconnected
+            if (!a_Cell->hasPort(it.first)) {
+                config.connections[it.first] = RTLIL::SigSpec(RTLIL::Sx);
+                continue;
+            }
+
+            // Get the port connection and map it to unique SigBits
+            config.connections[it.first] = m_SigMap(a_Cell->getPort(it.first));
+        }
+
+        return config;
+    }
+
+    /// Returns a parameter of a SISD DSP cell resized to the given width. A
+    /// missing parameter reads as zero.
+    static RTLIL::Const getParam(const RTLIL::Cell *a_Cell, const RTLIL::IdString &a_Name, int a_Width)
+    {
+        RTLIL::Const value = a_Cell->hasParam(a_Name) ? a_Cell->getParam(a_Name) : RTLIL::Const(RTLIL::S0, a_Width);
+        value.bits.resize(a_Width, RTLIL::S0);
+        return value;
+    }
+
+    /// Appends the configuration parameters of a QL_DSP3 cell to its mode
+    /// bits
+    void appendModeParams(const RTLIL::Cell *a_Cell, std::vector<RTLIL::State> &a_ModeBits)
+    {
+        for (const auto &it : m_DspParams2Mode) {
+            auto param = a_Cell->getParam(it);
+            a_ModeBits.insert(a_ModeBits.end(), param.bits.begin(), param.bits.end());
+        }
+    }
+
+    /// Finds the cells that consume the outputs of the given DSP cells.
+    dict<RTLIL::SigBit, std::vector<RTLIL::Cell *>> findConsumers(const pool<RTLIL::Cell *> &a_Cells)
+    {
+        dict<RTLIL::SigBit, std::vector<RTLIL::Cell *>> consumers;
+        for (auto cell : a_Cells) {
+            if (!cell->hasPort(m_OutputPort)) {
+                continue;
+            }
+            for (auto bit : m_SigMap(cell->getPort(m_OutputPort))) {
+                if (bit.wire != nullptr) {
+                    consumers[bit];
+                }
+            }
+        }
+
+        for (auto cell : m_Module->cells()) {
+            for (const auto &conn : cell->connections()) {
+                if (a_Cells.count(cell) && conn.first == m_OutputPort) {
+                    continue;
+                }
+                for (auto bit : m_SigMap(conn.second)) {
+                    auto it = consumers.find(bit);
+                    if (it != consumers.end() && (it->second.empty() || it->second.back() != cell)) {
+                        it->second.push_back(cell);
+                    }
+                }
+            }
+        }
+
+        return consumers;
+    }
+
+    /// Pairs the DSP cells of a group by connectivity affinity: shared
+    /// operand bits, shared consumers and a shared parent hierarchy. Returns
+    /// the pairs with their scores, an odd cell out is appended to
+    /// a_Unpaired.
+    std::vector<std::tuple<RTLIL::Cell *, RTLIL::Cell *, int>> matchGroup(const std::vector<RTLIL::Cell *> &a_Group,
+                                                                          const dict<RTLIL::SigBit, std::vector<RTLIL::Cell *>> &a_Consumers,
+                                                                          std::vector<RTLIL::Cell *> &a_Unpaired)
+    {
+        // Bucket the cells by the keys they have
+        dict<RTLIL::SigBit, std::vector<int>> operandBuckets;
+        dict<RTLIL::Cell *, std::vector<int>> consumerBuckets;
+        dict<std::string, std::vector<int>> hierBuckets;
+
+        auto add = [](std::vector<int> &a_Bucket, int a_Index) {
+            if (a_Bucket.empty() || a_Bucket.back() != a_Index) {
+                a_Bucket.push_back(a_Index);
+            }
+        };
+
+        for (int i = 0; i < (int)a_Group.size(); ++i) {
+            RTLIL::Cell *cell = a_Group[i];
+            for (const auto &port : {m_OperandPortA, m_OperandPortB}) {
+                if (!cell->hasPort(port)) {
+                    continue;
+                }
+                for (auto bit : m_SigMap(cell->getPort(port))) {
+                    if (bit.wire != nullptr) {
+                        add(operandBuckets[bit], i);
+                    }
+                }
+            }
+            if (cell->hasPort(m_OutputPort)) {
+                for (auto bit : m_SigMap(cell->getPort(m_OutputPort))) {
+                    auto it = a_Consumers.find(bit);
+                    if (it != a_Consumers.end()) {
+                        for (auto consumer : it->second) {
+                            add(consumerBuckets[consumer], i);
+                        }
+                    }
+                }
+            }
+            std::string prefix;
+            for (const auto &level : cell_hier_path(cell)) {
+                prefix += level + ".";
+                add(hierBuckets[prefix], i);
+            }
+        }
+
+        // Score the candidate pairs and match them
+        AffinityMatcher matcher(a_Group.size(), m_AffinityMaxNeighbors);
+        for (const auto &it : operandBuckets) {
+            matcher.add_key(it.second, m_AffinityOperandBit);
+        }
+        for (const auto &it : consumerBuckets) {
+            matcher.add_key(it.second, m_AffinityConsumer);
+        }
+        for (const auto &it : hierBuckets) {
+            matcher.add_key(it.second, m_AffinityHierLevel);
+        }
+
+        int unpaired;
+        std::vector<std::tuple<RTLIL::Cell *, RTLIL::Cell *, int>> pairs;
+        for (const auto &pair : matcher.match(unpaired)) {
+            pairs.push_back(std::make_tuple(a_Group[std::get<0>(pair)], a_Group[std::get<1>(pair)], std::get<2>(pair)));
+        }
+        if (unpaired >= 0) {
+            a_Unpaired.push_back(a_Group[unpaired]);
+        }
+
+        return pairs;
+    }
+
+    // ..........................................
+
+    /// Packs pairs of 10x9 DSP cells with identical configuration into SIMD
+    /// DSP cells.
+    void packSimd()
+    {
+        // Assemble DSP cell groups
+        dict<DspConfig, std::vector<RTLIL::Cell *>> groups;
+        pool<RTLIL::Cell *> candidates;
+        std::vector<RTLIL::Cell *> remaining;
+        for (auto cell : m_SisdCells) {
+            if (m_Types.at(cell->type).kind != Kind::SISD_10X9 || cell->has_keep_attr()) {
+                remaining.push_back(cell);
+                continue;
+            }
+            groups[getDspConfig(cell)].push_back(cell);
+            candidates.insert(cell);
+        }
+
+        if (candidates.empty()) {
+            return;
+        }
+
+        // The consumer map of all groups is built once, so cells are removed
+        // only after all groups are packed
+        auto consumers = findConsumers(candidates);
+        std::vector<RTLIL::Cell *> cellsToRemove;
+
+        int affinityPairs = 0;
+        int orderPairs = 0;
+        int totalScore = 0;
+
+        // Map cell pairs to the target DSP SIMD cell
+        for (const auto &it : groups) {
+            const auto &config = it.first;
+            bool use_cfg_params = config.use_cfg_params;
+
+            // Map SIMD pairs
+            for (const auto &pair : matchGroup(it.second, consumers, remaining)) {
+                RTLIL::Cell *dsp_a = std::get<0>(pair);
+                RTLIL::Cell *dsp_b = std::get<1>(pair);
+                int score = std::get<2>(pair);
+
+                if (score > 0) {
+                    affinityPairs++;
+                    totalScore += score;
+                } else {
+                    orderPairs++;
+                }
+
+                RTLIL::IdString name = m_Module->uniquify(RTLIL::escape_id(stringf("simd%d", m_SimdCount++)));
+                RTLIL::IdString type = use_cfg_params ? m_DspType_cfg_params : m_DspType_cfg_ports;
+
+                log(" SIMD: %s (%s) + %s (%s) => %s (%s), affinity %d\n", log_id(dsp_a->name), log_id(dsp_a->type), log_id(dsp_b->name),
+                    log_id(dsp_b->type), log_id(name), log_id(type), score);
+
+                // Create the new cell
+                RTLIL::Cell *simd = m_Module->addCell(name, type);
+
+                // Check if the target cell is known (important to know
+                // its port widths)
+                if (!simd->known()) {
+                    log_error(" The target cell type '%s' is not known!", log_id(type));
+                }
+
+                // Connect common ports
+                for (const auto &port : cfgPorts(use_cfg_params)) {
+                    simd->setPort(port.second, config.connections.at(port.first));
+                }
+
+                // Connect data ports
+                for (const auto &port : m_DspDataPorts) {
+                    size_t width;
+                    bool isOutput;
+
+                    std::tie(width, isOutput) = getPortInfo(simd, port.second);
+
+                    auto getConnection = [&](const RTLIL::Cell *cell) {
+                        RTLIL::SigSpec sigspec;
+                        if (cell->hasPort(port.first)) {
+                            sigspec.append(cell->getPort(port.first));
+                        }
+                        if ((size_t)sigspec.size() < width / 2) {
+                            if (isOutput) {
+                                sigspec.append(m_Module->addWire(NEW_ID, width / 2 - sigspec.size()));
+                            } else {
+                                sigspec.append(RTLIL::SigSpec(RTLIL::Sx, width / 2 - sigspec.size()));
+                            }
+                        }
+                        return sigspec;
+                    };
+
+                    RTLIL::SigSpec sigspec;
+                    sigspec.append(getConnection(dsp_a));
+                    sigspec.append(getConnection(dsp_b));
+                    simd->setPort(port.second, sigspec);
+                }
+
+                // Concatenate FIR coefficient parameters into the single
+                // MODE_BITS parameter
+                std::vector<RTLIL::State> mode_bits;
+                for (const auto &param : m_DspParams) {
+                    auto val_a = dsp_a->getParam(param);
+                    auto val_b = dsp_b->getParam(param);
+
+                    mode_bits.insert(mode_bits.end(), val_a.begin(), val_a.end());
+                    mode_bits.insert(mode_bits.end(), val_b.begin(), val_b.end());
+                }
+                size_t mode_bits_size = MODE_BITS_BASE_SIZE;
+                if (use_cfg_params) {
+                    // Add additional config parameters if necessary
+                    mode_bits.push_back(RTLIL::S1); // MODE_BITS[80] == F_MODE : Enable fractured mode
+                    for (const auto &param : m_DspParams2Mode) {
+                        log_assert(dsp_a->getParam(param) == dsp_b->getParam(param));
+                    }
+                    appendModeParams(dsp_a, mode_bits);
+                    mode_bits_size += MODE_BITS_EXTENSION_SIZE;
+                } else {
+                    // Enable the fractured mode by connecting the control
+                    // port.
+                    simd->setPort(m_FMode, RTLIL::S1);
+                }
+                simd->setParam(m_ModeBits, RTLIL::Const(mode_bits));
+                log_assert(mode_bits.size() == mode_bits_size);
+
+                // Handle the "is_inferred" attribute. If one of the fragments
+                // is not inferred mark the whole DSP as not inferred
+                bool is_inferred_a = dsp_a->has_attribute(m_IsInferred) ? dsp_a->get_bool_attribute(m_IsInferred) : false;
+                bool is_inferred_b = dsp_b->has_attribute(m_IsInferred) ? dsp_b->get_bool_attribute(m_IsInferred) : false;
+
+                simd->set_bool_attribute(m_IsInferred, is_inferred_a && is_inferred_b);
+
+                // Mark DSP parts for removal
+                cellsToRemove.push_back(dsp_a);
+                cellsToRemove.push_back(dsp_b);
+
+                m_FinalCells.push_back(simd);
+            }
+        }
+
+        // Remove old cells
+        for (auto cell : cellsToRemove) {
+            m_Module->remove(cell);
+        }
+
+        m_SisdCells.swap(remaining);
+
+        log("Packed %d SIMD pair(s) in %s: %d by affinity (total score %d), %d in order.\n", affinityPairs + orderPairs, log_id(m_Module),
+            affinityPairs, totalScore, orderPairs);
+    }
+
+    /// Maps the remaining SISD DSP cells to QL_DSP2/QL_DSP3 cells in place.
+    /// This does the same as the dsp_final_map.v techmap file.
+    void mapFinal()
+    {
+        for (auto cell : m_SisdCells) {
+            const auto &type = m_Types.at(cell->type);
+            bool fractured = (type.kind == Kind::SISD_10X9);
+
+            RTLIL::IdString newType = type.use_cfg_params ? m_DspType_cfg_params : m_DspType_cfg_ports;
+            log_debug(" %s (%s) -> %s\n", log_id(cell), log_id(cell->type), log_id(newType));
+
+            // Mode bits. A fractured DSP uses the lower half of each
+            // coefficient.
+            std::vector<RTLIL::State> mode_bits;
+            for (auto it = m_DspParams.rbegin(); it != m_DspParams.rend(); ++it) {
+                auto coeff = getParam(cell, *it, fractured ? 10 : 20);
+                coeff.bits.resize(20, RTLIL::S0);
+                mode_bits.insert(mode_bits.end(), coeff.bits.begin(), coeff.bits.end());
+            }
+            if (type.use_cfg_params) {
+                mode_bits.push_back(fractured ? RTLIL::S1 : RTLIL::S0);
+                const std::vector<int> widths = {3, 1, 6, 1, 1};
+                for (size_t i = 0; i < m_DspParams2Mode.size(); ++i) {
+                    auto param = getParam(cell, m_DspParams2Mode[i], widths[i]);
+                    mode_bits.insert(mode_bits.end(), param.bits.begin(), param.bits.end());
+                }
+            }
+
+            // Port connections
+            dict<RTLIL::IdString, RTLIL::SigSpec> connections;
+            for (const auto &port : cfgPorts(type.use_cfg_params)) {
+                if (cell->hasPort(port.first)) {
+                    connections[port.second] = cell->getPort(port.first);
+                }
+            }
+            for (size_t i = 0; i < m_DspDataPorts.size(); ++i) {
+                const auto &port = m_DspDataPorts[i];
+                if (!cell->hasPort(port.first)) {
+                    continue;
+                }
+                // A fractured DSP uses the lower half of the data ports, pad
+                // inputs with zeros and outputs with unused wires.
+                RTLIL::SigSpec sigspec = cell->getPort(port.first);
+                int padding = m_DspDataWidths[i] - sigspec.size();
+                if (padding > 0) {
+                    if (m_DspDataOutputs[i]) {
+                        sigspec.append(m_Module->addWire(NEW_ID, padding));
+                    } else {
+                        sigspec.append(RTLIL::SigSpec(RTLIL::S0, padding));
+                    }
+                }
+                connections[port.second] = sigspec;
+            }
+            if (!type.use_cfg_params) {
+                connections[m_FMode] = fractured ? RTLIL::S1 : RTLIL::S0;
+            }
+
+            cell->type = newType;
+            cell->parameters.clear();
+            cell->setParam(m_ModeBits, RTLIL::Const(mode_bits));
+            cell->connections_.clear();
+            for (const auto &it : connections) {
+                cell->setPort(it.first, it.second);
+            }
+
+            m_FinalCells.push_back(cell);
+        }
+
+        m_SisdCells.clear();
+    }
+
+    // ..........................................
+
+    // Returns a pair of mask and value describing constant bit connections of
+    // a SigSpec
+    std::pair<uint32_t, uint32_t> get_constant_mask_value(const RTLIL::SigSpec &sigspec)
+    {
+        uint32_t mask = 0L;
+        uint32_t value = 0L;
+
+        auto sigbits = sigspec.bits();
+        for (ssize_t i = (sigbits.size() - 1); i >= 0; --i) {
+            auto other = m_SigMap(sigbits[i]);
+
+            mask <<= 1;
+            value <<= 1;
+
+            // A known constant
+            if (!other.is_wire() && other.data != RTLIL::Sx) {
+                mask |= 0x1;
+                value |= (other.data == RTLIL::S1);
+            }
+        }
+
+        return std::make_pair(mask, value);
+    }
+
+    /// Returns a port of a QL_DSP2/QL_DSP3 cell, errors out if it is missing
+    static const RTLIL::SigSpec &getPort(const RTLIL::Cell *a_Cell, const RTLIL::IdString &a_Port)
+    {
+        if (!a_Cell->hasPort(a_Port)) {
+            log_error("%s port not found!", log_id(a_Port));
+        }
+        return a_Cell->getPort(a_Port);
+    }
+
+    /// Changes types of inferred QL_DSP2/QL_DSP3 cells depending on their
+    /// configuration and removes ports that the specialized types do not
+    /// have.
+    void classifyIoRegs()
+    {
+        for (auto dsp : m_FinalCells) {
+            // If the cell does not have the "is_inferred" attribute set
+            // then don't touch it.
+            if (!dsp->has_attribute(m_IsInferred) || dsp->get_bool_attribute(m_IsInferred) == false) {
+                continue;
+            }
+
+            bool del_clk = true;
+            bool use_dsp_cfg_params = (dsp->type == m_DspType_cfg_params);
+
+            int reg_in_i;
+            int out_sel_i;
+
+            // Get DSP configuration
+            if (use_dsp_cfg_params) {
+                // Read MODE_BITS at correct indexes
+                const auto &mode_bits = dsp->getParam(m_ModeBits);
+                reg_in_i = RTLIL::Const(mode_bits.bits.at(MODE_BITS_REGISTER_INPUTS_ID)).as_int();
+                out_sel_i = mode_bits.extract(MODE_BITS_OUTPUT_SELECT_START_ID, MODE_BITS_OUTPUT_SELECT_WIDTH).as_int();
+            } else {
+                // Read dedicated configuration ports
+                reg_in_i = getPort(dsp, m_RegisterInputs).as_const().as_int();
+                out_sel_i = getPort(dsp, m_OutputSelect).as_const().as_int();
+            }
+
+            // Check if feedback is or can be set to 0 which implies MACC
+            auto feedback_con = get_constant_mask_value(getPort(dsp, m_Feedback));
+            bool have_macc = (feedback_con.second == 0x0);
+
+            // Build new type name
+            std::string new_type = dsp->type.str();
+            new_type += "_MULT";
+
+            bool accumulate = false;
+            switch (out_sel_i) {
+            case 1:
+            case 2:
+            case 3:
+            case 5:
+            case 7:
+                accumulate = true;
+                break;
+            default:
+                break;
+            }
+
+            if (accumulate) {
+                if (have_macc) {
+                    del_clk = false;
+                    new_type += "ACC";
+                } else {
+                    new_type += "ADD";
+                }
+            }
+
+            if (reg_in_i) {
+                del_clk = false;
+                new_type += "_REGIN";
+            }
+
+            if (out_sel_i > 3) {
+                del_clk = false;
+                new_type += "_REGOUT";
+            }
+
+            // Set new type name
+            dsp->type = RTLIL::IdString(new_type);
+
+            std::vector<RTLIL::IdString> ports2del;
+
+            if (del_clk)
+                ports2del.push_back(m_Clk);
+
+            if (!accumulate) {
+                ports2del.insert(ports2del.end(), m_Ports2del_mult.begin(), m_Ports2del_mult.end());
+                // Mark for deleton additional configuration ports
+                if (!use_dsp_cfg_params) {
+                    ports2del.insert(ports2del.end(), m_Ports2del_extension.begin(), m_Ports2del_extension.end());
+                }
+            } else if (have_macc) {
+                ports2del.insert(ports2del.end(), m_Ports2del_mult_acc.begin(), m_Ports2del_mult_acc.end());
+            } else {
+                ports2del.insert(ports2del.end(), m_Ports2del_mult_add.begin(), m_Ports2del_mult_add.end());
+            }
+
+            for (const auto &port : ports2del) {
+                getPort(dsp, port);
+                dsp->connections_.erase(port);
+            }
+        }
+    }
+};
+
+// ============================================================================
+
+struct QlDspPackPass : public Pass {
+
+    QlDspPackPass() : Pass("ql_dsp_pack", "Packs and finalizes QuickLogic k6n10f DSP cells") {}
+
+    void help() override
+    {
+        log("\n");
+        log("    ql_dsp_pack [selection]\n");
+        log("\n");
+        log("    This pass runs the final steps of k6n10f DSP inference on one shared\n");
+        log("    index of the DSP cells of each module:\n");
+        log("\n");
+        log("    - packs pairs of DSP cells with identical configuration into DSP\n");
+        log("      cells that perform SIMD operation, like ql_dsp_simd,\n");
+        log("    - maps the remaining DSP cells to QL_DSP2/QL_DSP3 cells, like the\n");
+        log("      dsp_final_map.v techmap file,\n");
+        log("    - changes the types of the resulting cells depending on their\n");
+        log("      configuration, like ql_dsp_io_regs.\n");
+        log("\n");
+    }
+
+    void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
+    {
+        log_header(a_Design, "Executing QL_DSP_PACK pass.\n");
+
+        // Parse args
+        extra_args(a_Args, 1, a_Design);
+
+        QlDspPacker packer;
+        for (auto module : a_Design->selected_modules()) {
+            packer.index(module);
+            packer.packSimd();
+            packer.mapFinal();
+            packer.classifyIoRegs();
+        }
+        packer.clear();
+    }
+
+} QlDspPackPass;
+
+struct QlDspSimdPass : public Pass {
+
+    QlDspSimdPass() : Pass("ql_dsp_simd", "Infers QuickLogic k6n10f DSP pairs that can operate in SIMD mode") {}
+
+    void help() override
+    {
+        log("\n");
+        log("    ql_dsp_simd [selection]\n");
+        log("\n");
+        log("    This pass identifies k6n10f DSP cells with identical configuration\n");
+        log("    and packs pairs of them together into other DSP cells that can\n");
+        log("    perform SIMD operation.\n");
+    }
+
+    void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
+    {
+        log_header(a_Design, "Executing QL_DSP_SIMD pass.\n");
+
+        // Parse args
+        extra_args(a_Args, 1, a_Design);
+
+        QlDspPacker packer;
+        for (auto module : a_Design->selected_modules()) {
+            packer.index(module);
+            packer.packSimd();
+        }
+        packer.clear();
+    }
+
+} QlDspSimdPass;
+
+struct QlDspIORegs : public Pass {
+
+    QlDspIORegs() : Pass("ql_dsp_io_regs", "Changes types of QL_DSP2/QL_DSP3 depending on their configuration.") {}
+
+    void help() override
+    {
+        log("\n");
+        log("    ql_dsp_io_regs [options] [selection]\n");
+        log("\n");
+        log("Looks for QL_DSP2/QL_DSP3 cells and changes their types depending\n");
+        log("on their configuration.\n");
+    }
+
+    void execute(std::vector<std::string> a_Args, RTLIL::Design *a_Design) override
+    {
+        log_header(a_Design, "Executing QL_DSP_IO_REGS pass.\n");
+
+        size_t argidx;
+        for (argidx = 1; argidx < a_Args.size(); argidx++) {
+            break;
+        }
+        extra_args(a_Args, argidx, a_Design);
+
+        QlDspPacker packer;
+        for (auto module : a_Design->selected_modules()) {
+            packer.index(module);
+            packer.classifyIoRegs();
+        }
+        packer.clear();
+    }
+
+} QlDspIORegs;
+
+PRIVATE_NAMESPACE_END
@@ -25,34 +25,112 @@
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
 #include "kernel/sigtools.h"
+#include <algorithm>
+#include <chrono>
+#include <deque>
 #include <string>
 
+#include "../common/parallel.h"
+
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
 
-#define EDIF_DEF(_id) edif_names(RTLIL::unescape_id(_id), true).c_str()
-#define EDIF_DEFR(_id, _ren, _bl, _br) edif_names(RTLIL::unescape_id(_id), true, _ren, _bl, _br).c_str()
-#define EDIF_REF(_id) edif_names(RTLIL::unescape_id(_id), false).c_str()
+// Collects the EDIF text and hands it over to the output stream in large
+// blocks. Everything is appended directly instead of going through stringf
+// and temporary strings. A buffer without a stream just accumulates text.
+struct EdifBuffer {
+    static const size_t FLUSH_SIZE = 1 << 20;
+
+    std::ostream *f;
+    std::string data;
+
+    EdifBuffer(std::ostream *f = nullptr) : f(f)
+    {
+        if (f != nullptr)
+            data.reserve(FLUSH_SIZE + 4096);
+    }
+    ~EdifBuffer() { flush(); }
+
+    void flush()
+    {
+        if (f == nullptr || data.empty())
+            return;
+        f->write(data.data(), data.size());
+        data.clear();
+    }
+
+    EdifBuffer &operator<<(const std::string &str)
+    {
+        data += str;
+        if (data.size() >= FLUSH_SIZE)
+            flush();
+        return *this;
+    }
+    EdifBuffer &operator<<(const char *str)
+    {
+        data += str;
+        if (data.size() >= FLUSH_SIZE)
+            flush();
+        return *this;
+    }
+    EdifBuffer &operator<<(char c)
+    {
+        data += c;
+        return *this;
+    }
+    EdifBuffer &operator<<(int value) { return *this << std::to_string(value); }
+    EdifBuffer &operator<<(unsigned int value) { return *this << std::to_string(value); }
+};
 
 struct EdifNames {
     int counter;
     char delim_left, delim_right;
-    std::set<std::string> generated_names, used_names;
-    std::map<std::string, std::string> name_map;
+    pool<std::string> generated_names, used_names;
+    dict<std::string, std::string> name_map;
+
+    // Interned references and definitions of RTLIL identifiers, indexed by
+    // the IdString index. The strings live in a deque so that references
+    // handed out stay valid as names are added. Looking up a name that is
+    // already interned only reads these tables, so the const lookups may be
+    // used from worker threads.
+    std::vector<int> ref_slots, def_slots;
+    std::deque<std::string> interned;
 
     EdifNames() : counter(1), delim_left('['), delim_right(']') {}
 
-    std::string operator()(std::string id, bool define, bool port_rename = false, int range_left = 0, int range_right = 0)
+    const std::string &ref(const RTLIL::IdString &id) { return intern(ref_slots, id, false); }
+    const std::string &def(const RTLIL::IdString &id) { return intern(def_slots, id, true); }
+    const std::string &ref(const RTLIL::IdString &id) const { return interned.at(ref_slots.at(id.index_)); }
+    const std::string &def(const RTLIL::IdString &id) const { return interned.at(def_slots.at(id.index_)); }
+
+    const std::string &intern(std::vector<int> &slots, const RTLIL::IdString &id, bool define)
     {
-        if (define) {
-            std::string new_id = operator()(id, false);
-            if (port_rename)
-                return stringf("(rename %s \"%s%c%d:%d%c\")", new_id.c_str(), id.c_str(), delim_left, range_left, range_right, delim_right);
-            return new_id != id ? stringf("(rename %s \"%s\")", new_id.c_str(), id.c_str()) : id;
+        if (id.index_ >= GetSize(slots))
+            slots.resize(id.index_ + 1, -1);
+        if (slots[id.index_] < 0) {
+            interned.push_back(operator()(RTLIL::unescape_id(id.str()), define));
+            slots[id.index_] = GetSize(interned) - 1;
         }
+        return interned.at(slots[id.index_]);
+    }
 
-        if (name_map.count(id) > 0)
-            return name_map.at(id);
+    // Returns the definition of the identifier id that is referenced as new_id
+    std::string definition(const std::string &id, const std::string &new_id, bool port_rename = false, int range_left = 0,
+                           int range_right = 0) const
+    {
+        if (port_rename)
+            return stringf("(rename %s \"%s%c%d:%d%c\")", new_id.c_str(), id.c_str(), delim_left, range_left, range_right, delim_right);
+        return new_id != id ? stringf("(rename %s \"%s\")", new_id.c_str(), id.c_str()) : id;
+    }
+
+    std::string operator()(std::string id, bool define, bool port_rename = false, int range_left = 0, int range_right = 0)
+    {
+        if (define)
+            return definition(id, operator()(id, false), port_rename, range_left, range_right);
+
+        auto it = name_map.find(id);
+        if (it != name_map.end())
+            return it->second;
         if (generated_names.count(id) > 0)
             goto do_rename;
         if (id == "GND" || id == "VCC")
@@ -86,6 +164,470 @@ struct EdifNames {
     }
 };
 
+// A port reference joined to a net. The text is only rendered when the net
+// is written, using the interned names of the port and the instance.
+//
+// Multi-bit ports of library cells are declared as one port per bit, named
+// <port>_<bit>_. Multi-bit ports of the design modules are declared as EDIF
+// arrays and referenced as (member <port> <index>), index 0 being the
+// leftmost bit.
+struct EdifRef {
+    const RTLIL::IdString *port;
+    const RTLIL::IdString *instance; // nullptr for ports of the module itself
+    int member;                      // -1 for single bit ports
+    bool array;                      // member of an array port
+    bool output;
+};
+
+static void write_ref(EdifBuffer &out, const EdifNames &edif_names, const EdifRef &ref)
+{
+    if (ref.array)
+        out << "(portRef (member " << edif_names.ref(*ref.port) << ' ' << ref.member << ')';
+    else if (ref.member >= 0)
+        out << "(portRef " << edif_names.ref(*ref.port) << '_' << ref.member << '_';
+    else
+        out << "(portRef " << edif_names.ref(*ref.port);
+    if (ref.instance != nullptr)
+        out << " (instanceRef " << edif_names.ref(*ref.instance) << ')';
+    out << ')';
+}
+
+static std::string ref_str(const EdifNames &edif_names, const EdifRef &ref)
+{
+    EdifBuffer out;
+    write_ref(out, edif_names, ref);
+    return out.data;
+}
+
+// Returns the name of the net of a wire bit: the wire name with spaces and
+// backslashes removed followed by the bit index as declared in the source,
+// using the port vector delimiters.
+static std::string net_name(const EdifNames &edif_names, const RTLIL::SigBit &bit)
+{
+    const RTLIL::Wire *wire = bit.wire;
+    std::string name;
+    for (char c : wire->name.str())
+        if (c != ' ' && c != '\\')
+            name += c;
+    if (wire->width != 1) {
+        int index = wire->upto ? wire->start_offset + wire->width - bit.offset - 1 : wire->start_offset + bit.offset;
+        name += edif_names.delim_left + std::to_string(index) + edif_names.delim_right;
+    }
+    return name;
+}
+
+static void write_prop(EdifBuffer &out, const EdifNames &edif_names, const RTLIL::IdString &name, const RTLIL::Const &val, int lut_in = -1)
+{
+    out << "\n            (property " << edif_names.def(name);
+    if ((val.flags & RTLIL::CONST_FLAG_STRING) != 0) {
+        out << " (string \"" << val.decode_string() << "\"))";
+    } else if (val.bits.size() <= 32 && RTLIL::SigSpec(val).is_fully_def()) {
+        if (lut_in >= 0 && strstr(name.c_str(), "INIT")) {
+            int hex_code_width = ((1 << lut_in) / 4);
+            out << " (string \"" << stringf("%0*X", hex_code_width, val.as_int()) << "\"))";
+        } else {
+            out << " (integer " << (unsigned int)val.as_int() << "))";
+        }
+    } else {
+        std::string hex_string;
+        for (size_t i = 0; i < val.bits.size(); i += 4) {
+            int digit_value = 0;
+            for (size_t j = 0; j < 4; j++)
+                if (i + j < val.bits.size() && val.bits.at(i + j) == RTLIL::State::S1)
+                    digit_value |= 1 << j;
+            hex_string += "0123456789abcdef"[digit_value];
+        }
+        std::reverse(hex_string.begin(), hex_string.end());
+        out << " (string \"" << GetSize(val.bits) << "'h" << hex_string << "\"))";
+    }
+}
+
+// Orders the modules so that every module comes after the modules it
+// instantiates. This is Kahn's algorithm, linear in the number of modules
+// and distinct module instantiations.
+static std::vector<RTLIL::Module *> sort_modules(RTLIL::Design *design)
+{
+    dict<RTLIL::Module *, int> pending;
+    dict<RTLIL::Module *, std::vector<RTLIL::Module *>> users;
+    for (auto module : design->modules()) {
+        pool<RTLIL::Module *> deps;
+        for (auto cell : module->cells()) {
+            auto dep = design->module(cell->type);
+            if (dep != nullptr && deps.insert(dep).second)
+                users[dep].push_back(module);
+        }
+        pending[module] = GetSize(deps);
+    }
+
+    std::vector<RTLIL::Module *> sorted_modules;
+    for (auto module : design->modules())
+        if (pending.at(module) == 0)
+            sorted_modules.push_back(module);
+
+    for (size_t i = 0; i < sorted_modules.size(); i++) {
+        auto it = users.find(sorted_modules[i]);
+        if (it == users.end())
+            continue;
+        for (auto user : it->second)
+            if (--pending.at(user) == 0)
+                sorted_modules.push_back(user);
+    }
+
+    if (GetSize(sorted_modules) != GetSize(pending))
+        for (auto &it : pending)
+            if (it.second > 0)
+                log_error("Cyclic dependency between modules found! Cycle includes module %s.\n", log_id(it.first->name));
+
+    return sorted_modules;
+}
+
+// A module prepared for writing. Nets are collected and all names are
+// resolved serially, after that the EDIF cell of the module can be rendered
+// without touching any shared state.
+struct EdifModule {
+    struct KeepNet {
+        RTLIL::SigBit bit;
+        int net;
+        std::string name;
+    };
+
+    RTLIL::Module *module = nullptr;
+    std::vector<RTLIL::SigBit> net_bits;
+    std::vector<std::vector<EdifRef>> net_refs;
+    std::vector<std::string> net_names; // definitions, empty for nets that are not written
+    std::vector<KeepNet> keep_nets;
+};
+
+struct EdifWriter {
+    RTLIL::Design *design;
+    EdifNames edif_names;
+    std::map<RTLIL::IdString, std::map<RTLIL::IdString, int>> lib_cell_ports;
+    bool port_rename = false;
+    bool attr_properties = false;
+    bool nogndvcc = false, gndvccy = false, keepmode = false;
+
+    EdifWriter(RTLIL::Design *design) : design(design) {}
+
+    void intern_props(const dict<RTLIL::IdString, RTLIL::Const> &props)
+    {
+        for (auto &p : props)
+            edif_names.def(p.first);
+    }
+
+    // Collects the nets of the module and interns every name its EDIF cell
+    // uses, in the order the cell refers to them.
+    void collect(EdifModule &em, RTLIL::Module *module)
+    {
+        em.module = module;
+
+        SigMap sigmap(module);
+
+        // Nets are numbered in the order they are first referenced, each
+        // one collects the port references joined to it.
+        dict<RTLIL::SigBit, int> net_index;
+        auto add_ref = [&](const RTLIL::SigBit &bit, const EdifRef &ref) {
+            auto it = net_index.find(bit);
+            int index;
+            if (it == net_index.end()) {
+                index = GetSize(em.net_bits);
+                net_index[bit] = index;
+                em.net_bits.push_back(bit);
+                em.net_refs.emplace_back();
+            } else {
+                index = it->second;
+            }
+            em.net_refs[index].push_back(ref);
+        };
+
+        edif_names.def(module->name);
+
+        for (auto cell : module->cells()) {
+            for (auto &conn : cell->connections())
+                if (cell->output(conn.first))
+                    sigmap.add(conn.second);
+        }
+
+        for (auto wire : module->wires())
+            for (auto b1 : SigSpec(wire)) {
+                auto b2 = sigmap(b1);
+
+                if (b1 == b2 || !b2.wire)
+                    continue;
+
+                log_assert(b1.wire != nullptr);
+
+                Wire *w1 = b1.wire;
+                Wire *w2 = b2.wire;
+
+                {
+                    int c1 = w1->get_bool_attribute(ID::keep);
+                    int c2 = w2->get_bool_attribute(ID::keep);
+
+                    if (c1 > c2)
+                        goto promote;
+                    if (c1 < c2)
+                        goto nopromote;
+                }
+
+                {
+                    int c1 = w1->name.isPublic();
+                    int c2 = w2->name.isPublic();
+
+                    if (c1 > c2)
+                        goto promote;
+                    if (c1 < c2)
+                        goto nopromote;
+                }
+
+                {
+                    auto count_nontrivial_attr = [](Wire *w) {
+                        int count = w->attributes.size();
+                        count -= w->attributes.count(ID::src);
+                        count -= w->attributes.count(ID::unused_bits);
+                        return count;
+                    };
+
+                    int c1 = count_nontrivial_attr(w1);
+                    int c2 = count_nontrivial_attr(w2);
+
+                    if (c1 > c2)
+                        goto promote;
+                    if (c1 < c2)
+                        goto nopromote;
+                }
+
+                {
+                    int c1 = w1->port_id ? INT_MAX - w1->port_id : 0;
+                    int c2 = w2->port_id ? INT_MAX - w2->port_id : 0;
+
+                    if (c1 > c2)
+                        goto promote;
+                    if (c1 < c2)
+                        goto nopromote;
+                }
+
+            nopromote:
+                if (0)
+                promote:
+                    sigmap.add(b1);
+            }
+
+        for (auto wire : module->wires()) {
+            if (wire->port_id == 0)
+                continue;
+            edif_names.ref(wire->name);
+            if (wire->width == 1) {
+                edif_names.def(wire->name);
+                if (attr_properties)
+                    intern_props(wire->attributes);
+                add_ref(sigmap(RTLIL::SigBit(wire)), {&wire->name, nullptr, -1, false, wire->port_input});
+            } else {
+                if (attr_properties)
+                    intern_props(wire->attributes);
+                for (int i = 0; i < wire->width; i++)
+                    add_ref(sigmap(RTLIL::SigBit(wire, i)), {&wire->name, nullptr, GetSize(wire) - i - 1, true, wire->port_input});
+            }
+        }
+
+        for (auto cell : module->cells()) {
+            edif_names.def(cell->name);
+            edif_names.ref(cell->type);
+            intern_props(cell->parameters);
+            if (attr_properties)
+                intern_props(cell->attributes);
+
+            edif_names.ref(cell->name);
+            for (auto &p : cell->connections()) {
+                RTLIL::SigSpec sig = sigmap(p.second);
+                bool output = cell->output(p.first);
+                edif_names.ref(p.first);
+
+                // The width of a port of a known module comes from its wire.
+                // Ports of modules written to the design library are arrays.
+                int width = sig.size();
+                bool array = false;
+                auto m = design->module(cell->type);
+                if (m) {
+                    auto w = m->wire(p.first);
+                    if (w) {
+                        width = GetSize(w);
+                        array = width > 1 && lib_cell_ports.count(cell->type) == 0;
+                    }
+                }
+
+                for (int i = 0; i < GetSize(sig); i++)
+                    if (sig[i].wire == NULL && sig[i] != RTLIL::State::S0 && sig[i] != RTLIL::State::S1)
+                        log_warning("Bit %d of cell port %s.%s.%s driven by %s will be left unconnected in EDIF output.\n", i, log_id(module),
+                                    log_id(cell), log_id(p.first), log_signal(sig[i]));
+                    else
+                        add_ref(sig[i], {&p.first, &cell->name, width == 1 ? -1 : (array ? width - i - 1 : i), array, output});
+            }
+        }
+
+        em.net_names.resize(em.net_bits.size());
+        for (int index = 0; index < GetSize(em.net_bits); index++) {
+            RTLIL::SigBit &sig = em.net_bits[index];
+            if (sig.wire == NULL && sig != RTLIL::State::S0 && sig != RTLIL::State::S1) {
+                if (sig == RTLIL::State::Sx) {
+                    for (auto &ref : em.net_refs[index])
+                        log_warning("Exporting x-bit on %s as zero bit.\n", ref_str(edif_names, ref).c_str());
+                    sig = RTLIL::State::S0;
+                } else if (sig == RTLIL::State::Sz) {
+                    continue;
+                } else {
+                    for (auto &ref : em.net_refs[index])
+                        log_error("Don't know how to handle %s on %s.\n", log_signal(sig), ref_str(edif_names, ref).c_str());
+                    log_abort();
+                }
+            }
+            std::string netname;
+            if (sig == RTLIL::State::S0)
+                netname = "GND_NET";
+            else if (sig == RTLIL::State::S1)
+                netname = "VCC_NET";
+            else
+                netname = net_name(edif_names, sig);
+            em.net_names[index] = edif_names(netname, true);
+            if (sig.wire == NULL && nogndvcc)
+                log_error("Design contains constant nodes (map with \"hilomap\" first).\n");
+            if (attr_properties && sig.wire != NULL)
+                intern_props(sig.wire->attributes);
+        }
+
+        for (auto wire : module->wires()) {
+            if (!wire->get_bool_attribute(ID::keep))
+                continue;
+
+            for (int i = 0; i < wire->width; i++) {
+                SigBit raw_sig = RTLIL::SigSpec(wire, i);
+                SigBit mapped_sig = sigmap(raw_sig);
+
+                auto it = net_index.find(mapped_sig);
+                if (raw_sig == mapped_sig || it == net_index.end())
+                    continue;
+
+                std::string netname = edif_names(net_name(edif_names, raw_sig), true);
+
+                if (keepmode) {
+                    em.keep_nets.push_back({raw_sig, it->second, netname});
+                    if (attr_properties && raw_sig.wire != NULL)
+                        intern_props(raw_sig.wire->attributes);
+                } else {
+                    log_warning("Ignoring conflicting 'keep' property on net %s. Use -keep to generate the extra net nevertheless.\n",
+                                netname.c_str());
+                }
+            }
+        }
+    }
+
+    // Renders the EDIF cell of a collected module. Only reads the module and
+    // the interned names, so modules can be rendered concurrently.
+    void render(const EdifModule &em, EdifBuffer &out) const
+    {
+        const RTLIL::Module *module = em.module;
+
+        out << "    (cell " << edif_names.def(module->name) << "\n";
+        out << "      (cellType GENERIC)\n";
+        out << "      (view VIEW_NETLIST\n";
+        out << "        (viewType NETLIST)\n";
+        out << "        (interface\n";
+
+        for (auto wire : module->wires()) {
+            if (wire->port_id == 0)
+                continue;
+            const char *dir = "INOUT";
+            if (!wire->port_output)
+                dir = "INPUT";
+            else if (!wire->port_input)
+                dir = "OUTPUT";
+            if (wire->width == 1) {
+                out << "          (port " << edif_names.def(wire->name) << " (direction " << dir << ")";
+            } else {
+                int b[2];
+                b[wire->upto ? 0 : 1] = wire->start_offset;
+                b[wire->upto ? 1 : 0] = wire->start_offset + GetSize(wire) - 1;
+                std::string name = edif_names.definition(RTLIL::unescape_id(wire->name.str()), edif_names.ref(wire->name), port_rename, b[0], b[1]);
+                out << "          (port (array " << name << ' ' << wire->width << ") (direction " << dir << ")";
+            }
+            if (attr_properties)
+                for (auto &p : wire->attributes)
+                    write_prop(out, edif_names, p.first, p.second);
+            out << ")\n";
+        }
+
+        out << "        )\n";
+        out << "        (contents\n";
+
+        if (!nogndvcc) {
+            out << "          (instance GND (viewRef VIEW_NETLIST (cellRef GND (libraryRef LIB))))\n";
+            out << "          (instance VCC (viewRef VIEW_NETLIST (cellRef VCC (libraryRef LIB))))\n";
+        }
+
+        for (auto cell : module->cells()) {
+            out << "          (instance " << edif_names.def(cell->name) << "\n";
+            out << "            (viewRef VIEW_NETLIST (cellRef " << edif_names.ref(cell->type)
+                << (lib_cell_ports.count(cell->type) > 0 ? " (libraryRef LIB)" : "") << ")";
+            const char *lut_pos;
+            lut_pos = strstr(cell->type.c_str(), "LUT");
+            if (lut_pos) {
+                int lut_in = atoi(lut_pos + 3); // get the number of LUT inputs
+                for (auto &p : cell->parameters)
+                    write_prop(out, edif_names, p.first, p.second, lut_in);
+                if (attr_properties)
+                    for (auto &p : cell->attributes)
+                        write_prop(out, edif_names, p.first, p.second, lut_in);
+            } else {
+                for (auto &p : cell->parameters)
+                    write_prop(out, edif_names, p.first, p.second);
+                if (attr_properties)
+                    for (auto &p : cell->attributes)
+                        write_prop(out, edif_names, p.first, p.second);
+            }
+            out << ")\n";
+        }
+
+        for (int index = 0; index < GetSize(em.net_bits); index++) {
+            if (em.net_names[index].empty())
+                continue;
+            const RTLIL::SigBit &sig = em.net_bits[index];
+            out << "          (net " << em.net_names[index] << " (joined\n";
+            for (auto &ref : em.net_refs[index]) {
+                out << "              ";
+                write_ref(out, edif_names, ref);
+                out << "\n";
+            }
+            if (sig == RTLIL::State::S0)
+                out << "            (portRef " << (gndvccy ? 'Y' : 'G') << " (instanceRef GND))\n";
+            if (sig == RTLIL::State::S1)
+                out << "            (portRef " << (gndvccy ? 'Y' : 'P') << " (instanceRef VCC))\n";
+            out << "            )";
+            if (attr_properties && sig.wire != NULL)
+                for (auto &p : sig.wire->attributes)
+                    write_prop(out, edif_names, p.first, p.second);
+            out << "\n          )\n";
+        }
+
+        for (auto &keep_net : em.keep_nets) {
+            out << "          (net " << keep_net.name << " (joined\n";
+            for (auto &ref : em.net_refs[keep_net.net])
+                if (ref.output) {
+                    out << "              ";
+                    write_ref(out, edif_names, ref);
+                    out << "\n";
+                }
+            out << "            )";
+            if (attr_properties)
+                for (auto &p : keep_net.bit.wire->attributes)
+                    write_prop(out, edif_names, p.first, p.second);
+            out << "\n          )\n";
+        }
+
+        out << "        )\n";
+        out << "      )\n";
+        out << "    )\n";
+    }
+};
+
 struct QLEdifBackend : public Backend {
     QLEdifBackend() : Backend("ql_edif", "write design to EDIF netlist file") {}
     void help() override
@@ -118,6 +660,11 @@ struct QLEdifBackend : public Backend {
         log("        sets the delimiting character for module port rename clauses to\n");
         log("        parentheses, square brackets, or angle brackets.\n");
         log("\n");
+        log("    -threads <N>\n");
+        log("        number of threads used to render modules concurrently. (defaults to\n");
+        log("        the number of available cores, the output is the same for any\n");
+        log("        number of threads)\n");
+        log("\n");
         log("Unfortunately there are different \"flavors\" of the EDIF file format. This\n");
         log("command generates EDIF files for the Xilinx place&route tools. It might be\n");
         log("necessary to make small modifications to this command when a different tool\n");
@@ -128,12 +675,11 @@ struct QLEdifBackend : public Backend {
     {
         log_header(design, "Executing QL EDIF backend.\n");
         std::string top_module_name;
-        bool port_rename = false;
-        bool attr_properties = false;
-        std::map<RTLIL::IdString, std::map<RTLIL::IdString, int>> lib_cell_ports;
-        bool nogndvcc = false, gndvccy = false, keepmode = false;
+        int num_threads = default_thread_count();
         CellTypes ct(design);
-        EdifNames edif_names;
+        EdifWriter writer(design);
+        EdifNames &edif_names = writer.edif_names;
+        auto &lib_cell_ports = writer.lib_cell_ports;
 
         size_t argidx;
         for (argidx = 1; argidx < args.size(); argidx++) {
@@ -142,24 +688,24 @@ struct QLEdifBackend : public Backend {
                 continue;
             }
             if (args[argidx] == "-nogndvcc") {
-                nogndvcc = true;
+                writer.nogndvcc = true;
                 continue;
             }
             if (args[argidx] == "-gndvccy") {
-                gndvccy = true;
+                writer.gndvccy = true;
                 continue;
             }
             if (args[argidx] == "-attrprop") {
-                attr_properties = true;
+                writer.attr_properties = true;
                 continue;
             }
             if (args[argidx] == "-keep") {
-                keepmode = true;
+                writer.keepmode = true;
                 continue;
             }
             if (args[argidx] == "-pvector" && argidx + 1 < args.size()) {
                 std::string parray;
-                port_rename = true;
+                writer.port_rename = true;
                 parray = args[++argidx];
                 if (parray == "par") {
                     edif_names.delim_left = '(';
@@ -173,6 +719,10 @@ struct QLEdifBackend : public Backend {
                 }
                 continue;
             }
+            if (args[argidx] == "-threads" && argidx + 1 < args.size()) {
+                num_threads = std::max(1, atoi(args[++argidx].c_str()));
+                continue;
+            }
             break;
         }
         extra_args(f, filename, args, argidx);
@@ -206,40 +756,44 @@ struct QLEdifBackend : public Backend {
         if (top_module_name.empty())
             log_error("No module found in design!\n");
 
-        *f << stringf("(edif %s\n", EDIF_DEF(top_module_name));
-        *f << stringf("  (edifVersion 2 0 0)\n");
-        *f << stringf("  (edifLevel 0)\n");
-        *f << stringf("  (keywordMap (keywordLevel 0))\n");
-        *f << stringf("  (comment \"Generated by %s\")\n", yosys_version_str);
-
-        *f << stringf("  (external LIB\n");
-        *f << stringf("    (edifLevel 0)\n");
-        *f << stringf("    (technology (numberDefinition))\n");
-
-        if (!nogndvcc) {
-            *f << stringf("    (cell GND\n");
-            *f << stringf("      (cellType GENERIC)\n");
-            *f << stringf("      (view VIEW_NETLIST\n");
-            *f << stringf("        (viewType NETLIST)\n");
-            *f << stringf("        (interface (port %c (direction OUTPUT)))\n", gndvccy ? 'Y' : 'G');
-            *f << stringf("      )\n");
-            *f << stringf("    )\n");
-
-            *f << stringf("    (cell VCC\n");
-            *f << stringf("      (cellType GENERIC)\n");
-            *f << stringf("      (view VIEW_NETLIST\n");
-            *f << stringf("        (viewType NETLIST)\n");
-            *f << stringf("        (interface (port %c (direction OUTPUT)))\n", gndvccy ? 'Y' : 'P');
-            *f << stringf("      )\n");
-            *f << stringf("    )\n");
+        auto start_time = std::chrono::steady_clock::now();
+        EdifBuffer out(f);
+        int cell_count = 0;
+
+        out << "(edif " << edif_names(RTLIL::unescape_id(top_module_name), true) << "\n";
+        out << "  (edifVersion 2 0 0)\n";
+        out << "  (edifLevel 0)\n";
+        out << "  (keywordMap (keywordLevel 0))\n";
+        out << "  (comment \"Generated by " << yosys_version_str << "\")\n";
+
+        out << "  (external LIB\n";
+        out << "    (edifLevel 0)\n";
+        out << "    (technology (numberDefinition))\n";
+
+        if (!writer.nogndvcc) {
+            out << "    (cell GND\n";
+            out << "      (cellType GENERIC)\n";
+            out << "      (view VIEW_NETLIST\n";
+            out << "        (viewType NETLIST)\n";
+            out << "        (interface (port " << (writer.gndvccy ? 'Y' : 'G') << " (direction OUTPUT)))\n";
+            out << "      )\n";
+            out << "    )\n";
+
+            out << "    (cell VCC\n";
+            out << "      (cellType GENERIC)\n";
+            out << "      (view VIEW_NETLIST\n";
+            out << "        (viewType NETLIST)\n";
+            out << "        (interface (port " << (writer.gndvccy ? 'Y' : 'P') << " (direction OUTPUT)))\n";
+            out << "      )\n";
+            out << "    )\n";
         }
 
         for (auto &cell_it : lib_cell_ports) {
-            *f << stringf("    (cell %s\n", EDIF_DEF(cell_it.first));
-            *f << stringf("      (cellType GENERIC)\n");
-            *f << stringf("      (view VIEW_NETLIST\n");
-            *f << stringf("        (viewType NETLIST)\n");
-            *f << stringf("        (interface\n");
+            out << "    (cell " << edif_names.def(cell_it.first) << "\n";
+            out << "      (cellType GENERIC)\n";
+            out << "      (view VIEW_NETLIST\n";
+            out << "        (viewType NETLIST)\n";
+            out << "        (interface\n";
             for (auto &port_it : cell_it.second) {
                 const char *dir = "INOUT";
                 if (ct.cell_known(cell_it.first)) {
@@ -258,374 +812,65 @@ struct QLEdifBackend : public Backend {
                         start = w->start_offset;
                     }
                 }
+                const std::string &port_name = edif_names.def(port_it.first);
                 if (width == 1)
-                    *f << stringf("          (port %s (direction %s))\n", EDIF_DEF(port_it.first), dir);
+                    out << "          (port " << port_name << " (direction " << dir << "))\n";
                 else {
                     for (int b = start; b < start + width; b++) {
-                        *f << stringf("          (port (rename %s_%d_ \"%s(%d)\") (direction %s))\n", EDIF_DEF(port_it.first), b,
-                                      EDIF_DEF(port_it.first), b, dir);
+                        out << "          (port (rename " << port_name << '_' << b << "_ \"" << port_name << '(' << b << ")\") (direction " << dir
+                            << "))\n";
                     }
                 }
             }
-            *f << stringf("        )\n");
-            *f << stringf("      )\n");
-            *f << stringf("    )\n");
+            out << "        )\n";
+            out << "      )\n";
+            out << "    )\n";
         }
-        *f << stringf("  )\n");
-
-        std::vector<RTLIL::Module *> sorted_modules;
+        out << "  )\n";
 
-        // extract module dependencies
-        std::map<RTLIL::Module *, std::set<RTLIL::Module *>> module_deps;
-        for (auto module : design->modules()) {
-            module_deps[module] = std::set<RTLIL::Module *>();
-            for (auto cell : module->cells())
-                if (design->module(cell->type) != nullptr)
-                    module_deps[module].insert(design->module(cell->type));
-        }
-
-        // simple good-enough topological sort
-        // (O(n*m) on n elements and depth m)
-        while (module_deps.size() > 0) {
-            size_t sorted_modules_idx = sorted_modules.size();
-            for (auto &it : module_deps) {
-                for (auto &dep : it.second)
-                    if (module_deps.count(dep) > 0)
-                        goto not_ready_yet;
-                // log("Next in topological sort: %s\n", log_id(it.first->name));
-                sorted_modules.push_back(it.first);
-            not_ready_yet:;
-            }
-            if (sorted_modules_idx == sorted_modules.size())
-                log_error("Cyclic dependency between modules found! Cycle includes module %s.\n", log_id(module_deps.begin()->first->name));
-            while (sorted_modules_idx < sorted_modules.size())
-                module_deps.erase(sorted_modules.at(sorted_modules_idx++));
-        }
-
-        *f << stringf("  (library DESIGN\n");
-        *f << stringf("    (edifLevel 0)\n");
-        *f << stringf("    (technology (numberDefinition))\n");
-
-        auto add_prop = [&](IdString name, Const val) {
-            if ((val.flags & RTLIL::CONST_FLAG_STRING) != 0)
-                *f << stringf("\n            (property %s (string \"%s\"))", EDIF_DEF(name), val.decode_string().c_str());
-            else if (val.bits.size() <= 32 && RTLIL::SigSpec(val).is_fully_def()) {
-                *f << stringf("\n            (property %s (integer %u))", EDIF_DEF(name), val.as_int());
-            } else {
-                std::string hex_string = "";
-                for (size_t i = 0; i < val.bits.size(); i += 4) {
-                    int digit_value = 0;
-                    if (i + 0 < val.bits.size() && val.bits.at(i + 0) == RTLIL::State::S1)
-                        digit_value |= 1;
-                    if (i + 1 < val.bits.size() && val.bits.at(i + 1) == RTLIL::State::S1)
-                        digit_value |= 2;
-                    if (i + 2 < val.bits.size() && val.bits.at(i + 2) == RTLIL::State::S1)
-                        digit_value |= 4;
-                    if (i + 3 < val.bits.size() && val.bits.at(i + 3) == RTLIL::State::S1)
-                        digit_value |= 8;
-                    char digit_str[2] = {"0123456789abcdef"[digit_value], 0};
-                    hex_string = std::string(digit_str) + hex_string;
-                }
-                *f << stringf("\n            (property %s (string \"%d'h%s\"))", EDIF_DEF(name), GetSize(val.bits), hex_string.c_str());
-            }
-        };
-        auto add_lut_prop = [&](IdString name, Const val, int lut_in) {
-            if ((val.flags & RTLIL::CONST_FLAG_STRING) != 0)
-                *f << stringf("\n            (property %s (string \"%s\"))", EDIF_DEF(name), val.decode_string().c_str());
-            else if (val.bits.size() <= 32 && RTLIL::SigSpec(val).is_fully_def()) {
-                if (strstr(name.c_str(), "INIT")) {
-                    int hex_code_width = ((1 << lut_in) / 4);
-                    *f << stringf("\n            (property %s (string \"%0*X\"))", EDIF_DEF(name), hex_code_width, val.as_int());
-                } else {
-                    *f << stringf("\n            (property %s (integer %u))", EDIF_DEF(name), val.as_int());
-                }
-            } else {
-                std::string hex_string = "";
-                for (size_t i = 0; i < val.bits.size(); i += 4) {
-                    int digit_value = 0;
-                    if (i + 0 < val.bits.size() && val.bits.at(i + 0) == RTLIL::State::S1)
-                        digit_value |= 1;
-                    if (i + 1 < val.bits.size() && val.bits.at(i + 1) == RTLIL::State::S1)
-                        digit_value |= 2;
-                    if (i + 2 < val.bits.size() && val.bits.at(i + 2) == RTLIL::State::S1)
-                        digit_value |= 4;
-                    if (i + 3 < val.bits.size() && val.bits.at(i + 3) == RTLIL::State::S1)
-                        digit_value |= 8;
-                    char digit_str[2] = {"0123456789abcdef"[digit_value], 0};
-                    hex_string = std::string(digit_str) + hex_string;
-                }
-                *f << stringf("\n            (property %s (string \"%d'h%s\"))", EDIF_DEF(name), GetSize(val.bits), hex_string.c_str());
-            }
-        };
-        for (auto module : sorted_modules) {
+        // Nets are collected and names are resolved serially, so that the
+        // output does not depend on the number of threads. The module bodies
+        // are then rendered concurrently and written in order.
+        std::vector<EdifModule> modules;
+        for (auto module : sort_modules(design)) {
             if (module->get_blackbox_attribute())
                 continue;
+            modules.emplace_back();
+            writer.collect(modules.back(), module);
+            cell_count += GetSize(module->cells());
+        }
 
-            SigMap sigmap(module);
-            std::map<RTLIL::SigSpec, std::set<std::pair<std::string, bool>>> net_join_db;
-
-            *f << stringf("    (cell %s\n", EDIF_DEF(module->name));
-            *f << stringf("      (cellType GENERIC)\n");
-            *f << stringf("      (view VIEW_NETLIST\n");
-            *f << stringf("        (viewType NETLIST)\n");
-            *f << stringf("        (interface\n");
-
-            for (auto cell : module->cells()) {
-                for (auto &conn : cell->connections())
-                    if (cell->output(conn.first))
-                        sigmap.add(conn.second);
-            }
-
-            for (auto wire : module->wires())
-                for (auto b1 : SigSpec(wire)) {
-                    auto b2 = sigmap(b1);
-
-                    if (b1 == b2 || !b2.wire)
-                        continue;
-
-                    log_assert(b1.wire != nullptr);
-
-                    Wire *w1 = b1.wire;
-                    Wire *w2 = b2.wire;
-
-                    {
-                        int c1 = w1->get_bool_attribute(ID::keep);
-                        int c2 = w2->get_bool_attribute(ID::keep);
-
-                        if (c1 > c2)
-                            goto promote;
-                        if (c1 < c2)
-                            goto nopromote;
-                    }
-
-                    {
-                        int c1 = w1->name.isPublic();
-                        int c2 = w2->name.isPublic();
-
-                        if (c1 > c2)
-                            goto promote;
-                        if (c1 < c2)
-                            goto nopromote;
-                    }
-
-                    {
-                        auto count_nontrivial_attr = [](Wire *w) {
-                            int count = w->attributes.size();
-                            count -= w->attributes.count(ID::src);
-                            count -= w->attributes.count(ID::unused_bits);
-                            return count;
-                        };
-
-                        int c1 = count_nontrivial_attr(w1);
-                        int c2 = count_nontrivial_attr(w2);
-
-                        if (c1 > c2)
-                            goto promote;
-                        if (c1 < c2)
-                            goto nopromote;
-                    }
-
-                    {
-                        int c1 = w1->port_id ? INT_MAX - w1->port_id : 0;
-                        int c2 = w2->port_id ? INT_MAX - w2->port_id : 0;
-
-                        if (c1 > c2)
-                            goto promote;
-                        if (c1 < c2)
-                            goto nopromote;
-                    }
-
-                nopromote:
-                    if (0)
-                    promote:
-                        sigmap.add(b1);
-                }
-
-            for (auto wire : module->wires()) {
-                if (wire->port_id == 0)
-                    continue;
-                const char *dir = "INOUT";
-                if (!wire->port_output)
-                    dir = "INPUT";
-                else if (!wire->port_input)
-                    dir = "OUTPUT";
-                if (wire->width == 1) {
-                    *f << stringf("          (port %s (direction %s)", EDIF_DEF(wire->name), dir);
-                    if (attr_properties)
-                        for (auto &p : wire->attributes)
-                            add_prop(p.first, p.second);
-                    *f << ")\n";
-                    RTLIL::SigSpec sig = sigmap(RTLIL::SigSpec(wire));
-                    net_join_db[sig].insert(make_pair(stringf("(portRef %s)", EDIF_REF(wire->name)), wire->port_input));
-                } else {
-                    int b[2];
-                    b[wire->upto ? 0 : 1] = wire->start_offset;
-                    b[wire->upto ? 1 : 0] = wire->start_offset + GetSize(wire) - 1;
-                    *f << stringf("          (port (array %s %d) (direction %s)", EDIF_DEFR(wire->name, port_rename, b[0], b[1]), wire->width, dir);
-                    if (attr_properties)
-                        for (auto &p : wire->attributes)
-                            add_prop(p.first, p.second);
-
-                    *f << ")\n";
-                    for (int i = 0; i < wire->width; i++) {
-                        RTLIL::SigSpec sig = sigmap(RTLIL::SigSpec(wire, i));
-                        net_join_db[sig].insert(
-                          make_pair(stringf("(portRef %s_%d_)", EDIF_REF(wire->name), GetSize(wire) - i - 1), wire->port_input));
-                    }
-                }
-            }
-
-            *f << stringf("        )\n");
-            *f << stringf("        (contents\n");
-
-            if (!nogndvcc) {
-                *f << stringf("          (instance GND (viewRef VIEW_NETLIST (cellRef GND (libraryRef LIB))))\n");
-                *f << stringf("          (instance VCC (viewRef VIEW_NETLIST (cellRef VCC (libraryRef LIB))))\n");
-            }
-
-            for (auto cell : module->cells()) {
-                *f << stringf("          (instance %s\n", EDIF_DEF(cell->name));
-                *f << stringf("            (viewRef VIEW_NETLIST (cellRef %s%s))", EDIF_REF(cell->type),
-                              lib_cell_ports.count(cell->type) > 0 ? " (libraryRef LIB)" : "");
-                const char *lut_pos;
-                lut_pos = strstr(cell->type.c_str(), "LUT");
-                if (lut_pos) {
-                    int lut_in = atoi(lut_pos + 3); // get the number of LUT inputs
-                    for (auto &p : cell->parameters)
-                        add_lut_prop(p.first, p.second, lut_in);
-                    if (attr_properties)
-                        for (auto &p : cell->attributes)
-                            add_lut_prop(p.first, p.second, lut_in);
-                } else {
-                    for (auto &p : cell->parameters)
-                        add_prop(p.first, p.second);
-                    if (attr_properties)
-                        for (auto &p : cell->attributes)
-                            add_prop(p.first, p.second);
-                }
-
-                *f << stringf(")\n");
-                for (auto &p : cell->connections()) {
-                    RTLIL::SigSpec sig = sigmap(p.second);
-                    for (int i = 0; i < GetSize(sig); i++)
-                        if (sig[i].wire == NULL && sig[i] != RTLIL::State::S0 && sig[i] != RTLIL::State::S1)
-                            log_warning("Bit %d of cell port %s.%s.%s driven by %s will be left unconnected in EDIF output.\n", i, log_id(module),
-                                        log_id(cell), log_id(p.first), log_signal(sig[i]));
-                        else {
-                            int member_idx = GetSize(sig) - i - 1;
-                            auto m = design->module(cell->type);
-                            int width = sig.size();
-                            if (m) {
-                                auto w = m->wire(p.first);
-                                if (w) {
-                                    member_idx = GetSize(w) - i - 1;
-                                    width = GetSize(w);
-                                }
-                            }
-                            if (width == 1)
-                                net_join_db[sig[i]].insert(make_pair(
-                                  stringf("(portRef %s (instanceRef %s))", EDIF_REF(p.first), EDIF_REF(cell->name)), cell->output(p.first)));
-                            else {
-                                net_join_db[sig[i]].insert(make_pair(stringf("(portRef %s_%d_ (instanceRef %s))", EDIF_REF(p.first),
-                                                                             width - member_idx - 1, EDIF_REF(cell->name)), // reverse IDs
-                                                                     cell->output(p.first)));
-                            }
-                        }
-                }
-            }
-
-            for (auto &it : net_join_db) {
-                RTLIL::SigBit sig = it.first;
-                if (sig.wire == NULL && sig != RTLIL::State::S0 && sig != RTLIL::State::S1) {
-                    if (sig == RTLIL::State::Sx) {
-                        for (auto &ref : it.second)
-                            log_warning("Exporting x-bit on %s as zero bit.\n", ref.first.c_str());
-                        sig = RTLIL::State::S0;
-                    } else if (sig == RTLIL::State::Sz) {
-                        continue;
-                    } else {
-                        for (auto &ref : it.second)
-                            log_error("Don't know how to handle %s on %s.\n", log_signal(sig), ref.first.c_str());
-                        log_abort();
-                    }
-                }
-                std::string netname;
-                if (sig == RTLIL::State::S0)
-                    netname = "GND_NET";
-                else if (sig == RTLIL::State::S1)
-                    netname = "VCC_NET";
-                else {
-                    netname = log_signal(sig);
-                    for (size_t i = 0; i < netname.size(); i++)
-                        if (netname[i] == ' ' || netname[i] == '\\')
-                            netname.erase(netname.begin() + i--);
-                }
-                *f << stringf("          (net %s (joined\n", EDIF_DEF(netname));
-                for (auto &ref : it.second)
-                    *f << stringf("              %s\n", ref.first.c_str());
-                if (sig.wire == NULL) {
-                    if (nogndvcc)
-                        log_error("Design contains constant nodes (map with \"hilomap\" first).\n");
-                    if (sig == RTLIL::State::S0)
-                        *f << stringf("            (portRef %c (instanceRef GND))\n", gndvccy ? 'Y' : 'G');
-                    if (sig == RTLIL::State::S1)
-                        *f << stringf("            (portRef %c (instanceRef VCC))\n", gndvccy ? 'Y' : 'P');
-                }
-                *f << stringf("            )");
-                if (attr_properties && sig.wire != NULL)
-                    for (auto &p : sig.wire->attributes)
-                        add_prop(p.first, p.second);
-                *f << stringf("\n          )\n");
-            }
-
-            for (auto wire : module->wires()) {
-                if (!wire->get_bool_attribute(ID::keep))
-                    continue;
-
-                for (int i = 0; i < wire->width; i++) {
-                    SigBit raw_sig = RTLIL::SigSpec(wire, i);
-                    SigBit mapped_sig = sigmap(raw_sig);
-
-                    if (raw_sig == mapped_sig || net_join_db.count(mapped_sig) == 0)
-                        continue;
-
-                    std::string netname = log_signal(raw_sig);
-                    for (size_t i = 0; i < netname.size(); i++)
-                        if (netname[i] == ' ' || netname[i] == '\\')
-                            netname.erase(netname.begin() + i--);
-
-                    if (keepmode) {
-                        *f << stringf("          (net %s (joined\n", EDIF_DEF(netname));
-
-                        auto &refs = net_join_db.at(mapped_sig);
-                        for (auto &ref : refs)
-                            if (ref.second)
-                                *f << stringf("              %s\n", ref.first.c_str());
-                        *f << stringf("            )");
-
-                        if (attr_properties && raw_sig.wire != NULL)
-                            for (auto &p : raw_sig.wire->attributes)
-                                add_prop(p.first, p.second);
-
-                        *f << stringf("\n          )\n");
-                    } else {
-                        log_warning("Ignoring conflicting 'keep' property on net %s. Use -keep to generate the extra net nevertheless.\n",
-                                    EDIF_DEF(netname));
-                    }
-                }
+        out << "  (library DESIGN\n";
+        out << "    (edifLevel 0)\n";
+        out << "    (technology (numberDefinition))\n";
+
+        if (num_threads <= 1 || modules.size() <= 1) {
+            for (auto &em : modules)
+                writer.render(em, out);
+        } else {
+            std::vector<std::string> texts(modules.size());
+            parallel_for(modules.size(), num_threads, [&](size_t i) {
+                EdifBuffer buffer;
+                writer.render(modules[i], buffer);
+                texts[i].swap(buffer.data);
+            });
+            for (auto &text : texts) {
+                out << text;
+                std::string().swap(text);
             }
-
-            *f << stringf("        )\n");
-            *f << stringf("      )\n");
-            *f << stringf("    )\n");
         }
-        *f << stringf("  )\n");
+        out << "  )\n";
+
+        out << "  (design " << edif_names(RTLIL::unescape_id(top_module_name), true) << "\n";
+        out << "    (cellRef " << edif_names(RTLIL::unescape_id(top_module_name), false) << " (libraryRef DESIGN))\n";
+        out << "  )\n";
 
-        *f << stringf("  (design %s\n", EDIF_DEF(top_module_name));
-        *f << stringf("    (cellRef %s (libraryRef DESIGN))\n", EDIF_REF(top_module_name));
-        *f << stringf("  )\n");
+        out << ")\n";
+        out.flush();
 
-        *f << stringf(")\n");
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+        log("Wrote %d cells in %d modules in %.3f s (%.0f cells/s).\n", cell_count, GetSize(modules), seconds,
+            seconds > 0 ? cell_count / seconds : 0.0);
     }
 } QLEdifBackend;
 
@@ -31,35 +31,183 @@ struct QuicklogicEqnPass : public Pass {
         log("    quicklogic_eqn [selection]\n");
         log("\n");
         log("Calculate equations for luts since bitstream generator depends on it.\n");
+        log("Equations are written as minimized sums of products. Each distinct\n");
+        log("truth table is minimized only once.\n");
         log("\n");
     }
 
+    /// A product term. Bits set in 'mask' are the inputs the term depends
+    /// on, 'value' holds their polarities.
+    struct Implicant {
+        uint32_t value;
+        uint32_t mask;
+
+        bool covers(uint32_t minterm) const { return (minterm & mask) == value; }
+        bool operator<(const Implicant &other) const { return std::make_pair(mask, value) < std::make_pair(other.mask, other.value); }
+        bool operator==(const Implicant &other) const { return mask == other.mask && value == other.value; }
+    };
+
+    static int count_bits(uint32_t value)
+    {
+        int count = 0;
+        for (; value; value &= value - 1)
+            count++;
+        return count;
+    }
+
+    /// Equations computed so far indexed by (inputs, truth table)
+    dict<int64_t, Const> eqn_cache;
+
+    /// Returns prime implicants of the function given by the minterms
+    /// (Quine-McCluskey)
+    static std::vector<Implicant> prime_implicants(const std::vector<uint32_t> &minterms, int inputs)
+    {
+        const uint32_t full = (1u << inputs) - 1;
+
+        std::vector<Implicant> primes;
+        std::set<Implicant> curr;
+        for (auto minterm : minterms)
+            curr.insert({minterm, full});
+
+        while (!curr.empty()) {
+            std::set<Implicant> next;
+            std::set<Implicant> merged;
+
+            // Merge terms with the same mask that differ in a single input
+            for (auto a = curr.begin(); a != curr.end(); ++a) {
+                for (auto b = std::next(a); b != curr.end() && b->mask == a->mask; ++b) {
+                    uint32_t diff = a->value ^ b->value;
+                    if ((diff & (diff - 1)) != 0)
+                        continue;
+                    next.insert({a->value & ~diff, a->mask & ~diff});
+                    merged.insert(*a);
+                    merged.insert(*b);
+                }
+            }
+
+            for (auto &term : curr)
+                if (!merged.count(term))
+                    primes.push_back(term);
+
+            curr.swap(next);
+        }
+
+        return primes;
+    }
+
+    /// Selects prime implicants that cover all the minterms. Essential ones
+    /// first, then greedily the ones that cover the most remaining minterms.
+    static std::vector<Implicant> select_cover(const std::vector<Implicant> &primes, const std::vector<uint32_t> &minterms)
+    {
+        std::vector<Implicant> cover;
+        std::set<uint32_t> uncovered(minterms.begin(), minterms.end());
+
+        auto take = [&](const Implicant &term) {
+            cover.push_back(term);
+            for (auto it = uncovered.begin(); it != uncovered.end();) {
+                if (term.covers(*it))
+                    it = uncovered.erase(it);
+                else
+                    ++it;
+            }
+        };
+
+        for (auto minterm : minterms) {
+            if (!uncovered.count(minterm))
+                continue;
+            const Implicant *only = nullptr;
+            int count = 0;
+            for (auto &term : primes) {
+                if (term.covers(minterm)) {
+                    only = &term;
+                    count++;
+                }
+            }
+            if (count == 1)
+                take(*only);
+        }
+
+        while (!uncovered.empty()) {
+            const Implicant *best = nullptr;
+            size_t best_count = 0;
+            for (auto &term : primes) {
+                size_t count = 0;
+                for (auto minterm : uncovered)
+                    if (term.covers(minterm))
+                        count++;
+                // Prefer terms with fewer literals on a tie
+                bool better = count > best_count || (count == best_count && best != nullptr && count_bits(term.mask) < count_bits(best->mask));
+                if (better) {
+                    best = &term;
+                    best_count = count;
+                }
+            }
+            log_assert(best != nullptr && best_count > 0);
+            take(*best);
+        }
+
+        std::sort(cover.begin(), cover.end());
+        return cover;
+    }
+
     Const init2eqn(Const init, int inputs)
     {
         std::string init_bits = init.as_string();
-        const char *names[] = {"I0", "I1", "I2", "I3", "I4"};
+        int width = 1 << inputs;
 
-        std::string eqn;
-        int width = (int)pow(2, inputs);
+        // Truth table, bit i is the output for input combination i
+        uint32_t table = 0;
         for (int i = 0; i < width; i++) {
-            if (init_bits[width - 1 - i] == '1') {
-                eqn += "(";
-                for (int j = 0; j < inputs; j++) {
-                    if (i & (1 << j))
-                        eqn += names[j];
-                    else
-                        eqn += std::string("~") + names[j];
+            int index = width - 1 - i;
+            if (index < GetSize(init_bits) && init_bits[index] == '1')
+                table |= 1u << i;
+        }
+
+        int64_t key = ((int64_t)inputs << 32) | table;
+        auto it = eqn_cache.find(key);
+        if (it != eqn_cache.end())
+            return it->second;
+
+        std::vector<uint32_t> minterms;
+        for (int i = 0; i < width; i++)
+            if (table & (1u << i))
+                minterms.push_back(i);
 
-                    if (j != (inputs - 1))
-                        eqn += "*";
+        Const result("0");
+        if (!minterms.empty()) {
+            const char *names[] = {"I0", "I1", "I2", "I3", "I4"};
+
+            std::string eqn;
+            eqn.reserve(64);
+            for (auto &term : select_cover(prime_implicants(minterms, inputs), minterms)) {
+                // A constant one is written as a sum of the two polarities
+                // of the first input as the equation has to be non-empty.
+                if (term.mask == 0) {
+                    eqn = "(I0)+(~I0)";
+                    break;
+                }
+
+                if (!eqn.empty())
+                    eqn += '+';
+                eqn += '(';
+                bool first = true;
+                for (int j = 0; j < inputs; j++) {
+                    if (!(term.mask & (1u << j)))
+                        continue;
+                    if (!first)
+                        eqn += '*';
+                    if (!(term.value & (1u << j)))
+                        eqn += '~';
+                    eqn += names[j];
+                    first = false;
                 }
-                eqn += ")+";
+                eqn += ')';
             }
+            result = Const(eqn);
         }
-        if (eqn.empty())
-            return Const("0");
-        eqn = eqn.substr(0, eqn.length() - 1);
-        return Const(eqn);
+
+        eqn_cache[key] = result;
+        return result;
     }
 
     void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -68,32 +216,22 @@ struct QuicklogicEqnPass : public Pass {
 
         extra_args(args, args.size(), design);
 
+        const dict<IdString, int> lut_inputs = {{ID(LUT1), 1}, {ID(LUT2), 2}, {ID(LUT3), 3}, {ID(LUT4), 4}, {ID(LUT5), 5}};
+
         int cnt = 0;
         for (auto module : design->selected_modules()) {
             for (auto cell : module->selected_cells()) {
-                if (cell->type == ID(LUT1)) {
-                    cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), 1));
-                    cnt++;
-                }
-                if (cell->type == ID(LUT2)) {
-                    cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), 2));
-                    cnt++;
-                }
-                if (cell->type == ID(LUT3)) {
-                    cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), 3));
-                    cnt++;
-                }
-                if (cell->type == ID(LUT4)) {
-                    cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), 4));
-                    cnt++;
-                }
-                if (cell->type == ID(LUT5)) {
-                    cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), 5));
-                    cnt++;
-                }
+                auto it = lut_inputs.find(cell->type);
+                if (it == lut_inputs.end())
+                    continue;
+
+                cell->setParam(ID(EQN), init2eqn(cell->getParam(ID::INIT), it->second));
+                cnt++;
             }
         }
         log_header(design, "Updated %d of LUT* elements with equation.\n", cnt);
+        log("Computed %d distinct equation(s).\n", GetSize(eqn_cache));
+        eqn_cache.clear();
     }
 } QuicklogicEqnPass;
 
@@ -20,6 +20,28 @@
 #include "kernel/log.h"
 #include "kernel/register.h"
 #include "kernel/rtlil.h"
+#include "libs/json11/json11.hpp"
+#include "libs/sha1/sha1.h"
+
+#include "../common/parallel.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 USING_YOSYS_NAMESPACE
 PRIVATE_NAMESPACE_BEGIN
@@ -57,6 +79,18 @@ struct SynthQuickLogicPass : public ScriptPass {
         log("        By default most of ABC logic optimization features is\n");
         log("        enabled. Specifying this switch turns them off.\n");
         log("\n");
+        log("    -effort <low|normal|high>\n");
+        log("        Trade synthesis runtime for result quality. 'low' skips fsm,\n");
+        log("        peepopt and share, runs single fast opt rounds and maps to LUTs\n");
+        log("        with the fast ABC scripts; meant for quick RTL iterations.\n");
+        log("        'high' runs full opt rounds and aggressive resource sharing.\n");
+        log("        Default: normal\n");
+        log("\n");
+        log("    -abc_jobs <N>\n");
+        log("        Split the logic into register-bounded partitions and map them\n");
+        log("        to LUTs with up to N concurrent ABC runs, see 'help ql_abc_jobs'.\n");
+        log("        Not used for the pp3 ABC9 flow. Default: 1\n");
+        log("\n");
         log("    -edif <file>\n");
         log("        write the design to the specified edif file. writing of an output file\n");
         log("        is omitted if this parameter is not specified.\n");
@@ -96,22 +130,86 @@ struct SynthQuickLogicPass : public ScriptPass {
         log("        that support them. \n");
         log("        Specifying this switch turns it off.\n");
         log("\n");
+        log("    -cache <dir>\n");
+        log("        Save a snapshot of the design to the specified directory after\n");
+        log("        each synthesis label up to 'finalize'. A later run starts from\n");
+        log("        the deepest snapshot that is still valid and skips the labels\n");
+        log("        before it. A snapshot is valid when the input design, the Yosys\n");
+        log("        scratchpad, the plugin library, all commands executed up to its\n");
+        log("        label and the share files they read are the same, so changing\n");
+        log("        only output options or options of late labels reuses the early\n");
+        log("        ones. Ignored together with -run and on Windows.\n");
+        log("\n");
+        log("    -profile <file>\n");
+        log("        Write a JSON profile of the synthesis to the specified file. For\n");
+        log("        every executed command it records the wall and CPU time, the\n");
+        log("        increase of the peak resident set size and the number of cells\n");
+        log("        and wires before and after the command. The commands are grouped\n");
+        log("        by label, with totals per label and for the whole run.\n");
+        log("\n");
+        log("    -sweep <spec>\n");
+        log("        Compare several option sets. The design is elaborated once, up\n");
+        log("        to the 'prepare' label, then one forked process per option set\n");
+        log("        runs the rest of the script on a copy-on-write copy of it. Up to\n");
+        log("        one process per CPU core runs at a time. A table with the runtime\n");
+        log("        and the cell counts of every option set is printed at the end.\n");
+        log("        The option sets are separated by ',' and the options of one set\n");
+        log("        by '+'. Option values follow a '='. 'default' stands for the\n");
+        log("        options given on the command line alone, which every set adds\n");
+        log("        to. For example:\n");
+        log("            -sweep default,-nosdff,-no_adder+-bram_types,-effort=low\n");
+        log("        Options that can be swept: -no_dsp, -use_dsp_cfg_params,\n");
+        log("        -no_adder, -no_bram, -bram_types, -no_abc_opt, -no_abc9,\n");
+        log("        -effort, -abc_jobs, -no_ff_map and -nosdff. The design is left\n");
+        log("        after 'prepare' and no output files are written. Fails when any\n");
+        log("        option set fails, keeping the logs of the failed sets. Not\n");
+        log("        supported on Windows, ignores -cache and -profile.\n");
+        log("\n");
         log("\n");
         log("The following commands are executed by this synthesis command:\n");
         help_script();
         log("\n");
     }
 
-    string top_opt, edif_file, blif_file, family, currmodule, verilog_file, use_dsp_cfg_params;
+    string top_opt, edif_file, blif_file, family, currmodule, verilog_file, use_dsp_cfg_params, effort;
     bool nodsp;
     bool inferAdder;
     bool inferBram;
     bool bramTypes;
     bool abcOpt;
     bool abc9;
+    int abcJobs;
     bool noffmap;
     bool nosdff;
 
+    // Checkpoint cache state, see -cache
+    string cache_dir;
+    bool cachePlanning;                               // script() only records the commands
+    bool cacheSkipping;                               // resuming, commands before active_run_from are skipped
+    int cacheLabel;                                   // index of the running label in cachePlan
+    std::vector<std::pair<string, string>> cachePlan; // labels and the commands they run
+    std::vector<string> cacheKeys;                    // snapshot key after each cacheable label
+
+    // Option sets to compare, see -sweep
+    string sweep_spec;
+    std::vector<std::vector<string>> sweepVariants;
+
+    // Profile of the executed commands, see -profile
+    struct ProfileEntry {
+        string label;
+        string command;
+        double wall;
+        double cpu;
+        long peakRssDelta;
+        long peakRss;
+        int cellsBefore, cellsAfter;
+        int wiresBefore, wiresAfter;
+    };
+
+    string profile_file;
+    string profileLabel;
+    std::vector<ProfileEntry> profile;
+
     void clear_flags() override
     {
         top_opt = "-auto-top";
@@ -125,10 +223,89 @@ struct SynthQuickLogicPass : public ScriptPass {
         bramTypes = false;
         abcOpt = true;
         abc9 = true;
+        abcJobs = 1;
+        effort = "normal";
         noffmap = false;
         nodsp = false;
         nosdff = false;
         use_dsp_cfg_params = "";
+        cache_dir = "";
+        cachePlanning = false;
+        cacheSkipping = false;
+        cacheLabel = -1;
+        cachePlan.clear();
+        cacheKeys.clear();
+        profile_file = "";
+        profileLabel = "";
+        profile.clear();
+        sweep_spec = "";
+        sweepVariants.clear();
+    }
+
+    // Parses an option that only affects the script after 'prepare' and
+    // can therefore be swept. Returns false if args[argidx] is not one.
+    bool parse_option(const std::vector<std::string> &args, size_t &argidx)
+    {
+        if (args[argidx] == "-no_dsp") {
+            nodsp = true;
+            return true;
+        }
+        if (args[argidx] == "-use_dsp_cfg_params") {
+            use_dsp_cfg_params = " -use_dsp_cfg_params";
+            return true;
+        }
+        if (args[argidx] == "-no_adder") {
+            inferAdder = false;
+            return true;
+        }
+        if (args[argidx] == "-no_bram") {
+            inferBram = false;
+            return true;
+        }
+        if (args[argidx] == "-bram_types") {
+            bramTypes = true;
+            return true;
+        }
+        if (args[argidx] == "-no_abc_opt") {
+            abcOpt = false;
+            return true;
+        }
+        if (args[argidx] == "-no_abc9") {
+            abc9 = false;
+            return true;
+        }
+        if (args[argidx] == "-effort" && argidx + 1 < args.size()) {
+            effort = args[++argidx];
+            return true;
+        }
+        if (args[argidx] == "-abc_jobs" && argidx + 1 < args.size()) {
+            abcJobs = std::max(atoi(args[++argidx].c_str()), 1);
+            return true;
+        }
+        if (args[argidx] == "-no_ff_map") {
+            noffmap = true;
+            return true;
+        }
+        if (args[argidx] == "-nosdff") {
+            nosdff = true;
+            return true;
+        }
+        return false;
+    }
+
+    // Checks the options and applies the family specific overrides
+    void check_options()
+    {
+        if (effort != "low" && effort != "normal" && effort != "high")
+            log_cmd_error("Invalid effort specified: '%s'\n", effort.c_str());
+
+        if (family != "pp3") {
+            abc9 = false;
+        }
+
+        if (family == "qlf_k4n8") {
+            nosdff = true;
+        }
     }
 
     void execute(std::vector<std::string> args, RTLIL::Design *design) override
@@ -170,40 +347,19 @@ struct SynthQuickLogicPass : public ScriptPass {
                 verilog_file = args[++argidx];
                 continue;
             }
-            if (args[argidx] == "-no_dsp") {
-                nodsp = true;
-                continue;
-            }
-            if (args[argidx] == "-use_dsp_cfg_params") {
-                use_dsp_cfg_params = " -use_dsp_cfg_params";
-                continue;
-            }
-            if (args[argidx] == "-no_adder") {
-                inferAdder = false;
-                continue;
-            }
-            if (args[argidx] == "-no_bram") {
-                inferBram = false;
-                continue;
-            }
-            if (args[argidx] == "-bram_types") {
-                bramTypes = true;
+            if (parse_option(args, argidx)) {
                 continue;
             }
-            if (args[argidx] == "-no_abc_opt") {
-                abcOpt = false;
+            if (args[argidx] == "-cache" && argidx + 1 < args.size()) {
+                cache_dir = args[++argidx];
                 continue;
             }
-            if (args[argidx] == "-no_abc9") {
-                abc9 = false;
+            if (args[argidx] == "-profile" && argidx + 1 < args.size()) {
+                profile_file = args[++argidx];
                 continue;
             }
-            if (args[argidx] == "-no_ff_map") {
-                noffmap = true;
-                continue;
-            }
-            if (args[argidx] == "-nosdff") {
-                nosdff = true;
+            if (args[argidx] == "-sweep" && argidx + 1 < args.size()) {
+                sweep_spec = args[++argidx];
                 continue;
             }
 
@@ -217,12 +373,19 @@ struct SynthQuickLogicPass : public ScriptPass {
         if (family != "pp3" && family != "qlf_k4n8" && family != "qlf_k6n10" && family != "qlf_k6n10f")
             log_cmd_error("Invalid family specified: '%s'\n", family.c_str());
 
-        if (family != "pp3") {
-            abc9 = false;
-        }
+        check_options();
 
-        if (family == "qlf_k4n8") {
-            nosdff = true;
+        if (!sweep_spec.empty()) {
+#ifdef _WIN32
+            log_cmd_error("-sweep is not supported on Windows.\n");
+#endif
+            if (!run_from.empty() || !run_to.empty())
+                log_cmd_error("-sweep can't be combined with -run.\n");
+            if (!cache_dir.empty() || !profile_file.empty() || !edif_file.empty() || !blif_file.empty() || !verilog_file.empty()) {
+                log_warning("Ignoring -cache, -profile and output files together with -sweep.\n");
+                cache_dir = profile_file = edif_file = blif_file = verilog_file = "";
+            }
+            parse_sweep_spec();
         }
 
         if (abc9 && design->scratchpad_get_int("abc9.D", 0) == 0) {
@@ -230,14 +393,520 @@ struct SynthQuickLogicPass : public ScriptPass {
             design->scratchpad_set_int("abc9.D", 41667); // 12MHz = 83.33.. ns; divided by two to allow for interconnect delay.
         }
 
+        if (!cache_dir.empty() && (!run_from.empty() || !run_to.empty())) {
+            log_warning("Ignoring -cache together with -run.\n");
+            cache_dir = "";
+        }
+
         log_header(design, "Executing SYNTH_QUICKLOGIC pass.\n");
         log_push();
 
+        if (!sweep_spec.empty()) {
+            run_sweep(design);
+            log_pop();
+            return;
+        }
+
+        if (!cache_dir.empty())
+            run_from = cache_resume(design);
+
         run_script(design, run_from, run_to);
 
+        if (!cache_dir.empty())
+            cache_save(cacheLabel);
+
+        if (!profile_file.empty())
+            write_profile();
+
         log_pop();
     }
 
+    // ..........................................
+
+    // Splits the -sweep spec into the options of every option set and checks
+    // that all of them can be swept
+    void parse_sweep_spec()
+    {
+        // Sweepable options and whether they take a value
+        static const std::map<string, bool> sweepOptions = {
+          {"-no_dsp", false},     {"-use_dsp_cfg_params", false}, {"-no_adder", false}, {"-no_bram", false},
+          {"-bram_types", false}, {"-no_abc_opt", false},         {"-no_abc9", false},  {"-effort", true},
+          {"-abc_jobs", true},    {"-no_ff_map", false},          {"-nosdff", false},
+        };
+
+        for (auto &variant : split_tokens(sweep_spec, ",")) {
+            std::vector<string> options;
+            if (variant != "default") {
+                for (auto &option : split_tokens(variant, "+")) {
+                    size_t pos = option.find('=');
+                    options.push_back(option.substr(0, pos));
+                    if (pos != string::npos)
+                        options.push_back(option.substr(pos + 1));
+                }
+            }
+
+            for (size_t i = 0; i < options.size(); i++) {
+                auto it = sweepOptions.find(options[i]);
+                if (it == sweepOptions.end())
+                    log_cmd_error("Option '%s' can't be swept.\n", options[i].c_str());
+                if (it->second && ++i >= options.size())
+                    log_cmd_error("Swept option '%s' needs a value, e.g. '%s=<value>'.\n", it->first.c_str(), it->first.c_str());
+                if (it->first == "-effort" && options[i] != "low" && options[i] != "normal" && options[i] != "high")
+                    log_cmd_error("Invalid effort specified: '%s'\n", options[i].c_str());
+            }
+            sweepVariants.push_back(options);
+        }
+
+        if (sweepVariants.empty())
+            log_cmd_error("No option sets given to -sweep.\n");
+    }
+
+#ifndef _WIN32
+    // Elaborates the design, then forks one process per option set that runs
+    // the rest of the script. Each process writes its log and its results to
+    // a temporary directory, which are collected into a comparison table.
+    void run_sweep(RTLIL::Design *design)
+    {
+        // The end label is exclusive, this runs up to and including 'prepare'
+        run_script(design, "", "coarse");
+
+        string dir = make_temp_dir("/tmp/yosys-ql-sweep-XXXXXX");
+        int jobs = std::min(default_thread_count(), GetSize(sweepVariants));
+        log("Sweeping %d option set(s) with up to %d concurrent job(s) in %s.\n", GetSize(sweepVariants), jobs, dir.c_str());
+
+        // Children inherit the buffered output, flush it so it is written once
+        log_flush();
+
+        std::map<pid_t, int> running;
+        std::vector<int> exitCodes(sweepVariants.size(), -1);
+        int next = 0;
+        while (next < GetSize(sweepVariants) || !running.empty()) {
+            if (next < GetSize(sweepVariants) && GetSize(running) < jobs) {
+                pid_t pid = fork();
+                if (pid < 0)
+                    log_error("Can't fork: %s\n", strerror(errno));
+                if (pid == 0)
+                    sweep_child(design, next, dir);
+                running[pid] = next++;
+                continue;
+            }
+
+            int status;
+            pid_t pid = waitpid(-1, &status, 0);
+            if (pid < 0) {
+                if (errno == EINTR)
+                    continue;
+                log_error("Can't wait for sweep jobs: %s\n", strerror(errno));
+            }
+            auto it = running.find(pid);
+            if (it == running.end())
+                continue;
+            exitCodes[it->second] = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+            running.erase(it);
+        }
+
+        // Collect the results
+        struct SweepResult {
+            bool ok = false;
+            double wall = 0.0, cpu = 0.0;
+            int cells = 0;
+            std::map<string, int> cellTypes;
+        };
+        std::vector<SweepResult> results(sweepVariants.size());
+        std::set<string> cellTypes;
+        bool failed = false;
+        for (int i = 0; i < GetSize(sweepVariants); i++) {
+            auto &result = results[i];
+            std::ifstream file(stringf("%s/variant_%d.txt", dir.c_str(), i));
+            string key;
+            while (exitCodes[i] == 0 && file >> key) {
+                if (key == "wall") {
+                    file >> result.wall;
+                } else if (key == "cpu") {
+                    file >> result.cpu;
+                } else if (key == "cell") {
+                    string type;
+                    int count;
+                    file >> type >> count;
+                    result.cellTypes[type] = count;
+                    result.cells += count;
+                    cellTypes.insert(type);
+                }
+                result.ok = true;
+            }
+            failed |= !result.ok;
+        }
+
+        log("\n");
+        log("Sweep results:\n");
+        log("\n");
+        log("  %-4s %-40s %10s %10s %10s\n", "Set", "Options", "Wall [s]", "CPU [s]", "Cells");
+        for (int i = 0; i < GetSize(sweepVariants); i++) {
+            string options = sweepVariants[i].empty() ? "(default)" : "";
+            for (auto &arg : sweepVariants[i])
+                options += (options.empty() ? "" : " ") + arg;
+            if (results[i].ok) {
+                log("  %-4d %-40s %10.2f %10.2f %10d\n", i, options.c_str(), results[i].wall, results[i].cpu, results[i].cells);
+            } else {
+                log("  %-4d %-40s failed, see %s/variant_%d.log\n", i, options.c_str(), dir.c_str(), i);
+            }
+        }
+
+        log("\n");
+        log("  %-30s", "Cell type");
+        for (int i = 0; i < GetSize(sweepVariants); i++)
+            log(" %8d", i);
+        log("\n");
+        for (auto &type : cellTypes) {
+            log("  %-30s", type.c_str());
+            for (auto &result : results) {
+                auto it = result.cellTypes.find(type);
+                log(" %8d", it == result.cellTypes.end() ? 0 : it->second);
+            }
+            log("\n");
+        }
+        log("\n");
+
+        if (failed)
+            log_error("Some option sets failed, their logs are kept in %s.\n", dir.c_str());
+        remove_directory(dir);
+    }
+
+    // Runs the script after 'prepare' with the given option set in a forked
+    // process and writes the runtime and the cell counts to the sweep
+    // directory. Never returns.
+    void sweep_child(RTLIL::Design *design, int variant, const string &dir)
+    {
+        int exitCode = 1;
+        try {
+            std::ofstream logFile(stringf("%s/variant_%d.log", dir.c_str(), variant));
+            log_files.clear();
+            log_streams.clear();
+            log_streams.push_back(&logFile);
+
+            const auto &args = sweepVariants[variant];
+            for (size_t argidx = 0; argidx < args.size(); argidx++)
+                if (!parse_option(args, argidx))
+                    log_cmd_error("Unknown option '%s'.\n", args[argidx].c_str());
+            check_options();
+
+            auto wall = std::chrono::steady_clock::now();
+            std::clock_t cpu = std::clock();
+
+            run_script(design, "coarse", "");
+
+            double wallTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+            double cpuTime = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+
+            Pass::call(design, "stat");
+
+            std::map<string, int> cellTypes;
+            for (auto module : design->modules()) {
+                if (module->get_blackbox_attribute())
+                    continue;
+                for (auto cell : module->cells())
+                    cellTypes[log_id(cell->type)]++;
+            }
+
+            std::ofstream result(stringf("%s/variant_%d.txt", dir.c_str(), variant));
+            result << "wall " << wallTime << "\n";
+            result << "cpu " << cpuTime << "\n";
+            for (auto &it : cellTypes)
+                result << "cell " << it.first << " " << it.second << "\n";
+            result.flush();
+            exitCode = result.good() ? 0 : 1;
+            log_streams.clear();
+        } catch (...) {
+            exitCode = 1;
+        }
+
+        // Leave without running the exit handlers of the parent process
+        _exit(exitCode);
+    }
+#else
+    void run_sweep(RTLIL::Design *) {}
+#endif
+
+    // Returns the peak resident set size of the process in kB
+    static long peak_rss()
+    {
+#ifndef _WIN32
+        struct rusage usage;
+        if (getrusage(RUSAGE_SELF, &usage) == 0)
+            return usage.ru_maxrss;
+#endif
+        return 0;
+    }
+
+    static void count_objects(RTLIL::Design *design, int &cells, int &wires)
+    {
+        cells = wires = 0;
+        for (auto module : design->modules()) {
+            cells += GetSize(module->cells_);
+            wires += GetSize(module->wires_);
+        }
+    }
+
+    void profile_run(const string &command, const string &info)
+    {
+        ProfileEntry entry;
+        entry.label = profileLabel;
+        entry.command = command;
+        count_objects(active_design, entry.cellsBefore, entry.wiresBefore);
+        long rss = peak_rss();
+        auto wall = std::chrono::steady_clock::now();
+        std::clock_t cpu = std::clock();
+
+        ScriptPass::run(command, info);
+
+        entry.cpu = double(std::clock() - cpu) / CLOCKS_PER_SEC;
+        entry.wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall).count();
+        entry.peakRss = peak_rss();
+        entry.peakRssDelta = entry.peakRss - rss;
+        count_objects(active_design, entry.cellsAfter, entry.wiresAfter);
+        profile.push_back(entry);
+    }
+
+    // Writes the profile. Labels and commands are listed in the order they
+    // were executed, times are in seconds and memory sizes in kB.
+    void write_profile()
+    {
+        std::ofstream file(profile_file);
+        if (!file)
+            log_error("Can't open file '%s' for writing!\n", profile_file.c_str());
+
+        struct Totals {
+            double wall = 0.0, cpu = 0.0;
+            long peakRssDelta = 0;
+        };
+        auto totals_json = [](const Totals &totals) {
+            return json11::Json::object{
+              {"wall_s", totals.wall},
+              {"cpu_s", totals.cpu},
+              {"peak_rss_delta_kb", (double)totals.peakRssDelta},
+            };
+        };
+
+        json11::Json::array labels;
+        json11::Json::array commands;
+        Totals total, label;
+        for (size_t i = 0; i < profile.size(); i++) {
+            const auto &entry = profile[i];
+            commands.push_back(json11::Json::object{
+              {"command", entry.command},
+              {"wall_s", entry.wall},
+              {"cpu_s", entry.cpu},
+              {"peak_rss_delta_kb", (double)entry.peakRssDelta},
+              {"peak_rss_kb", (double)entry.peakRss},
+              {"cells_before", entry.cellsBefore},
+              {"cells_after", entry.cellsAfter},
+              {"wires_before", entry.wiresBefore},
+              {"wires_after", entry.wiresAfter},
+            });
+            for (auto sum : {&label, &total}) {
+                sum->wall += entry.wall;
+                sum->cpu += entry.cpu;
+                sum->peakRssDelta += entry.peakRssDelta;
+            }
+
+            // Close the label at its last command
+            if (i + 1 == profile.size() || profile[i + 1].label != entry.label) {
+                size_t first = i + 1 - commands.size();
+                auto json = totals_json(label);
+                json["label"] = entry.label;
+                json["cells_before"] = profile[first].cellsBefore;
+                json["cells_after"] = entry.cellsAfter;
+                json["wires_before"] = profile[first].wiresBefore;
+                json["wires_after"] = entry.wiresAfter;
+                json["commands"] = commands;
+                labels.push_back(json);
+                commands.clear();
+                label = Totals();
+            }
+        }
+
+        auto summary = totals_json(total);
+        summary["peak_rss_kb"] = (double)peak_rss();
+
+        json11::Json json = json11::Json::object{
+          {"format_version", 1},
+          {"yosys_version", yosys_version_str},
+          {"family", family},
+          {"labels", labels},
+          {"total", summary},
+        };
+
+        log("Writing profile to '%s'...\n", profile_file.c_str());
+        file << json.dump() << std::endl;
+    }
+
+    // ..........................................
+
+    // Labels that write output files. They are never cached and neither is
+    // anything after them.
+    static bool is_output_label(const string &label) { return label == "blif" || label == "edif" || label == "verilog"; }
+
+    string cache_file(int label) const { return cache_dir + "/" + cacheKeys.at(label) + ".il"; }
+
+    // Identifies the loaded plugin library by its path, size and modification
+    // time. Returns an empty string when it can't be determined.
+    static string plugin_stamp()
+    {
+#ifndef _WIN32
+        Dl_info info;
+        struct stat st;
+        if (dladdr((void *)&plugin_stamp, &info) && info.dli_fname && stat(info.dli_fname, &st) == 0)
+            return stringf("%s %lld %lld\n", info.dli_fname, (long long)st.st_size, (long long)st.st_mtime);
+#endif
+        return string();
+    }
+
+    // Hashes the contents of the share files (+/...) read by the commands
+    static string share_files_hash(const string &commands)
+    {
+        SHA1 sha;
+        for (auto &token : split_tokens(commands)) {
+            if (token.compare(0, 2, "+/") != 0)
+                continue;
+            string path = token;
+            rewrite_filename(path);
+            std::ifstream file(path, std::ios::binary);
+            if (file.fail()) {
+                sha.update(token + " missing\n");
+                continue;
+            }
+            std::stringstream text;
+            text << file.rdbuf();
+            sha.update(token + "\n" + text.str());
+        }
+        return sha.final() + "\n";
+    }
+
+    // Hashes the input design, the scratchpad and the plugin library, then
+    // records the commands of every label by running the script without
+    // executing them. Returns the label to resume from, loading its snapshot
+    // into the design, or an empty string when no snapshot is valid.
+    string cache_resume(RTLIL::Design *design)
+    {
+        string plugin = plugin_stamp();
+        if (plugin.empty()) {
+            log_warning("Can't identify the plugin library, ignoring -cache.\n");
+            cache_dir = "";
+            return string();
+        }
+
+        if (!check_file_exists(cache_dir) && !create_directory(cache_dir))
+            log_cmd_error("Can't create cache directory '%s'.\n", cache_dir.c_str());
+
+        SHA1 sha;
+        sha.update(stringf("%s\n", yosys_version_str) + plugin);
+
+        std::map<string, string> scratchpad;
+        for (auto &it : design->scratchpad)
+            scratchpad[it.first] = it.second;
+        for (auto &it : scratchpad)
+            sha.update(it.first + "=" + it.second + "\n");
+
+        // The autoidx line is left out, it depends on the commands executed
+        // before and not on the design itself
+        string input_file = make_temp_file();
+        Pass::call(design, std::vector<string>{"write_rtlil", input_file});
+        std::ifstream input(input_file);
+        for (string line; std::getline(input, line);)
+            if (line.compare(0, 8, "autoidx ") != 0)
+                sha.update(line + "\n");
+        input.close();
+        std::remove(input_file.c_str());
+
+        cachePlanning = true;
+        run_script(design);
+        cachePlanning = false;
+
+        // The key of a label covers everything executed up to its end and the
+        // share files read on the way
+        string state = sha.final();
+        for (auto &label : cachePlan) {
+            if (is_output_label(label.first))
+                break;
+            SHA1 key;
+            state += label.first + ":\n" + label.second + share_files_hash(label.second);
+            key.update(state);
+            cacheKeys.push_back(key.final());
+        }
+
+        for (int i = GetSize(cacheKeys) - 1; i >= 0; i--) {
+            if (i + 1 >= GetSize(cachePlan) || !check_file_exists(cache_file(i)))
+                continue;
+
+            log("Resuming after label '%s' from %s.\n", cachePlan[i].first.c_str(), cache_file(i).c_str());
+            while (!design->modules_.empty())
+                design->remove(design->modules_.begin()->second);
+            Pass::call(design, std::vector<string>{"read_rtlil", cache_file(i)});
+
+            cacheSkipping = true;
+            return cachePlan[i + 1].first;
+        }
+
+        log("No valid snapshot in %s.\n", cache_dir.c_str());
+        return string();
+    }
+
+    // Saves the design after the given label unless it is not cacheable or a
+    // snapshot with the same key exists
+    void cache_save(int label)
+    {
+        if (label < 0 || label >= GetSize(cacheKeys) || check_file_exists(cache_file(label)))
+            return;
+
+        // Write to a temporary file first so concurrent runs never see a
+        // partial snapshot
+        string temp_file = make_temp_file(cache_dir + "/snapshot_XXXXXX");
+        Pass::call(active_design, std::vector<string>{"write_rtlil", temp_file});
+        if (std::rename(temp_file.c_str(), cache_file(label).c_str()) != 0) {
+            log_warning("Can't save snapshot %s.\n", cache_file(label).c_str());
+            std::remove(temp_file.c_str());
+        }
+    }
+
+    // Shadow ScriptPass::check_label and ScriptPass::run to record the plan,
+    // skip the labels restored from a snapshot, save new snapshots and
+    // profile the commands.
+    bool check_label(string label, string info = string())
+    {
+        profileLabel = label;
+        if (!cache_dir.empty() && !help_mode) {
+            if (cachePlanning) {
+                cachePlan.push_back({label, string()});
+            } else {
+                // Entering a label completes the previous one
+                if (!cacheSkipping && block_active)
+                    cache_save(cacheLabel);
+                cacheLabel++;
+                if (cacheSkipping && label == active_run_from)
+                    cacheSkipping = false;
+            }
+        }
+        return ScriptPass::check_label(label, info);
+    }
+
+    void run(string command, string info = string())
+    {
+        if (!cache_dir.empty() && !help_mode) {
+            if (cachePlanning) {
+                if (!cachePlan.empty())
+                    cachePlan.back().second += command + "\n";
+                return;
+            }
+            if (cacheSkipping)
+                return;
+        }
+        if (!profile_file.empty() && !help_mode) {
+            profile_run(command, info);
+            return;
+        }
+        ScriptPass::run(command, info);
+    }
+
     void script() override
     {
         if (check_label("begin")) {
@@ -277,15 +946,31 @@ struct SynthQuickLogicPass : public ScriptPass {
             noDFFArgs += " -nodffe";
         }
 
+        // Full opt rounds, shortened or extended by -effort
+        std::string optCmd = "opt";
+        if (effort == "low") {
+            optCmd = "opt -fast";
+        } else if (effort == "high") {
+            optCmd = "opt -full";
+        }
+
         if (check_label("coarse")) {
             run("check");
-            run("opt -nodffe -nosdff");
-            run("fsm");
-            run("opt" + noDFFArgs);
+            run(optCmd + " -nodffe -nosdff");
+            if (effort != "low" || help_mode) {
+                run("fsm", "                           (skip if -effort low)");
+            }
+            run(optCmd + noDFFArgs);
             run("wreduce");
-            run("peepopt");
+            if (effort != "low" || help_mode) {
+                run("peepopt", "                       (skip if -effort low)");
+            }
             run("opt_clean");
-            run("share");
+            if (effort == "high") {
+                run("share -aggressive");
+            } else if (effort != "low" || help_mode) {
+                run("share", "                         (skip if -effort low, -aggressive if -effort high)");
+            }
 
             if (family == "qlf_k6n10") {
                 if (help_mode || !nodsp) {
@@ -329,9 +1014,7 @@ struct SynthQuickLogicPass : public ScriptPass {
                         run("techmap -map +/quicklogic/" + family + "/dsp_map.v -D USE_DSP_CFG_PARAMS=0", "(for qlf_k6n10f if not -no_dsp)");
                     else
                         run("techmap -map +/quicklogic/" + family + "/dsp_map.v -D USE_DSP_CFG_PARAMS=1", "(for qlf_k6n10f if not -no_dsp)");
-                    run("ql_dsp_simd                   ", "(for qlf_k6n10f if not -no_dsp)");
-                    run("techmap -map +/quicklogic/" + family + "/dsp_final_map.v", "(for qlf_k6n10f if not -no_dsp)");
-                    run("ql_dsp_io_regs");
+                    run("ql_dsp_pack                   ", "(for qlf_k6n10f if not -no_dsp)");
                 } else if (!nodsp) {
 
                     run("wreduce t:$mul");
@@ -349,9 +1032,7 @@ struct SynthQuickLogicPass : public ScriptPass {
                         run("techmap -map +/quicklogic/" + family + "/dsp_map.v -D USE_DSP_CFG_PARAMS=0");
                     else
                         run("techmap -map +/quicklogic/" + family + "/dsp_map.v -D USE_DSP_CFG_PARAMS=1");
-                    run("ql_dsp_simd");
-                    run("techmap -map +/quicklogic/" + family + "/dsp_final_map.v");
-                    run("ql_dsp_io_regs");
+                    run("ql_dsp_pack");
                 }
             }
 
@@ -360,7 +1041,7 @@ struct SynthQuickLogicPass : public ScriptPass {
             run("opt_clean");
             run("alumacc");
             run("pmuxtree");
-            run("opt" + noDFFArgs);
+            run(optCmd + noDFFArgs);
             run("memory -nomap");
             run("opt_clean");
         }
@@ -380,52 +1061,8 @@ struct SynthQuickLogicPass : public ScriptPass {
                 run("techmap -map +/quicklogic/" + family + "/brams_final_map.v");
             }
 
-            // Data width to specialized cell type width map
-            const std::unordered_map<int, int> dataWidth36 = {{36, 36}, {32, 36}, {18, 18}, {16, 18}, {9, 9}, {8, 9}, {4, 4}, {2, 2}, {1, 1}};
-            const std::unordered_map<int, int> dataWidth18 = {{18, 18}, {16, 18}, {9, 9}, {8, 9}, {4, 4}, {2, 2}, {1, 1}};
-
-            // Perform a series of 'chtype' passess
-            if (bramTypes) {
-                for (const auto &ww : dataWidth18) {
-                    for (const auto &rw : dataWidth18) {
-                        auto cmd =
-                          stringf("chtype -set TDP36K_BRAM_WR_X%d_RD_X%d_split t:TDP36K a:is_inferred=1 %%i a:is_split=1 %%i a:wr_data_width=%d "
-                                  "%%i a:rd_data_width=%d %%i",
-                                  ww.second, rw.second, ww.first, rw.first);
-                        run(cmd);
-
-                        auto cmd1 = stringf("chtype -set TDP36K_FIFO_ASYNC_WR_X%d_RD_X%d_split t:TDP36K a:is_fifo=1 %%i a:sync_fifo=0 %%i "
-                                            "a:is_split=1 %%i a:wr_data_width=%d "
-                                            "%%i a:rd_data_width=%d %%i",
-                                            ww.second, rw.second, ww.first, rw.first);
-                        run(cmd1);
-
-                        auto cmd2 = stringf("chtype -set TDP36K_FIFO_SYNC_WR_X%d_RD_X%d_split t:TDP36K a:is_fifo=1 %%i a:sync_fifo=1 %%i "
-                                            "a:is_split=1 %%i a:wr_data_width=%d "
-                                            "%%i a:rd_data_width=%d %%i",
-                                            ww.second, rw.second, ww.first, rw.first);
-                        run(cmd2);
-                    }
-                }
-
-                for (const auto &ww : dataWidth36) {
-                    for (const auto &rw : dataWidth36) {
-                        auto cmd = stringf(
-                          "chtype -set TDP36K_BRAM_WR_X%d_RD_X%d_nonsplit t:TDP36K a:is_inferred=1 %%i a:wr_data_width=%d %%i a:rd_data_width=%d %%i",
-                          ww.second, rw.second, ww.first, rw.first);
-                        run(cmd);
-
-                        auto cmd1 = stringf("chtype -set TDP36K_FIFO_ASYNC_WR_X%d_RD_X%d_nonsplit t:TDP36K a:is_fifo=1 %%i a:sync_fifo=0 %%i "
-                                            "a:wr_data_width=%d %%i a:rd_data_width=%d %%i",
-                                            ww.second, rw.second, ww.first, rw.first);
-                        run(cmd1);
-
-                        auto cmd2 = stringf("chtype -set TDP36K_FIFO_SYNC_WR_X%d_RD_X%d_nonsplit t:TDP36K a:is_fifo=1 %%i a:sync_fifo=1 %%i "
-                                            "a:wr_data_width=%d %%i a:rd_data_width=%d %%i",
-                                            ww.second, rw.second, ww.first, rw.first);
-                        run(cmd2);
-                    }
-                }
+            if (bramTypes || help_mode) {
+                run("ql_bram_types", "(if -bram_types)");
             }
         }
 
@@ -450,7 +1087,7 @@ struct SynthQuickLogicPass : public ScriptPass {
             run("opt_expr");
             run("opt_merge");
             run("opt_clean");
-            run("opt" + noDFFArgs);
+            run(optCmd + noDFFArgs);
         }
 
         if (check_label("map_ffs")) {
@@ -487,33 +1124,38 @@ struct SynthQuickLogicPass : public ScriptPass {
             }
             run("opt_merge");
             run("opt_clean");
-            run("opt" + noDFFArgs);
+            run(optCmd + noDFFArgs);
         }
 
         if (check_label("map_luts")) {
             if (abcOpt) {
+                std::string abcCmd = abcJobs > 1 ? stringf("ql_abc_jobs -jobs %d", abcJobs) : "abc";
+                std::string abcFast = effort == "low" ? "-fast" : "";
                 if (family == "qlf_k6n10" || family == "qlf_k6n10f") {
-                    run("abc -lut 6 ");
+                    run(abcCmd + " -lut 6 " + abcFast);
                 } else if (family == "qlf_k4n8") {
-                    run("abc -lut 4 ");
+                    run(abcCmd + " -lut 4 " + abcFast);
                 } else if (family == "pp3") {
                     run("techmap -map +/quicklogic/" + family + "/latches_map.v");
                     if (abc9) {
                         run("read_verilog -lib -specify -icells +/quicklogic/" + family + "/abc9_model.v");
                         run("techmap -map +/quicklogic/" + family + "/abc9_map.v");
-                        run("abc9 -maxlut 4 -dff");
+                        run("abc9 -maxlut 4 -dff" + std::string(effort == "low" ? " -fast" : ""));
                         run("techmap -map +/quicklogic/" + family + "/abc9_unmap.v");
                     } else {
                         std::string lutDefs = "+/quicklogic/" + family + "/lutdefs.txt";
                         rewrite_filename(lutDefs);
 
-                        std::string abcArgs = "+read_lut," + lutDefs +
-                                              ";"
-                                              "strash;ifraig;scorr;dc2;dretime;strash;dch,-f;if;mfs2;" // Common Yosys ABC script
-                                              "sweep;eliminate;if;mfs;lutpack;"                        // Optimization script
-                                              "dress";                                                 // "dress" to preserve names
+                        std::string abcArgs = "+read_lut," + lutDefs + ";";
+                        if (effort == "low") {
+                            abcArgs += "strash;if;"; // Minimal mapping script
+                        } else {
+                            abcArgs += "strash;ifraig;scorr;dc2;dretime;strash;dch,-f;if;mfs2;" // Common Yosys ABC script
+                                       "sweep;eliminate;if;mfs;lutpack;";                       // Optimization script
+                        }
+                        abcArgs += "dress"; // "dress" to preserve names
 
-                        run("abc -script " + abcArgs);
+                        run(abcCmd + " -script " + abcArgs);
                     }
                 }
             }
@@ -544,8 +1186,8 @@ struct SynthQuickLogicPass : public ScriptPass {
             if (family == "pp3") {
                 run("setundef -zero -params -undriven");
             }
-            if (family == "pp3" || (check_label("edif") && (!edif_file.empty()))) {
-                run("hilomap -hicell logic_1 a -locell logic_0 a -singleton A:top");
+            if (help_mode || family == "pp3" || !edif_file.empty()) {
+                run("hilomap -hicell logic_1 a -locell logic_0 a -singleton A:top", "(for pp3 or if -edif)");
             }
             run("opt_clean -purge");
             run("check");
@@ -559,7 +1201,6 @@ struct SynthQuickLogicPass : public ScriptPass {
         }
 
         if (check_label("edif") && (!edif_file.empty())) {
-            run("splitnets -ports -format ()");
             run("quicklogic_eqn");
 
             run(stringf("write_ql_edif -nogndvcc -attrprop -pvector par %s %s", this->currmodule.c_str(), edif_file.c_str()));
@@ -0,0 +1,39 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+# Partitioned mapping for qlf_k4n8 device
+read_verilog $::env(DESIGN_TOP).v
+hierarchy -top top
+yosys proc
+equiv_opt -assert -map +/quicklogic/qlf_k4n8/cells_sim.v synth_quicklogic -family qlf_k4n8 -abc_jobs 4
+design -load postopt
+yosys cd top
+
+stat
+select -assert-none t:\$_*_
+
+design -reset
+
+# Partitioned mapping for qlf_k6n10f device
+read_verilog $::env(DESIGN_TOP).v
+hierarchy -top top
+yosys proc
+equiv_opt -assert -map +/quicklogic/qlf_k6n10f/cells_sim.v synth_quicklogic -family qlf_k6n10f -abc_jobs 4
+design -load postopt
+yosys cd top
+
+stat
+select -assert-none t:\$_*_
+
+design -reset
+
+# Quality check against a single ABC run
+read_verilog $::env(DESIGN_TOP).v
+hierarchy -top top
+yosys proc
+synth_quicklogic -family qlf_k4n8 -run :map_luts
+# A worse partitioned result is reported with a warning
+logger -expect-no-warnings
+ql_abc_jobs -jobs 4 -lut 4 -check
+select -assert-none t:\$_*_
@@ -0,0 +1,27 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Four independent cones of logic, one per output bit
+module top (
+    input  [15:0] a,
+    input  [15:0] b,
+    output [ 3:0] y
+);
+  assign y[0] = ^(a[3:0] & b[3:0]);
+  assign y[1] = |(a[7:4] ^ b[7:4]);
+  assign y[2] = &(a[11:8] | b[11:8]);
+  assign y[3] = (a[15:12] == b[15:12]);
+endmodule
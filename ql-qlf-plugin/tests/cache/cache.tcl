@@ -0,0 +1,34 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+design -save input
+
+set cache [test_output_path "cache"]
+file delete -force $cache
+
+proc snapshots { cache } {
+    return [llength [glob -nocomplain -directory $cache *.il]]
+}
+
+# The first run saves a snapshot after each of the 12 labels up to finalize
+synth_quicklogic -family qlf_k4n8 -top cache -cache $cache
+yosys cd cache
+select -assert-count 4 t:dffsr
+if { [snapshots $cache] != 12 } { error "Expected 12 snapshots, found [snapshots $cache]" }
+
+# The same run resumes after finalize and adds no snapshot
+design -load input
+synth_quicklogic -family qlf_k4n8 -top cache -cache $cache
+yosys cd cache
+select -assert-count 4 t:dffsr
+if { [snapshots $cache] != 12 } { error "Expected 12 snapshots, found [snapshots $cache]" }
+
+# Changing map_luts resumes after map_ffs and adds the 5 snapshots from
+# map_luts to finalize
+design -load input
+synth_quicklogic -family qlf_k4n8 -top cache -cache $cache -no_abc_opt
+yosys cd cache
+select -assert-count 4 t:dffsr
+if { [snapshots $cache] != 17 } { error "Expected 17 snapshots, found [snapshots $cache]" }
@@ -0,0 +1 @@
+../../../third_party/VexRiscv_Lite/VexRiscv_Lite.v
\ No newline at end of file
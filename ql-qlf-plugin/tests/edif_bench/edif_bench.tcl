@@ -0,0 +1,33 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+# Throughput benchmark of write_ql_edif. Each design is synthesized once and
+# then written EDIF_BENCH_RUNS times. Every run of write_ql_edif reports the
+# number of cells written and the throughput in cells/s, these lines are
+# collected in edif_bench.txt.
+
+set runs 5
+if { [info exists ::env(EDIF_BENCH_RUNS)] } { set runs $::env(EDIF_BENCH_RUNS) }
+set result edif_bench.txt
+file delete -force $result
+
+proc bench { name runs result } {
+    for {set i 0} {$i < $runs} {incr i} {
+        tee -q -a $result write_ql_edif -nogndvcc -attrprop -pvector par $name.edif
+    }
+}
+
+read_verilog VexRiscv_Lite.v
+synth_quicklogic -family qlf_k6n10f -top VexRiscv
+bench VexRiscv_Lite $runs $result
+
+design -reset
+
+# The Xilinx primitives instantiated by the SoC are kept as black boxes.
+read_verilog -lib -specify +/xilinx/cells_sim.v
+read_verilog -lib +/xilinx/cells_xtra.v
+read_verilog minilitex_ddr_arty.v
+read_verilog VexRiscv_Lite.v
+synth_quicklogic -family qlf_k6n10f -top top
+bench minilitex_ddr_arty $runs $result
@@ -0,0 +1 @@
+../../../third_party/minilitex_ddr_arty/minilitex_ddr_arty.v
\ No newline at end of file
@@ -0,0 +1,31 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+
+set edif_file [test_output_path "edif_bus.edif"]
+synth_quicklogic -family pp3 -top edif_bus -edif $edif_file
+
+# The buses are kept in the design...
+yosys cd edif_bus
+select -assert-count 1 w:a
+select -assert-count 1 w:q
+
+# ...and written as EDIF arrays referenced by member
+set fh [open $edif_file r]
+set edif [read $fh]
+close $fh
+
+foreach pattern {
+    {*(port (array (rename a "a(7:0)") 8) (direction INPUT))*}
+    {*(port (array (rename q "q(7:0)") 8) (direction OUTPUT))*}
+    {*(portRef (member a 0))*}
+    {*(portRef (member a 7))*}
+    {*(portRef (member q 0))*}
+    {*(portRef (member q 7))*}
+} {
+    if { ![string match $pattern $edif] } {
+        error "EDIF output does not match $pattern"
+    }
+}
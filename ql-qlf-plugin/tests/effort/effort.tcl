@@ -0,0 +1,36 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+design -save read
+
+# Low effort for qlf_k4n8 device
+design -load read
+hierarchy -top top
+yosys proc
+equiv_opt -assert -async2sync -map +/quicklogic/qlf_k4n8/cells_sim.v synth_quicklogic -family qlf_k4n8 -effort low
+design -load postopt
+yosys cd top
+stat
+select -assert-none t:\$_*_
+
+# High effort for qlf_k4n8 device
+design -load read
+hierarchy -top top
+yosys proc
+equiv_opt -assert -async2sync -map +/quicklogic/qlf_k4n8/cells_sim.v synth_quicklogic -family qlf_k4n8 -effort high
+design -load postopt
+yosys cd top
+stat
+select -assert-none t:\$_*_
+
+# Low effort for qlf_k6n10f device
+design -load read
+hierarchy -top top
+yosys proc
+equiv_opt -assert -async2sync -map +/quicklogic/qlf_k6n10f/cells_sim.v synth_quicklogic -family qlf_k6n10f -effort low
+design -load postopt
+yosys cd top
+stat
+select -assert-none t:\$_*_
@@ -0,0 +1,35 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Counter with a registered, shared-operand datapath
+module top (
+    input             clk,
+    input             rst,
+    input             sel,
+    input      [ 7:0] a,
+    input      [ 7:0] b,
+    output reg [ 7:0] q,
+    output reg [ 3:0] cnt
+);
+  always @(posedge clk)
+    if (rst) begin
+      q   <= 8'd0;
+      cnt <= 4'd0;
+    end else begin
+      q   <= sel ? a + b : a + q;
+      cnt <= cnt + 1'b1;
+    end
+endmodule
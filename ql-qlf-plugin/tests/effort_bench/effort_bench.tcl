@@ -0,0 +1,55 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+# Runtime and result size of synth_quicklogic -effort low|normal|high. Each
+# design is synthesized for qlf_k6n10f once per effort level with -profile.
+# The total wall time and the final cell count from every profile are
+# collected in effort_bench.txt, followed by the 'stat' of each result.
+
+set result effort_bench.txt
+file delete -force $result
+
+proc read_effort {} {
+    read_verilog ../effort/effort.v
+}
+
+proc read_vexriscv {} {
+    read_verilog ../edif_bench/VexRiscv_Lite.v
+}
+
+# The Xilinx primitives instantiated by the SoC are kept as black boxes.
+proc read_minilitex {} {
+    read_verilog -lib -specify +/xilinx/cells_sim.v
+    read_verilog -lib +/xilinx/cells_xtra.v
+    read_verilog ../edif_bench/minilitex_ddr_arty.v
+    read_verilog ../edif_bench/VexRiscv_Lite.v
+}
+
+proc bench { name reader top result } {
+    foreach effort {low normal high} {
+        design -reset
+        $reader
+        set profile_file ${name}_${effort}.json
+        synth_quicklogic -family qlf_k6n10f -top $top -effort $effort -profile $profile_file
+
+        set fh [open $profile_file r]
+        set profile [read $fh]
+        close $fh
+
+        # Labels are written in execution order, the last cell count is the
+        # one of the final netlist.
+        regexp {"total": \{[^\}]*"wall_s": ([0-9.eE+-]+)} $profile -> wall
+        set cells [lindex [regexp -all -inline {"cells_after": ([0-9]+)} $profile] end]
+
+        set fh [open $result a]
+        puts $fh [format "%-20s %-8s wall_s %8.2f cells %8d" $name $effort $wall $cells]
+        close $fh
+
+        tee -q -a ${name}_${effort}.stat stat
+    }
+}
+
+bench effort read_effort top $result
+bench VexRiscv_Lite read_vexriscv VexRiscv $result
+bench minilitex_ddr_arty read_minilitex top $result
@@ -0,0 +1,16 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+
+# Binary init file with x/z digits, '_' separators, comments, an address
+# gap and two words beyond the memory depth
+logger -expect log "Attempt to initialize 2 non existent address" 1
+pp3_braminit -readmemb
+yosys cd top
+
+# Word 3, word 2 (not in the file), word 1, word 0
+set INIT 36'b11111000000000000001x10z011100000001
+select -assert-count 1 t:RAM_8K_BLK r:INIT=$INIT %i
+select -assert-none t:RAM_8K_BLK r:INIT_FILE %i
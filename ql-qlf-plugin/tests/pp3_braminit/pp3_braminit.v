@@ -0,0 +1,53 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+module top (
+    CLK,
+    WADR,
+    WDAT,
+    WEN,
+    RADR,
+    RDAT
+);
+
+  input wire CLK;
+
+  input wire [1:0] WADR;
+  input wire [8:0] WDAT;
+  input wire WEN;
+
+  input wire [1:0] RADR;
+  output wire [8:0] RDAT;
+
+  RAM_8K_BLK #(
+      .INIT_FILE     ("init_b.txt"),
+      .addr_int      (2),
+      .data_depth_int(4),
+      .data_width_int(9)
+  ) the_ram (
+      .WClk   (CLK),
+      .RClk   (CLK),
+      .WClk_En(1'b1),
+      .RClk_En(1'b1),
+      .WA     (WADR),
+      .WD     (WDAT),
+      .WEN    (WEN),
+      .RA     (RADR),
+      .RD     (RDAT)
+  );
+
+endmodule
@@ -0,0 +1,29 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+
+set profile_file [test_output_path "profile.json"]
+synth_quicklogic -family qlf_k4n8 -top profile -profile $profile_file
+yosys cd profile
+select -assert-count 4 t:dffsr
+
+set fh [open $profile_file r]
+set profile [read $fh]
+close $fh
+
+foreach pattern {
+    {*"format_version": 1*}
+    {*"family": "qlf_k4n8"*}
+    {*"label": "begin"*}
+    {*"label": "map_luts"*}
+    {*"command": "abc -lut 4 "*}
+    {*"cells_before": *}
+    {*"peak_rss_delta_kb": *}
+    {*"total": *}
+} {
+    if { ![string match $pattern $profile] } {
+        error "Profile does not match $pattern"
+    }
+}
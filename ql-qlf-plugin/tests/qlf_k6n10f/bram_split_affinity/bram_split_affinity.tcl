@@ -0,0 +1,20 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog -lib -specify +/quicklogic/qlf_k6n10f/brams_sim.v
+read_verilog $::env(DESIGN_TOP).v
+yosys cd top
+
+# Both pairs are made by affinity and the site utilization is reported
+logger -expect log {Packed 2 BRAM pair\(s\) in top: 2 by affinity} 1
+logger -expect log {BRAM sites in top: 4 before, 2 after packing; 18K half utilization 50\.0% before, 100\.0% after\.} 1
+ql_bram_split
+stat
+
+# Halves of the same clock domain are paired, whatever the cell order
+select -assert-count 2 t:BRAM2x18_TDP
+select -assert-none t:\$__QLF_FACTOR_BRAM18_TDP
+select -assert-count 1 w:clk1 %co t:BRAM2x18_TDP %i
+select -assert-count 1 w:clk2 %co t:BRAM2x18_TDP %i
+select -assert-none w:clk1 %co w:clk2 %co %i t:BRAM2x18_TDP %i
@@ -0,0 +1,99 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+// Four 18K BRAM halves of the same configuration in two clock domains,
+// declared interleaved. Halves of the same domain share the clock, the
+// address and the write enable.
+module top (
+    input  wire        clk1,
+    input  wire        clk2,
+    input  wire [ 9:0] addr1,
+    input  wire [ 9:0] addr2,
+    input  wire [17:0] din,
+    input  wire        we1,
+    input  wire        we2,
+    output wire [17:0] dout_a,
+    output wire [17:0] dout_b,
+    output wire [17:0] dout_c,
+    output wire [17:0] dout_d
+);
+
+  \$__QLF_FACTOR_BRAM18_TDP #(
+      .CFG_ABITS   (10),
+      .CFG_DBITS   (18),
+      .CFG_ENABLE_B(2),
+      .CFG_ENABLE_D(2)
+  ) ram_a (
+      .CLK1  (clk1),
+      .CLK2  (clk1),
+      .A1ADDR(addr1),
+      .A1DATA(dout_a),
+      .A1EN  (1'b1),
+      .B1ADDR(addr1),
+      .B1DATA(din),
+      .B1EN  ({we1, we1})
+  );
+
+  \$__QLF_FACTOR_BRAM18_TDP #(
+      .CFG_ABITS   (10),
+      .CFG_DBITS   (18),
+      .CFG_ENABLE_B(2),
+      .CFG_ENABLE_D(2)
+  ) ram_b (
+      .CLK1  (clk2),
+      .CLK2  (clk2),
+      .A1ADDR(addr2),
+      .A1DATA(dout_b),
+      .A1EN  (1'b1),
+      .B1ADDR(addr2),
+      .B1DATA(din),
+      .B1EN  ({we2, we2})
+  );
+
+  \$__QLF_FACTOR_BRAM18_TDP #(
+      .CFG_ABITS   (10),
+      .CFG_DBITS   (18),
+      .CFG_ENABLE_B(2),
+      .CFG_ENABLE_D(2)
+  ) ram_c (
+      .CLK1  (clk1),
+      .CLK2  (clk1),
+      .A1ADDR(addr1),
+      .A1DATA(dout_c),
+      .A1EN  (1'b1),
+      .B1ADDR(addr1),
+      .B1DATA(din),
+      .B1EN  ({we1, we1})
+  );
+
+  \$__QLF_FACTOR_BRAM18_TDP #(
+      .CFG_ABITS   (10),
+      .CFG_DBITS   (18),
+      .CFG_ENABLE_B(2),
+      .CFG_ENABLE_D(2)
+  ) ram_d (
+      .CLK1  (clk2),
+      .CLK2  (clk2),
+      .A1ADDR(addr2),
+      .A1DATA(dout_d),
+      .A1EN  (1'b1),
+      .B1ADDR(addr2),
+      .B1DATA(din),
+      .B1EN  ({we2, we2})
+  );
+
+endmodule
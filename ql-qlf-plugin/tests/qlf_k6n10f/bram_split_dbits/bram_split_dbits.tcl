@@ -0,0 +1,18 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog -lib -specify +/quicklogic/qlf_k6n10f/brams_sim.v
+read_verilog $::env(DESIGN_TOP).v
+yosys cd top
+
+# Halves with different CFG_DBITS are never merged, however much they share.
+# ram_a is paired with ram_c instead and ram_b is left alone.
+logger -expect log {BRAM sites in top: 3 before, 2 after packing; 18K half utilization 50\.0% before, 75\.0% after\.} 1
+ql_bram_split
+stat
+select -assert-count 1 t:BRAM2x18_TDP
+select -assert-count 1 t:BRAM2x18_TDP r:CFG_DBITS=18 %i
+select -assert-count 1 t:\$__QLF_FACTOR_BRAM18_TDP
+select -assert-count 1 c:ram_b t:\$__QLF_FACTOR_BRAM18_TDP %i
+select -assert-none c:ram_a c:ram_c
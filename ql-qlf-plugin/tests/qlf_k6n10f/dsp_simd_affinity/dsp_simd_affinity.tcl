@@ -0,0 +1,19 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf}
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+
+# Both pairs are made by affinity and reported with their score
+logger -expect log {SIMD: .* affinity [1-9][0-9]*} 2
+logger -expect log {Packed 2 SIMD pair\(s\) in top: 2 by affinity} 1
+synth_quicklogic -family qlf_k6n10f -top top
+yosys cd top
+stat
+
+# Each SIMD cell holds the two multipliers sharing an operand: one of them
+# is connected to x, the other one to y
+select -assert-count 2 t:QL_DSP2*
+select -assert-count 1 w:x %co t:QL_DSP2* %i
+select -assert-count 1 w:y %co t:QL_DSP2* %i
+select -assert-none w:x %co w:y %co %i t:QL_DSP2* %i
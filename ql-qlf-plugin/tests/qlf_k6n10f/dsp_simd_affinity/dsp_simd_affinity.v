@@ -0,0 +1,111 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+// Two 10x9 multipliers per instance of sub. The multipliers of one instance
+// share nothing but the hierarchy, the ones in the same position of the two
+// instances share their first operand. The operand sharing outweighs the
+// hierarchy, so the SIMD pairs are made across the instances.
+module sub (
+    input  wire         clk,
+
+    input  wire [ 7:0]  a0,
+    input  wire [ 7:0]  b0,
+    output wire [15:0]  z0,
+
+    input  wire [ 7:0]  a1,
+    input  wire [ 7:0]  b1,
+    output wire [15:0]  z1
+);
+
+    dsp_t1_10x9x32_cfg_ports dsp_0 (
+        .a_i    (a0),
+        .b_i    (b0),
+        .z_o    (z0),
+
+        .clock_i            (clk),
+
+        .feedback_i         (3'd0),
+        .load_acc_i         (1'b0),
+        .unsigned_a_i       (1'b1),
+        .unsigned_b_i       (1'b1),
+
+        .output_select_i    (3'd0),
+        .saturate_enable_i  (1'b0),
+        .shift_right_i      (6'd0),
+        .round_i            (1'b0),
+        .subtract_i         (1'b0),
+        .register_inputs_i  (1'b0)
+    );
+
+    dsp_t1_10x9x32_cfg_ports dsp_1 (
+        .a_i    (a1),
+        .b_i    (b1),
+        .z_o    (z1),
+
+        .clock_i            (clk),
+
+        .feedback_i         (3'd0),
+        .load_acc_i         (1'b0),
+        .unsigned_a_i       (1'b1),
+        .unsigned_b_i       (1'b1),
+
+        .output_select_i    (3'd0),
+        .saturate_enable_i  (1'b0),
+        .shift_right_i      (6'd0),
+        .round_i            (1'b0),
+        .subtract_i         (1'b0),
+        .register_inputs_i  (1'b0)
+    );
+
+endmodule
+
+module top (
+    input  wire         clk,
+
+    input  wire [ 7:0]  x,
+    input  wire [ 7:0]  y,
+    input  wire [ 7:0]  b0,
+    input  wire [ 7:0]  b1,
+    input  wire [ 7:0]  b2,
+    input  wire [ 7:0]  b3,
+    output wire [15:0]  z0,
+    output wire [15:0]  z1,
+    output wire [15:0]  z2,
+    output wire [15:0]  z3
+);
+
+    sub u0 (
+        .clk    (clk),
+        .a0     (x),
+        .b0     (b0),
+        .z0     (z0),
+        .a1     (y),
+        .b1     (b1),
+        .z1     (z1)
+    );
+
+    sub u1 (
+        .clk    (clk),
+        .a0     (x),
+        .b0     (b2),
+        .z0     (z2),
+        .a1     (y),
+        .b1     (b3),
+        .z1     (z3)
+    );
+
+endmodule
@@ -0,0 +1,15 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+quicklogic_eqn
+yosys cd top
+
+# Minimized equations of known truth tables. The patterns are globs, so '*'
+# also matches longer products, which the I1 check rules out for lut_and.
+select -assert-count 1 c:lut_zero r:EQN=0 %i
+select -assert-count 1 c:lut_one r:EQN=(I0)+(~I0) %i
+select -assert-count 1 c:lut_and r:EQN=(I0*I2) %i
+select -assert-none c:lut_and r:EQN=*I1* %i
+select -assert-count 1 c:lut_xor r:EQN=(I0*~I1)+(~I0*I1) %i
@@ -0,0 +1,60 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+
+module top (
+    input  wire [2:0] I,
+    output wire [3:0] O
+);
+
+  // Constant 0
+  LUT2 #(
+      .INIT(4'b0000)
+  ) lut_zero (
+      .I0(I[0]),
+      .I1(I[1]),
+      .O (O[0])
+  );
+
+  // Constant 1
+  LUT2 #(
+      .INIT(4'b1111)
+  ) lut_one (
+      .I0(I[0]),
+      .I1(I[1]),
+      .O (O[1])
+  );
+
+  // I0 & I2, I1 is ignored
+  LUT3 #(
+      .INIT(8'b10100000)
+  ) lut_and (
+      .I0(I[0]),
+      .I1(I[1]),
+      .I2(I[2]),
+      .O (O[2])
+  );
+
+  // I0 ^ I1
+  LUT2 #(
+      .INIT(4'b0110)
+  ) lut_xor (
+      .I0(I[0]),
+      .I1(I[1]),
+      .O (O[3])
+  );
+
+endmodule
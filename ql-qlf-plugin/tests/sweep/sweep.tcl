@@ -0,0 +1,23 @@
+yosys -import
+if { [info procs quicklogic_eqn] == {} } { plugin -i ql-qlf }
+yosys -import  ;# ingest plugin commands
+
+read_verilog $::env(DESIGN_TOP).v
+design -save read
+
+# Sweep option sets for qlf_k6n10f device
+design -load read
+# Every option set must report its runtime and cell count, a failed set is an error
+logger -expect log {^\s+[0-9]+\s+\S.*\s[0-9]+\.[0-9]{2}\s+[0-9]+\.[0-9]{2}\s+[0-9]+} 4
+# Every set maps the 8 flip-flops, with a synchronous reset unless -nosdff
+logger -expect log {^\s+sdffsre\s+8\s+0\s+8\s+8\s} 1
+logger -expect log {^\s+dffsre\s+0\s+8\s+0\s+0\s} 1
+synth_quicklogic -family qlf_k6n10f -top top -sweep default,-nosdff,-no_adder+-effort=low,-no_abc_opt
+yosys cd top
+
+# The design is left after 'prepare': processes are converted, nothing is
+# mapped
+select -assert-none p:*
+select -assert-count 1 t:\$dff
+select -assert-none t:adder_carry t:\$lut t:sdffsre t:dffsre
+select -assert-count 1 t:\$add
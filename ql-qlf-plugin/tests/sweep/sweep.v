@@ -0,0 +1,28 @@
+// Copyright 2020-2022 F4PGA Authors
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//
+// SPDX-License-Identifier: Apache-2.0
+
+// Registered adder with a synchronous reset
+module top (
+    input            clk,
+    input            rst,
+    input      [7:0] a,
+    input      [7:0] b,
+    output reg [7:0] q
+);
+  always @(posedge clk)
+    if (rst) q <= 8'd0;
+    else q <= a + b;
+endmodule